@@ -2,20 +2,58 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
-#include "lbfgsb.h"
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#  define HAVE_POSIX 1
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+#include "lbfgsb_private.h"
+
+// How the block of memory of a context has been allocated.
+#define ALLOC_CALLER 0 // Provided by the caller.
+#define ALLOC_HEAP   1 // By aligned_alloc().
+#define ALLOC_MAPPED 2 // By mmap().
 
-// Allocate a dynamic array of `n` elements of type `T`.
-#define NEW_ARRAY(n, T)  ((T*)malloc((n)*sizeof(T)))
+// Default size of huge pages.
+#define HUGE_PAGE_SIZE (2L << 20)
+
+int64_t lbfgsb_clock_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (int64_t)ts.tv_sec*INT64_C(1000000000) + ts.tv_nsec;
+    }
+#endif
+    return (int64_t)time(NULL)*INT64_C(1000000000);
+}
 
-// Allocate a dynamic array of `n` elements of type `T` filled with zeros.
-#define ZEROS(n, T)  ((T*)malloc((n)*sizeof(T)))
+int64_t lbfgsb_cpu_clock_ns(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+        return (int64_t)ts.tv_sec*INT64_C(1000000000) + ts.tv_nsec;
+    }
+#endif
+    return (int64_t)(1e9*(double)clock()/(double)CLOCKS_PER_SEC);
+}
 
 double lbfgsb_timer(void)
 {
-    double t;
-    LBFGSB_TIMER_(&t);
-    return t;
+    return 1e-9*(double)lbfgsb_cpu_clock_ns();
+}
+
+double lbfgsb_wall_time(void)
+{
+    return 1e-9*(double)lbfgsb_clock_ns();
 }
 
 static inline lbfgsb_task get_task(
@@ -24,8 +62,19 @@ static inline lbfgsb_task get_task(
     switch (buf[0]) {
     case 'F':
         if (buf[1] == 'G') {
+            if (buf[2] == '_' && buf[3] == 'T' && buf[4] == 'R') {
+                return LBFGSB_FG_TRIALS;
+            }
             return LBFGSB_FG;
         }
+        if (buf[1] == '_') {
+            return LBFGSB_F;
+        }
+        break;
+    case 'G':
+        if (buf[1] == '_') {
+            return LBFGSB_G;
+        }
         break;
     case 'N':
         if (buf[1] == 'E' && buf[2] == 'W' &&
@@ -55,6 +104,41 @@ static inline lbfgsb_task get_task(
     return LBFGSB_ERROR;
 }
 
+// Figure out where to resume the algorithm given the task message.  This
+// mimics the tests performed by the FORTRAN code on the leading characters.
+static inline lbfgsb_stage get_stage(
+    const character* buf)
+{
+    if (strncmp(buf, "START", 5) == 0) {
+        return LBFGSB_STAGE_START;
+    }
+    if (strncmp(buf, "FG_LN", 5) == 0) {
+        return LBFGSB_STAGE_FG_LNSRCH;
+    }
+    if (strncmp(buf, "FG_ST", 5) == 0) {
+        return LBFGSB_STAGE_FG_START;
+    }
+    if (strncmp(buf, "FG_TR", 5) == 0) {
+        return LBFGSB_STAGE_FG_TRIALS;
+    }
+    if (strncmp(buf, "F_LNS", 5) == 0) {
+        return LBFGSB_STAGE_F_LNSRCH;
+    }
+    if (strncmp(buf, "G_LNS", 5) == 0) {
+        return LBFGSB_STAGE_G_LNSRCH;
+    }
+    if (strncmp(buf, "NEW_X", 5) == 0) {
+        return LBFGSB_STAGE_NEW_X;
+    }
+    if (strncmp(buf, "STOP", 4) == 0) {
+        if (strncmp(buf + 6, "CPU", 3) == 0) {
+            return LBFGSB_STAGE_STOP_CPU;
+        }
+        return LBFGSB_STAGE_STOP;
+    }
+    return LBFGSB_STAGE_DONE;
+}
+
 char* lbfgsb_get_task_string(
     lbfgsb_context* ctx,
     char*           buf,
@@ -83,6 +167,187 @@ char* lbfgsb_get_task_string(
     return buf;
 }
 
+// Messages of the termination of the algorithm by the engine and
+// corresponding reasons.
+static const struct {
+    const char*   mesg;
+    lbfgsb_status status;
+} status_table[] = {
+    {"CONVERGENCE: NORM_OF_PROJECTED_GRADIENT", LBFGSB_PGTOL_TEST},
+    {"CONVERGENCE: REL_REDUCTION_OF_F",         LBFGSB_FACTR_TEST},
+    {"CONVERGENCE: F_<=_FATOL",                 LBFGSB_FATOL_TEST},
+    {"CONVERGENCE: NORM_OF_STEP",               LBFGSB_XTOL_TEST},
+    {"WARNING: TOO_MANY_ITERATIONS",            LBFGSB_TOO_MANY_ITERATIONS},
+    {"WARNING: TOO_MANY_EVALUATIONS",           LBFGSB_TOO_MANY_EVALUATIONS},
+    {"WARNING: DEADLINE_REACHED",               LBFGSB_DEADLINE_REACHED},
+};
+
+lbfgsb_status lbfgsb_get_status(
+    const lbfgsb_context* ctx)
+{
+    switch (ctx->task) {
+    case LBFGSB_CONVERGENCE:
+    case LBFGSB_WARNING:
+        for (size_t i = 0; i < sizeof(status_table)/sizeof(status_table[0]);
+             ++i) {
+            const char* mesg = status_table[i].mesg;
+            if (strncmp(ctx->wrks.task, mesg, strlen(mesg)) == 0) {
+                return status_table[i].status;
+            }
+        }
+        return LBFGSB_FAILURE;
+    case LBFGSB_STOP:
+        return LBFGSB_STOPPED;
+    case LBFGSB_ERROR:
+        return LBFGSB_FAILURE;
+    default:
+        return LBFGSB_RUNNING;
+    }
+}
+
+int lbfgsb_get_stats(
+    const lbfgsb_context* ctx,
+    lbfgsb_stats*         stats)
+{
+    const lbfgsb_workspace* w = &ctx->wrks;
+    memset(stats, 0, sizeof(*stats));
+    stats->iters    = w->iter;
+    stats->evals    = w->nfgv;
+    stats->restarts = w->nreset;
+    stats->skips    = w->nskip;
+    stats->segments = w->nintol;
+#ifdef LBFGSB_NO_STATS
+    errno = ENOSYS;
+    return -1;
+#else
+    for (int p = 0; p < LBFGSB_NPHASES; ++p) {
+        stats->wall_ns[p] = w->wall_ns[p];
+        stats->cpu_ns[p]  = w->cpu_ns[p];
+    }
+    stats->bytes = w->bytes;
+    return 0;
+#endif
+}
+
+// Yield `a*b + c` for nonnegative `a`, `b` and `c` or -1 if any argument is
+// negative or in case of overflow.
+static long muladd(
+    long a,
+    long b,
+    long c)
+{
+    if (a < 0 || b < 0 || c < 0 || (a > 0 && b > (LONG_MAX - c)/a)) {
+        return -1;
+    }
+    return a*b + c;
+}
+
+// Ring buffer of the iteration trace.  The engine is the only writer and a
+// single reader may run in another thread.  The record of index `k` (counted
+// from the creation of the trace) is stored in `rec[k%capacity]`.  `count`
+// and `tail` are the numbers of records written and read, each is only
+// modified by one side, so the records are exchanged without locks.  When
+// the buffer is full, new records are dropped until the reader catches up.
+typedef struct lbfgsb_trace {
+    long capacity;
+    _Atomic int64_t count;
+    _Atomic int64_t tail;
+    lbfgsb_trace_record rec[];
+} lbfgsb_trace;
+
+int lbfgsb_set_trace(
+    lbfgsb_context* ctx,
+    long            capacity)
+{
+    if (capacity < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    lbfgsb_trace* trace = NULL;
+    if (capacity > 0) {
+        long size = muladd(capacity, sizeof(lbfgsb_trace_record),
+                           offsetof(lbfgsb_trace, rec));
+        if (size < 0) {
+            errno = EOVERFLOW;
+            return -1;
+        }
+        trace = malloc(size);
+        if (trace == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        trace->capacity = capacity;
+        atomic_init(&trace->count, 0);
+        atomic_init(&trace->tail, 0);
+    }
+    free(ctx->wrks.trace);
+    ctx->wrks.trace = trace;
+    return 0;
+}
+
+void lbfgsb_push_trace(
+    lbfgsb_workspace* w,
+    double            f)
+{
+    lbfgsb_trace* trace = w->trace;
+    int64_t k = atomic_load_explicit(&trace->count, memory_order_relaxed);
+    if (k - atomic_load_explicit(&trace->tail, memory_order_acquire) >=
+        trace->capacity) {
+        return;
+    }
+    lbfgsb_trace_record* rec = &trace->rec[k%trace->capacity];
+    rec->iter   = w->iter;
+    rec->nfgv   = w->nfgv;
+    rec->nseg   = w->nseg;
+    rec->nact   = w->nact;
+    rec->f      = f;
+    rec->sbgnrm = w->sbgnrm;
+    rec->stp    = w->stp;
+    rec->xstep  = w->xstep;
+    for (int p = 0; p < LBFGSB_NPHASES; ++p) {
+        rec->wall_ns[p] = w->wall_ns[p];
+    }
+    atomic_store_explicit(&trace->count, k + 1, memory_order_release);
+}
+
+long lbfgsb_read_trace(
+    lbfgsb_context*     ctx,
+    lbfgsb_trace_record rec[],
+    long                max)
+{
+    lbfgsb_trace* trace = ctx->wrks.trace;
+    if (trace == NULL || max <= 0) {
+        return 0;
+    }
+    int64_t first = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    int64_t count = atomic_load_explicit(&trace->count, memory_order_acquire);
+    int64_t last = (count - first > max ? first + max : count);
+    for (int64_t k = first; k < last; ++k) {
+        rec[k - first] = trace->rec[k%trace->capacity];
+    }
+    atomic_store_explicit(&trace->tail, last, memory_order_release);
+    return (long)(last - first);
+}
+
+void lbfgsb_set_output(
+    lbfgsb_context* ctx,
+    FILE*           out)
+{
+    ctx->wrks.output = out;
+}
+
+void lbfgsb_set_summary(
+    lbfgsb_context* ctx,
+    FILE*           file)
+{
+    // A summary being written goes on in the new stream, if any.
+    lbfgsb_workspace* w = &ctx->wrks;
+    if (w->itfile != NULL) {
+        w->itfile = file;
+    }
+    w->summary = file;
+}
+
 lbfgsb_task lbfgsb_set_task(
     lbfgsb_context* ctx,
     const char*     str)
@@ -99,10 +364,77 @@ lbfgsb_task lbfgsb_set_task(
     for (long i = len1; i < len2; ++i) {
         task[i] = ' ';
     }
-    ctx->task = get_task(ctx->wrks.task);
+    ctx->task = get_task(task);
+    ctx->wrks.stage = get_stage(task);
+    if (ctx->wrks.stage == LBFGSB_STAGE_START) {
+        // Cold start unless lbfgsb_restart_warm() says otherwise.
+        ctx->wrks.warm = 0;
+    }
     return ctx->task;
 }
 
+void lbfgsb_set_task_(
+    lbfgsb_context* ctx,
+    lbfgsb_task     task,
+    lbfgsb_stage    stage,
+    const char*     mesg)
+{
+    character* buf = ctx->wrks.task;
+    long len = (mesg == NULL ? 0 : strlen(mesg));
+    if (len > LBFGSB_TASK_LENGTH) {
+        len = LBFGSB_TASK_LENGTH;
+    }
+    memcpy(buf, mesg, len);
+    memset(buf + len, ' ', LBFGSB_TASK_LENGTH - len);
+    ctx->task = task;
+    ctx->wrks.stage = stage;
+}
+
+int lbfgsb_evaluate(
+    lbfgsb_context*    ctx,
+    double             x[],
+    double*            f,
+    double             g[],
+    lbfgsb_fg_callback fg,
+    void*              data)
+{
+    long n = ctx->siz;
+    int count = 1;
+    int status;
+    switch (ctx->task) {
+    case LBFGSB_FG:
+        status = fg(data, n, x, f, g);
+        break;
+    case LBFGSB_F:
+        status = fg(data, n, x, f, NULL);
+        break;
+    case LBFGSB_G:
+        // The function value is already known.
+        status = fg(data, n, x, NULL, g);
+        break;
+    case LBFGSB_FG_TRIALS: {
+        double* ft = lbfgsb_get_trial_f(ctx);
+        status = 0;
+        for (count = 0; count < ctx->trials && status == 0; ++count) {
+            status = fg(data, n, lbfgsb_get_trial_x(ctx, count), &ft[count],
+                        lbfgsb_get_trial_g(ctx, count));
+        }
+        break;
+    }
+    default:
+        return 0;
+    }
+    if (status != 0) {
+        // In a line search, the engine restores the previous iterate.
+        lbfgsb_set_task_(ctx, LBFGSB_STOP,
+                         (ctx->wrks.stage == LBFGSB_STAGE_FG_START ?
+                          LBFGSB_STAGE_STOP : LBFGSB_STAGE_STOP_CPU),
+                         "STOP: EVALUATION FAILED");
+        return -1;
+    }
+    return count;
+}
+
 void lbfgsb_reset(
     lbfgsb_context* ctx,
     int full)
@@ -121,191 +453,852 @@ void lbfgsb_reset(
     lbfgsb_set_task(ctx, "START");
 }
 
-lbfgsb_context* lbfgsb_create(
-    long n,
-    long m)
+long lbfgsb_restart_warm(
+    lbfgsb_context* ctx)
+{
+    int valid = (ctx->task != LBFGSB_ERROR && ctx->wrks.col > 0);
+    lbfgsb_set_task(ctx, "START");
+    ctx->wrks.warm = valid;
+    return (valid ? (long)ctx->wrks.col : 0);
+}
+
+void lbfgsb_reset_f32(
+    lbfgsb_context_f32* ctx,
+    int full)
+{
+    if (full != 0) {
+        long         n = ctx->base.siz;
+        float*   lower = ctx->lower;
+        float*   upper = ctx->upper;
+        integer* bound = ctx->base.wrks.nbd;
+        for (long i = 0; i < n; ++i) {
+            lower[i] = -INFINITY;
+            upper[i] = +INFINITY;
+            bound[i] = 0;
+        }
+    }
+    lbfgsb_set_task(&ctx->base, "START");
+}
+
+// Yield `a` rounded up to a multiple of `LBFGSB_ALIGNMENT` or -1 if `a` is
+// negative or in case of overflow.
+static long align_up(
+    long a)
+{
+    const long align = LBFGSB_ALIGNMENT;
+    if (a < 0 || a > LONG_MAX - (align - 1)) {
+        return -1;
+    }
+    return ((a + (align - 1))/align)*align;
+}
+
+// Offsets (in bytes) of the arrays of a context stored in a single block of
+// memory starting with the context structure.  All offsets are multiples of
+// `LBFGSB_ALIGNMENT`.
+typedef struct block_layout {
+    long lower; // Lower bounds (n elements).
+    long upper; // Upper bounds (n elements).
+    long nbd;   // Kind of bounds (n integers).
+    long iwa;   // Integer workspace (3*n integers).
+    long wa;    // Floating-point workspace.
+    long hsize; // Size of the correction history.
+    long hist;  // Size of the correction history at the start of `wa`.
+    long vec;   // Size of the vectors of length n at the start of `wa`.
+    long size;  // Total size of the block.
+} block_layout;
+
+// Compute the layout of a context for `n` variables and `m` memorized steps.
+// If `single` is true, the variables are in single precision.  If `inblock`
+// is false, the correction history is not stored in the block.  Returns 0 on
+// success, -1 on failure with `errno` set.
+static int get_layout(
+    block_layout* b,
+    long          n,
+    long          m,
+    int           single,
+    int           inblock)
 {
-    // FIXME: check for integer overflow (in particular in n_wa below)
     if (n < 1 || m < 1) {
         errno = EINVAL;
-        return NULL;
+        return -1;
     }
-    lbfgsb_context* ctx = malloc(sizeof(lbfgsb_context));
-    if (ctx == NULL) {
-        return NULL;
+    long ctxsize = (single ? sizeof(lbfgsb_context_f32) :
+                    sizeof(lbfgsb_context));
+    long elsize = (single ? sizeof(float) : sizeof(double));
+
+    // The workspace `wa` stores the 2*m*n elements of the correction history
+    // (unless stored elsewhere) and the 5*n elements of the other vectors of
+    // length n, then (as in `setulb`) the (11*m + 8)*m double precision
+    // elements of the small matrices and vectors.  The size of the block
+    // must not overflow.
+    b->hsize = muladd(muladd(2, m, 0), n, 0);
+    b->hsize = muladd(b->hsize, elsize, 0);
+    b->hist  = (inblock ? b->hsize : 0);
+    b->lower = align_up(ctxsize);
+    b->upper = align_up(muladd(n, elsize, b->lower));
+    b->nbd   = align_up(muladd(n, elsize, b->upper));
+    b->iwa   = align_up(muladd(n, sizeof(integer), b->nbd));
+    b->wa    = align_up(muladd(muladd(3, n, 0), sizeof(integer), b->iwa));
+    b->vec   = align_up(muladd(muladd(5, n, 0), elsize, b->hist));
+    b->size  = align_up(muladd(muladd(muladd(11, m, 8), m, 0),
+                               sizeof(double), muladd(1, b->vec, b->wa)));
+    if (n > LBFGSB_INTEGER_MAX || b->hist < 0 || b->wa < 0 || b->vec < 0 ||
+        b->size < 0 || (unsigned long)b->size > SIZE_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    return 0;
+}
+
+// Set the pointers `ws` and `wy` to the correction history according to the
+// layout in use.
+static void link_history(
+    lbfgsb_workspace* w,
+    long              n,
+    long              m,
+    long              elsize)
+{
+    char* h = w->hist;
+    if (h == NULL) {
+        w->ws = NULL;
+        w->wy = NULL;
+    } else if (w->layout == LBFGSB_LAYOUT_INTERLEAVED) {
+        w->wy = h;
+        w->ws = h + m*elsize;
+    } else {
+        w->ws = h;
+        w->wy = h + m*n*elsize;
     }
-    memset(ctx, 0, sizeof(lbfgsb_context));
+}
+
+// Set the pointers to the arrays of a context for `n` variables and `m`
+// memorized steps stored in the block `buf` with layout `b`.  If `single` is
+// true, the variables are in single precision.  If the correction history is
+// not stored in the block, it must be set by the caller.
+static void link_block(
+    void*               buf,
+    const block_layout* b,
+    long                n,
+    long                m,
+    int                 single)
+{
+    char* blk = buf;
+    long elsize = (single ? sizeof(float) : sizeof(double));
+    lbfgsb_context* ctx = buf;
+    if (single) {
+        lbfgsb_context_f32* ctx_f32 = buf;
+        ctx_f32->lower = (float*)(blk + b->lower);
+        ctx_f32->upper = (float*)(blk + b->upper);
+    } else {
+        ctx->lower = (double*)(blk + b->lower);
+        ctx->upper = (double*)(blk + b->upper);
+    }
+    lbfgsb_workspace* w = &ctx->wrks;
+    char* v = blk + b->wa;
+    w->nbd    = (integer*)(blk + b->nbd);
+    w->iwa    = (integer*)(blk + b->iwa);
+    w->wa     = v;
+    w->hist   = (b->hist > 0 ? v : NULL);
+    link_history(w, n, m, elsize);
+    v += b->hist;
+    w->z      = v;
+    w->r      = v + n*elsize;
+    w->d      = v + 2*n*elsize;
+    w->t      = v + 3*n*elsize;
+    w->xp     = v + 4*n*elsize;
+    w->sy     = (double*)(blk + b->wa + b->vec);
+    w->ss     = w->sy  + m*m;
+    w->wt     = w->ss  + m*m;
+    w->wn     = w->wt  + m*m;
+    w->snd    = w->wn  + 4*m*m;
+    w->wa8    = w->snd + 4*m*m;
+    w->index  = w->iwa;
+    w->iwhere = w->iwa + n;
+    w->indx2  = w->iwa + 2*n;
+}
+
+// Initialize a context for `n` variables and `m` memorized steps in the
+// block `buf` with layout `b`.  If `single` is true, the variables are in
+// single precision.  Except for the bounds, the arrays are not initialized,
+// this is done at the start of each optimization.  If the correction history
+// is not stored in the block, it must be set by the caller.
+static lbfgsb_context* init_block(
+    void*               buf,
+    const block_layout* b,
+    long                n,
+    long                m,
+    int                 single)
+{
+    lbfgsb_context* ctx = buf;
+    memset(ctx, 0, b->lower);
     ctx->mem = m;
     ctx->siz = n;
     ctx->factr = 1.0e+7;
     ctx->pgtol = 1.0e-6;
+    ctx->fatol = -INFINITY;
+    ctx->xatol = 0.0;
+    ctx->xrtol = 0.0;
+    ctx->deadline = INFINITY;
+    ctx->maxiter = -1; // No limit.
+    ctx->maxeval = -1; // No limit.
     ctx->print = -1; // No output.
-#ifdef OLD_LBFGSB_VERSION
-   long n_wa = (2*m + 4)*n + 12*m*(m + 1);
-#else
-    long n_wa = (2*m + 5)*n + (11*m + 8)*m;
-#endif
-    if ((ctx->lower    = ZEROS(n,    double))  == NULL ||
-        (ctx->upper    = ZEROS(n,    double))  == NULL ||
-        (ctx->wrks.nbd = ZEROS(n,    integer)) == NULL ||
-        (ctx->wrks.wa  = ZEROS(n_wa, double))  == NULL ||
-        (ctx->wrks.iwa = ZEROS(3*n,  integer)) == NULL) {
-        lbfgsb_destroy(ctx);
-        return NULL;
+    ctx->nthreads = 1;
+    ctx->trials = 1;
+
+    // Partition the workspaces.  The correction history is stored in `hist`,
+    // `ws` and `wy` are set at the start of each optimization according to
+    // the chosen layout.
+    lbfgsb_workspace* w = &ctx->wrks;
+    w->layout = LBFGSB_LAYOUT_COLUMNS;
+    w->hinc   = 1;
+    w->hld    = n;
+    link_block(buf, b, n, m, single);
+
+    // Set the bounds.
+    if (single) {
+        lbfgsb_reset_f32((lbfgsb_context_f32*)ctx, 1);
+    } else {
+        lbfgsb_reset(ctx, 1);
     }
-    lbfgsb_reset(ctx, 1);
     return ctx;
 }
 
+// Check that `buf` is a suitable block for a context.
+static int check_buffer(
+    const void* buf)
+{
+    if (buf == NULL || (uintptr_t)buf % LBFGSB_ALIGNMENT != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+size_t lbfgsb_workspace_size(
+    long n,
+    long m)
+{
+    block_layout b;
+    return (get_layout(&b, n, m, 0, 1) == 0 ? b.size : 0);
+}
 
-#define free_memory(ptr)                        \
-    do {                                        \
-        void *ptr_ = (ptr);                     \
-        if (ptr_ != NULL) {                     \
-            (ptr) = NULL;                       \
-            free(ptr_);                         \
-        }                                       \
-    } while (0)
+size_t lbfgsb_workspace_size_f32(
+    long n,
+    long m)
+{
+    block_layout b;
+    return (get_layout(&b, n, m, 1, 1) == 0 ? b.size : 0);
+}
 
-void lbfgsb_destroy(lbfgsb_context* ctx)
+lbfgsb_context* lbfgsb_init_in_buffer(
+    void* buf,
+    long  n,
+    long  m)
 {
-    if (ctx != NULL) {
-        free_memory(ctx->lower);
-        free_memory(ctx->upper);
-        free_memory(ctx->wrks.nbd);
-        free_memory(ctx->wrks.wa);
-        free_memory(ctx->wrks.iwa);
-        free(ctx);
+    block_layout b;
+    if (check_buffer(buf) != 0 || get_layout(&b, n, m, 0, 1) != 0) {
+        return NULL;
     }
+    return init_block(buf, &b, n, m, 0);
 }
 
-static void check_bounds(
-    lbfgsb_context* ctx,
-    double          x[])
+lbfgsb_context_f32* lbfgsb_init_in_buffer_f32(
+    void* buf,
+    long  n,
+    long  m)
 {
-    long           n     = ctx->siz;
-    const double*  lower = ctx->lower;
-    const double*  upper = ctx->upper;
-    integer*       bound = ctx->wrks.nbd;
-    for (long i = 0; i < n; ++i) {
-        double lo = lower[i];
-        double hi = upper[i];
-        if (isnan(lo)) {
-            lbfgsb_set_task(ctx, "ERROR: Invalid lower bound value");
-            break;
-        }
-        if (isnan(hi)) {
-            lbfgsb_set_task(ctx, "ERROR: Invalid upper bound value");
-            break;
-        }
-        if (lo > hi) {
-            lbfgsb_set_task(ctx, "ERROR: Incompatible bounds");
-            break;
-        }
-        if (lo > -INFINITY) {
-            if (hi < +INFINITY) {
-                bound[i] = 2;
-            } else {
-                bound[i] = 1;
-            }
-        } else {
-            if (hi < +INFINITY) {
-                bound[i] = 3;
-            } else {
-                bound[i] = 0;
-            }
-        }
-#if 0 // Not needed, this is done by main L-BFGS-B subroutine.
-        if (x[i] > hi) {
-            x[i] = hi;
-        }
-        if (x[i] < lo) {
-            x[i] = lo;
-        }
-#endif
+    block_layout b;
+    if (check_buffer(buf) != 0 || get_layout(&b, n, m, 1, 1) != 0) {
+        return NULL;
     }
+    return (lbfgsb_context_f32*)init_block(buf, &b, n, m, 1);
 }
 
-lbfgsb_task lbfgsb_iterate(
-    lbfgsb_context* ctx,
-    double          x[],
-    double*         f,
-    double          g[])
+// Read in file `path` the first line starting with `key` and yield the
+// integer value that follows times `scale` or 0 if not found.
+static long read_value(
+    const char* path,
+    const char* key,
+    long        scale)
 {
-    if (ctx->task == LBFGSB_START) {
-        check_bounds(ctx, x);
+    char line[256];
+    long val = 0;
+    size_t len = strlen(key);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
     }
-    if (ctx->task != LBFGSB_ERROR) {
-        integer m = ctx->mem;
-        integer n = ctx->siz;
-        integer print = ctx->print;
-        LBFGSB_SETULB_(
-            &n, &m, x, ctx->lower, ctx->upper, ctx->wrks.nbd, f, g,
-            &ctx->factr, &ctx->pgtol, ctx->wrks.wa, ctx->wrks.iwa,
-            ctx->wrks.task, &print, ctx->wrks.csave, ctx->wrks.lsave,
-            ctx->wrks.isave, ctx->wrks.dsave);
-        ctx->task = get_task(ctx->wrks.task);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, key, len) == 0) {
+            if (sscanf(line + len, "%ld", &val) != 1 || val < 0) {
+                val = 0;
+            }
+            break;
+        }
     }
-    return ctx->task;
+    fclose(fp);
+    return val*scale;
 }
 
-lbfgsb_task lbfgsb_get_task(
-    const lbfgsb_context* ctx)
+// Yield the size of the default explicit huge pages or of the transparent
+// huge pages.
+static long huge_page_size(
+    int explicit)
 {
-    return ctx->task;
+    long size = (explicit ?
+                 read_value("/proc/meminfo", "Hugepagesize:", 1024) :
+                 read_value("/sys/kernel/mm/transparent_hugepage/"
+                            "hpage_pmd_size", "", 1));
+    return (size > 0 ? size : HUGE_PAGE_SIZE);
 }
 
-long lbfgsb_get_mem(
-    const lbfgsb_context* ctx)
+// Yield `a` rounded up to a multiple of `b` or 0 in case of overflow.
+static size_t round_up(
+    size_t a,
+    size_t b)
 {
-    return ctx->mem;
+    return (a > SIZE_MAX - (b - 1) ? 0 : ((a + (b - 1))/b)*b);
 }
 
-long lbfgsb_get_siz(
-    const lbfgsb_context* ctx)
+// Map `size` bytes of memory backed by the given kind of pages.  Returns the
+// address of the mapping and its size in `len`, or `NULL` with `errno` set.
+static void* map_block(
+    size_t       size,
+    lbfgsb_pages pages,
+    size_t*      len)
 {
-    return ctx->siz;
+#ifdef MAP_ANONYMOUS
+    const int prot = PROT_READ|PROT_WRITE;
+    const int flags = MAP_PRIVATE|MAP_ANONYMOUS;
+#  ifdef MAP_HUGETLB
+    if (pages == LBFGSB_PAGES_HUGETLB) {
+        *len = round_up(size, huge_page_size(1));
+        if (*len != 0) {
+            void* addr = mmap(NULL, *len, prot, flags|MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED) {
+                return addr;
+            }
+        }
+        // Fall back to transparent huge pages.
+    }
+#  endif
+
+    // Over-allocate to align the mapping on a huge page boundary, then unmap
+    // the unused leading and trailing parts.
+    size_t align = huge_page_size(0);
+    *len = round_up(size, sysconf(_SC_PAGESIZE));
+    if (*len == 0 || *len > SIZE_MAX - align) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    char* base = mmap(NULL, *len + align, prot, flags, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    char* addr = (char*)round_up((uintptr_t)base, align);
+    if (addr > base) {
+        munmap(base, addr - base);
+    }
+    if (addr + *len < base + *len + align) {
+        munmap(addr + *len, (base + *len + align) - (addr + *len));
+    }
+#  ifdef MADV_HUGEPAGE
+    if (pages != LBFGSB_PAGES_DEFAULT) {
+        madvise(addr, *len, MADV_HUGEPAGE);
+    }
+#  endif
+    return addr;
+#else
+    errno = ENOSYS;
+    return NULL;
+#endif
 }
 
-double *lbfgsb_get_lower(
-    const lbfgsb_context* ctx)
+// Allocate a block of `size` bytes for a context.  Returns `NULL` with `errno`
+// set in case of failure.
+static void* alloc_block(
+    size_t       size,
+    lbfgsb_pages pages,
+    int*         alloc,
+    size_t*      len)
 {
-    return ctx->lower;
+    void* buf = NULL;
+    *len = 0;
+    if (pages == LBFGSB_PAGES_DEFAULT) {
+        *alloc = ALLOC_HEAP;
+        buf = aligned_alloc(LBFGSB_ALIGNMENT, size);
+        if (buf == NULL) {
+            errno = ENOMEM;
+        }
+    } else {
+        *alloc = ALLOC_MAPPED;
+        buf = map_block(size, pages, len);
+    }
+    return buf;
 }
 
-double *lbfgsb_get_upper(
-    const lbfgsb_context* ctx)
+// Map the file `path` to store the `size` bytes of the correction history
+// of the context `ctx` whose variables have `elsize` bytes.  Returns 0 on
+// success, -1 on failure with `errno` set.
+static int map_history(
+    lbfgsb_context* ctx,
+    const char*     path,
+    size_t          size,
+    long            elsize)
 {
-    return ctx->upper;
+#ifdef MAP_SHARED
+    int fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        int code = errno;
+        close(fd);
+        errno = code;
+        return -1;
+    }
+    void* addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    int code = errno;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        errno = code;
+        return -1;
+    }
+#  ifdef MADV_SEQUENTIAL
+    // The history is swept in storage order by all the passes.
+    madvise(addr, size, MADV_SEQUENTIAL);
+#  endif
+    ctx->wrks.hist = addr;
+    ctx->wrks.hsiz = size;
+    link_history(&ctx->wrks, ctx->siz, ctx->mem, elsize);
+    return 0;
+#else
+    (void)ctx;
+    (void)path;
+    (void)size;
+    (void)elsize;
+    errno = ENOSYS;
+    return -1;
+#endif
 }
 
-double lbfgsb_get_factr(
-    const lbfgsb_context* ctx)
+// Create a context for `n` variables and `m` memorized steps in memory
+// backed by the given kind of pages.  If `single` is true, the variables are
+// in single precision.  If `path` is not `NULL`, the correction history is
+// mapped from this file.  Returns `NULL` with `errno` set in case of failure.
+static lbfgsb_context* create_context(
+    long         n,
+    long         m,
+    lbfgsb_pages pages,
+    int          single,
+    const char*  path)
 {
-    return ctx->factr;
+    block_layout b;
+    int alloc;
+    size_t len;
+    if (get_layout(&b, n, m, single, path == NULL) != 0) {
+        return NULL;
+    }
+    void* buf = alloc_block(b.size, pages, &alloc, &len);
+    if (buf == NULL) {
+        return NULL;
+    }
+    lbfgsb_context* ctx = init_block(buf, &b, n, m, single);
+    ctx->wrks.alloc = alloc;
+    ctx->wrks.mapsiz = len;
+    long elsize = (single ? sizeof(float) : sizeof(double));
+    if (path != NULL && map_history(ctx, path, b.hsize, elsize) != 0) {
+        int code = errno;
+        lbfgsb_destroy(ctx);
+        errno = code;
+        return NULL;
+    }
+    return ctx;
 }
 
-void lbfgsb_set_factr(
-    lbfgsb_context* ctx,
-    double factr)
+lbfgsb_context* lbfgsb_create(
+    long n,
+    long m)
 {
-    ctx->factr = factr;
+    return create_context(n, m, LBFGSB_PAGES_DEFAULT, 0, NULL);
 }
 
-double lbfgsb_get_pgtol(
-    const lbfgsb_context* ctx)
+lbfgsb_context_f32* lbfgsb_create_f32(
+    long n,
+    long m)
 {
-    return ctx->pgtol;
+    return (lbfgsb_context_f32*)create_context(n, m, LBFGSB_PAGES_DEFAULT,
+                                               1, NULL);
 }
 
-void lbfgsb_set_pgtol(
-    lbfgsb_context* ctx,
-    double pgtol)
+lbfgsb_context* lbfgsb_create_mapped(
+    long         n,
+    long         m,
+    lbfgsb_pages pages)
 {
-    ctx->pgtol = pgtol;
+    return create_context(n, m, pages, 0, NULL);
 }
 
-long lbfgsb_get_print(
+lbfgsb_context_f32* lbfgsb_create_mapped_f32(
+    long         n,
+    long         m,
+    lbfgsb_pages pages)
+{
+    return (lbfgsb_context_f32*)create_context(n, m, pages, 1, NULL);
+}
+
+lbfgsb_context* lbfgsb_create_out_of_core(
+    long        n,
+    long        m,
+    const char* path)
+{
+    if (path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return create_context(n, m, LBFGSB_PAGES_DEFAULT, 0, path);
+}
+
+lbfgsb_context_f32* lbfgsb_create_out_of_core_f32(
+    long        n,
+    long        m,
+    const char* path)
+{
+    if (path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return (lbfgsb_context_f32*)create_context(n, m, LBFGSB_PAGES_DEFAULT,
+                                               1, path);
+}
+
+void lbfgsb_destroy(lbfgsb_context* ctx)
+{
+    if (ctx != NULL) {
+        // Release the resources not stored in the block of the context.
+        free(ctx->wrks.part);
+        ctx->wrks.part = NULL;
+        free(ctx->wrks.trial);
+        ctx->wrks.trial = NULL;
+        free(ctx->wrks.trace);
+        ctx->wrks.trace = NULL;
+#ifdef MAP_SHARED
+        if (ctx->wrks.hsiz > 0) {
+            munmap(ctx->wrks.hist, ctx->wrks.hsiz);
+            ctx->wrks.hist = NULL;
+            ctx->wrks.hsiz = 0;
+        }
+#endif
+        if (ctx->wrks.alloc == ALLOC_HEAP) {
+            free(ctx);
+#ifdef MAP_ANONYMOUS
+        } else if (ctx->wrks.alloc == ALLOC_MAPPED) {
+            munmap(ctx, ctx->wrks.mapsiz);
+#endif
+        }
+    }
+}
+
+void lbfgsb_destroy_f32(lbfgsb_context_f32* ctx)
+{
+    if (ctx != NULL) {
+        lbfgsb_destroy(&ctx->base);
+    }
+}
+
+// Set the kind of bounds `nbd` for a variable with bounds `lo` and `hi`.
+// Returns an error message or `NULL` if the bounds are valid.
+static const char* bound_kind(
+    integer* nbd,
+    double   lo,
+    double   hi)
+{
+    if (isnan(lo)) {
+        return "ERROR: Invalid lower bound value";
+    }
+    if (isnan(hi)) {
+        return "ERROR: Invalid upper bound value";
+    }
+    if (lo > hi) {
+        return "ERROR: Incompatible bounds";
+    }
+    if (lo > -INFINITY) {
+        if (hi < +INFINITY) {
+            *nbd = 2;
+        } else {
+            *nbd = 1;
+        }
+    } else {
+        if (hi < +INFINITY) {
+            *nbd = 3;
+        } else {
+            *nbd = 0;
+        }
+    }
+    return NULL;
+}
+
+// Check the bounds and set the kind of bounds of each variable.  The initial
+// variables need not be projected, this is done by `mainlb`.  If no variable
+// has a finite bound, `mainlb` is instructed to compute the search
+// directions by the two-loop recursion of L-BFGS.
+static void check_bounds(
+    lbfgsb_context* ctx)
+{
+    long           n     = ctx->siz;
+    const double*  lower = ctx->lower;
+    const double*  upper = ctx->upper;
+    integer*       bound = ctx->wrks.nbd;
+    integer        any   = 0;
+    for (long i = 0; i < n; ++i) {
+        const char* mesg = bound_kind(&bound[i], lower[i], upper[i]);
+        if (mesg != NULL) {
+            lbfgsb_set_task(ctx, mesg);
+            break;
+        }
+        any |= bound[i];
+    }
+    ctx->wrks.uncons = (any == 0);
+}
+
+static void check_bounds_f32(
+    lbfgsb_context_f32* ctx)
+{
+    long           n     = ctx->base.siz;
+    const float*   lower = ctx->lower;
+    const float*   upper = ctx->upper;
+    integer*       bound = ctx->base.wrks.nbd;
+    integer        any   = 0;
+    for (long i = 0; i < n; ++i) {
+        const char* mesg = bound_kind(&bound[i], lower[i], upper[i]);
+        if (mesg != NULL) {
+            lbfgsb_set_task(&ctx->base, mesg);
+            break;
+        }
+        any |= bound[i];
+    }
+    ctx->base.wrks.uncons = (any == 0);
+}
+
+lbfgsb_task lbfgsb_iterate(
+    lbfgsb_context* ctx,
+    double          x[],
+    double*         f,
+    double          g[])
+{
+    if (ctx->task == LBFGSB_START) {
+        check_bounds(ctx);
+    }
+    if (ctx->task != LBFGSB_ERROR) {
+        lbfgsb_mainlb(ctx, ctx->lower, ctx->upper, x, f, g);
+    }
+    return ctx->task;
+}
+
+lbfgsb_task lbfgsb_minimize(
+    lbfgsb_context*      ctx,
+    lbfgsb_fg_callback   fg,
+    lbfgsb_newx_callback newx,
+    void*                data,
+    double               x[],
+    double*              f,
+    double               g[])
+{
+    // The engine is called directly: the bounds are only checked at the
+    // start and the task is decoded once per return of the engine.
+    while (1) {
+        switch (ctx->task) {
+        case LBFGSB_START:
+            check_bounds(ctx);
+            if (ctx->task == LBFGSB_ERROR) {
+                return ctx->task;
+            }
+            break;
+        case LBFGSB_FG:
+        case LBFGSB_FG_TRIALS:
+        case LBFGSB_F:
+        case LBFGSB_G:
+            lbfgsb_evaluate(ctx, x, f, g, fg, data);
+            break;
+        case LBFGSB_NEW_X:
+            if (newx != NULL && newx(data, ctx, x, *f, g) != 0 &&
+                ctx->task == LBFGSB_NEW_X) {
+                lbfgsb_set_task_(ctx, LBFGSB_STOP, LBFGSB_STAGE_STOP,
+                                 "STOP: REQUESTED BY THE CALLBACK");
+            }
+            break;
+        default:
+            return ctx->task;
+        }
+        lbfgsb_mainlb(ctx, ctx->lower, ctx->upper, x, f, g);
+    }
+}
+
+lbfgsb_task lbfgsb_iterate_f32(
+    lbfgsb_context_f32* ctx,
+    float               x[],
+    float*              f,
+    float               g[])
+{
+    lbfgsb_context* base = &ctx->base;
+    if (base->task == LBFGSB_START) {
+        check_bounds_f32(ctx);
+    }
+    if (base->task != LBFGSB_ERROR) {
+        double fx = *f;
+        lbfgsb_mainlb_f32(base, ctx->lower, ctx->upper, x, &fx, g);
+        *f = fx;
+    }
+    return base->task;
+}
+
+lbfgsb_task lbfgsb_get_task(
+    const lbfgsb_context* ctx)
+{
+    return ctx->task;
+}
+
+long lbfgsb_get_mem(
+    const lbfgsb_context* ctx)
+{
+    return ctx->mem;
+}
+
+long lbfgsb_get_siz(
+    const lbfgsb_context* ctx)
+{
+    return ctx->siz;
+}
+
+double *lbfgsb_get_lower(
+    const lbfgsb_context* ctx)
+{
+    return ctx->lower;
+}
+
+double *lbfgsb_get_upper(
+    const lbfgsb_context* ctx)
+{
+    return ctx->upper;
+}
+
+float* lbfgsb_get_lower_f32(
+    const lbfgsb_context_f32* ctx)
+{
+    return ctx->lower;
+}
+
+float* lbfgsb_get_upper_f32(
+    const lbfgsb_context_f32* ctx)
+{
+    return ctx->upper;
+}
+
+double lbfgsb_get_factr(
+    const lbfgsb_context* ctx)
+{
+    return ctx->factr;
+}
+
+void lbfgsb_set_factr(
+    lbfgsb_context* ctx,
+    double factr)
+{
+    ctx->factr = factr;
+}
+
+double lbfgsb_get_pgtol(
+    const lbfgsb_context* ctx)
+{
+    return ctx->pgtol;
+}
+
+void lbfgsb_set_pgtol(
+    lbfgsb_context* ctx,
+    double pgtol)
+{
+    ctx->pgtol = pgtol;
+}
+
+double lbfgsb_get_fatol(
+    const lbfgsb_context* ctx)
+{
+    return ctx->fatol;
+}
+
+void lbfgsb_set_fatol(
+    lbfgsb_context* ctx,
+    double fatol)
+{
+    ctx->fatol = fatol;
+}
+
+double lbfgsb_get_xatol(
+    const lbfgsb_context* ctx)
+{
+    return ctx->xatol;
+}
+
+void lbfgsb_set_xatol(
+    lbfgsb_context* ctx,
+    double xatol)
+{
+    ctx->xatol = xatol;
+}
+
+double lbfgsb_get_xrtol(
+    const lbfgsb_context* ctx)
+{
+    return ctx->xrtol;
+}
+
+void lbfgsb_set_xrtol(
+    lbfgsb_context* ctx,
+    double xrtol)
+{
+    ctx->xrtol = xrtol;
+}
+
+long lbfgsb_get_maxiter(
+    const lbfgsb_context* ctx)
+{
+    return ctx->maxiter;
+}
+
+void lbfgsb_set_maxiter(
+    lbfgsb_context* ctx,
+    long maxiter)
+{
+    ctx->maxiter = maxiter;
+}
+
+long lbfgsb_get_maxeval(
+    const lbfgsb_context* ctx)
+{
+    return ctx->maxeval;
+}
+
+void lbfgsb_set_maxeval(
+    lbfgsb_context* ctx,
+    long maxeval)
+{
+    ctx->maxeval = maxeval;
+}
+
+double lbfgsb_get_deadline(
+    const lbfgsb_context* ctx)
+{
+    return ctx->deadline;
+}
+
+void lbfgsb_set_deadline(
+    lbfgsb_context* ctx,
+    double deadline)
+{
+    ctx->deadline = deadline;
+}
+
+long lbfgsb_get_print(
     const lbfgsb_context* ctx)
 {
     return ctx->print;
@@ -318,13 +1311,743 @@ void lbfgsb_set_print(
     ctx->print = print;
 }
 
+lbfgsb_layout lbfgsb_get_layout(
+    const lbfgsb_context* ctx)
+{
+    return ctx->layout;
+}
+
+int lbfgsb_set_layout(
+    lbfgsb_context* ctx,
+    lbfgsb_layout layout)
+{
+    if (layout != LBFGSB_LAYOUT_COLUMNS &&
+        layout != LBFGSB_LAYOUT_INTERLEAVED) {
+        errno = EINVAL;
+        return -1;
+    }
+    ctx->layout = layout;
+    return 0;
+}
+
+int lbfgsb_get_threads(
+    const lbfgsb_context* ctx)
+{
+    return ctx->nthreads;
+}
+
+int lbfgsb_set_threads(
+    lbfgsb_context* ctx,
+    int nthreads)
+{
+    if (nthreads < 1 || nthreads > LBFGSB_MAX_THREADS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nthreads > 1) {
+        // Storage for the partial sums of length 2*m of each thread.
+        double* part = realloc(ctx->wrks.part,
+                               2*ctx->mem*nthreads*sizeof(double));
+        if (part == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        ctx->wrks.part = part;
+    }
+    ctx->nthreads = nthreads;
+    return 0;
+}
+
+int lbfgsb_get_lazy_gradient(
+    const lbfgsb_context* ctx)
+{
+    return ctx->lazy;
+}
+
+void lbfgsb_set_lazy_gradient(
+    lbfgsb_context* ctx,
+    int lazy)
+{
+    ctx->lazy = (lazy != 0);
+}
+
+static int set_trials(
+    lbfgsb_context* ctx,
+    int             ntrials,
+    size_t          elsize)
+{
+    if (ntrials < 1 || ntrials > LBFGSB_MAX_TRIALS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ntrials != ctx->trials) {
+        if (ctx->wrks.stage == LBFGSB_STAGE_FG_TRIALS) {
+            errno = EBUSY;
+            return -1;
+        }
+        free(ctx->wrks.trial);
+        ctx->wrks.trial = NULL;
+        ctx->trials = 1;
+        if (ntrials > 1) {
+            // Steps and function values, then points and gradients.
+            void* trial = malloc(2*ntrials*(sizeof(double) +
+                                            ctx->siz*elsize));
+            if (trial == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            ctx->wrks.trial = trial;
+        }
+        ctx->trials = ntrials;
+    }
+    return 0;
+}
+
+static void* get_trial_vector(
+    const lbfgsb_context* ctx,
+    int                   j,
+    size_t                elsize)
+{
+    if (ctx->wrks.trial == NULL || j < 0 || j >= 2*ctx->trials) {
+        return NULL;
+    }
+    return lbfgsb_trial_vector(ctx->wrks.trial, ctx->trials, ctx->siz,
+                               elsize, j);
+}
+
+int lbfgsb_get_trials(
+    const lbfgsb_context* ctx)
+{
+    return ctx->trials;
+}
+
+int lbfgsb_set_trials(
+    lbfgsb_context* ctx,
+    int ntrials)
+{
+    return set_trials(ctx, ntrials, sizeof(double));
+}
+
+int lbfgsb_set_trials_f32(
+    lbfgsb_context_f32* ctx,
+    int ntrials)
+{
+    return set_trials(&ctx->base, ntrials, sizeof(float));
+}
+
+double* lbfgsb_get_trial_f(
+    const lbfgsb_context* ctx)
+{
+    double* trial = ctx->wrks.trial;
+    return (trial == NULL ? NULL : trial + ctx->trials);
+}
+
+double* lbfgsb_get_trial_x(
+    const lbfgsb_context* ctx,
+    int j)
+{
+    return (j < ctx->trials ?
+            get_trial_vector(ctx, j, sizeof(double)) : NULL);
+}
+
+double* lbfgsb_get_trial_g(
+    const lbfgsb_context* ctx,
+    int j)
+{
+    return (j >= 0 ?
+            get_trial_vector(ctx, ctx->trials + j, sizeof(double)) : NULL);
+}
+
+float* lbfgsb_get_trial_x_f32(
+    const lbfgsb_context_f32* ctx,
+    int j)
+{
+    return (j < ctx->base.trials ?
+            get_trial_vector(&ctx->base, j, sizeof(float)) : NULL);
+}
+
+float* lbfgsb_get_trial_g_f32(
+    const lbfgsb_context_f32* ctx,
+    int j)
+{
+    return (j >= 0 ?
+            get_trial_vector(&ctx->base, ctx->base.trials + j,
+                             sizeof(float)) : NULL);
+}
+
 const double* lbfgsb_get_latest_x(
     const lbfgsb_context* ctx)
 {
+    // The latest iterate is saved in `t` at the start of each line search.
+    return ctx->wrks.t;
+}
+
+const float* lbfgsb_get_latest_x_f32(
+    const lbfgsb_context_f32* ctx)
+{
+    return ctx->base.wrks.t;
+}
+
+long lbfgsb_get_page_size(
+    const lbfgsb_context* ctx)
+{
+    long size = 0;
+#ifdef HAVE_POSIX
+    size = sysconf(_SC_PAGESIZE);
+#endif
+    if (size <= 0) {
+        size = 4096;
+    }
+#ifdef __linux__
+    // Find the mapping of the workspace in "/proc/self/smaps" and check
+    // whether it is backed by explicit or by transparent huge pages.
+    char line[256];
+    unsigned long addr = (uintptr_t)ctx->wrks.wa;
+    int found = 0;
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL) {
+        return size;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long start, stop;
+        long val;
+        if (sscanf(line, "%lx-%lx ", &start, &stop) == 2) {
+            if (found) {
+                break;
+            }
+            found = (start <= addr && addr < stop);
+        } else if (found) {
+            if (sscanf(line, "KernelPageSize: %ld", &val) == 1 &&
+                1024*val > size) {
+                size = 1024*val;
+            } else if (sscanf(line, "AnonHugePages: %ld", &val) == 1 &&
+                       val > 0 && huge_page_size(0) > size) {
+                size = huge_page_size(0);
+            }
+        }
+    }
+    fclose(fp);
+#endif
+    return size;
+}
+
+void lbfgsb_prefetch_(
+    const void* addr,
+    size_t      len)
+{
+#ifdef MADV_WILLNEED
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pagesize > 0 && len > 0) {
+        uintptr_t start = ((uintptr_t)addr/pagesize)*pagesize;
+        madvise((void*)start, ((uintptr_t)addr - start) + len,
+                MADV_WILLNEED);
+    }
+#else
+    (void)addr;
+    (void)len;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// CHECKPOINTS
+
+// A checkpoint starts with a header followed, at `offset` bytes from its
+// start, by a copy of the block of the context with the layout used by
+// lbfgsb_init_in_buffer() (wherever the correction history is stored).  The
+// copy is raw, so a checkpoint can only be loaded by a library with the same
+// version of the format and the same data model.  The clocks of the timers of
+// the context have arbitrary origins, so the header stores the durations
+// elapsed since their readings and the timers are rebased on the clocks of
+// the process loading the checkpoint.
+#ifdef HAVE_POSIX
+
+#define SAVE_MAGIC   "LBFGSB-C"
+#define SAVE_VERSION 2
+#define SAVE_ORDER   UINT64_C(0x0102030405060708)
+#define SAVE_OFFSET  65536 // A multiple of the page size.
+
+typedef struct save_header {
+    char     magic[8]; // SAVE_MAGIC without the final null.
+    uint32_t version;  // SAVE_VERSION.
+    uint32_t single;   // Whether the variables are in single precision.
+    uint32_t intsize;  // Size of the `integer` type.
+    uint32_t ctxsize;  // Size of the context structure.
+    uint64_t order;    // SAVE_ORDER in the native byte order.
+    int64_t  siz;      // Number of variables.
+    int64_t  mem;      // Number of memorized steps.
+    uint64_t offset;   // Offset of the block.
+    uint64_t size;     // Size of the block.
+    double   wall;     // Wall-clock time since the start (s).
+    double   cpu;      // CPU time since the start (s).
+    int64_t  wall_ns;  // Wall-clock time since the last return (ns).
+    int64_t  cpu_ns;   // CPU time since the last return (ns).
+} save_header;
+
+// Maximum number of bytes per call to read() or write().
+#define IO_CHUNK (1L << 30)
+
+static int write_all(
+    int         fd,
+    const void* buf,
+    size_t      len)
+{
+    const char* ptr = buf;
+    while (len > 0) {
+        ssize_t cnt = write(fd, ptr, (len > IO_CHUNK ? IO_CHUNK : len));
+        if (cnt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        ptr += cnt;
+        len -= cnt;
+    }
+    return 0;
+}
+
+static int write_zeros(
+    int    fd,
+    size_t len)
+{
+    static const char zeros[4096];
+    while (len > 0) {
+        size_t cnt = (len > sizeof(zeros) ? sizeof(zeros) : len);
+        if (write_all(fd, zeros, cnt) != 0) {
+            return -1;
+        }
+        len -= cnt;
+    }
+    return 0;
+}
+
+// Read exactly `len` bytes, or skip them if `buf` is `NULL`.  A premature end
+// of file is reported with `errno` set to `EINVAL`.
+static int read_all(
+    int    fd,
+    void*  buf,
+    size_t len)
+{
+    char tmp[4096];
+    char* ptr = buf;
+    while (len > 0) {
+        size_t max = (ptr == NULL ? sizeof(tmp) : IO_CHUNK);
+        ssize_t cnt = read(fd, (ptr == NULL ? tmp : ptr),
+                           (len > max ? max : len));
+        if (cnt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (cnt == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (ptr != NULL) {
+            ptr += cnt;
+        }
+        len -= cnt;
+    }
+    return 0;
+}
+
+static int save_context(
+    const lbfgsb_context* ctx,
+    int                   single,
+    int                   fd)
+{
+    const lbfgsb_workspace* w = &ctx->wrks;
     long n = ctx->siz;
     long m = ctx->mem;
+    long elsize = (single ? sizeof(float) : sizeof(double));
+    block_layout b;
+    if (get_layout(&b, n, m, single, 1) != 0) {
+        return -1;
+    }
+    save_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SAVE_MAGIC, sizeof(hdr.magic));
+    hdr.version = SAVE_VERSION;
+    hdr.single  = single;
+    hdr.intsize = sizeof(integer);
+    hdr.ctxsize = (single ? sizeof(lbfgsb_context_f32) :
+                   sizeof(lbfgsb_context));
+    hdr.order   = SAVE_ORDER;
+    hdr.siz     = n;
+    hdr.mem     = m;
+    hdr.offset  = SAVE_OFFSET;
+    hdr.size    = b.size;
+    hdr.wall    = lbfgsb_wall_time() - w->wtime1;
+    hdr.cpu     = lbfgsb_timer() - w->time1;
+    hdr.wall_ns = lbfgsb_clock_ns() - w->wall_exit;
+    hdr.cpu_ns  = lbfgsb_cpu_clock_ns() - w->cpu_exit;
+    if (write_all(fd, &hdr, sizeof(hdr)) != 0 ||
+        write_zeros(fd, SAVE_OFFSET - sizeof(hdr)) != 0) {
+        return -1;
+    }
+    const char* blk = (const char*)ctx;
+    if (w->hsiz == 0) {
+        return write_all(fd, blk, b.size);
+    }
+
+    // The correction history is stored in a file, write the other parts of
+    // the block around it.
+    long vec = 5*n*elsize;
+    if (write_all(fd, blk, b.wa) != 0 ||
+        write_all(fd, w->hist, b.hsize) != 0 ||
+        write_all(fd, w->z, vec) != 0 ||
+        write_zeros(fd, b.vec - b.hsize - vec) != 0 ||
+        write_all(fd, w->sy, b.size - b.wa - b.vec) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static lbfgsb_context* load_context(
+    int single,
+    int fd)
+{
+    // Read and check the header.
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    save_header hdr;
+    block_layout b;
+    if (read_all(fd, &hdr, sizeof(hdr)) != 0) {
+        return NULL;
+    }
+    if (memcmp(hdr.magic, SAVE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != SAVE_VERSION || hdr.order != SAVE_ORDER ||
+        hdr.single != (single != 0) || hdr.intsize != sizeof(integer) ||
+        hdr.ctxsize != (single ? sizeof(lbfgsb_context_f32) :
+                        sizeof(lbfgsb_context)) ||
+        hdr.siz > LONG_MAX || hdr.mem > LONG_MAX ||
+        get_layout(&b, hdr.siz, hdr.mem, single, 1) != 0 ||
+        hdr.size != (uint64_t)b.size || hdr.offset < sizeof(hdr) ||
+        hdr.offset > LONG_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    long n = hdr.siz;
+    long m = hdr.mem;
+
+    // Map the block from the file if possible, read it otherwise.
+    void* buf = NULL;
+    int alloc = ALLOC_MAPPED;
+    size_t len = b.size;
+    struct stat st;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pos >= 0 && pagesize > 0 && (pos + hdr.offset) % pagesize == 0 &&
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size >= (off_t)(pos + hdr.offset + b.size)) {
+        buf = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd,
+                   pos + hdr.offset);
+        if (buf == MAP_FAILED) {
+            buf = NULL;
+        } else {
+            lseek(fd, pos + hdr.offset + b.size, SEEK_SET);
+        }
+    }
+    if (buf == NULL) {
+        buf = alloc_block(b.size, LBFGSB_PAGES_DEFAULT, &alloc, &len);
+        if (buf == NULL) {
+            return NULL;
+        }
+        if (read_all(fd, NULL, hdr.offset - sizeof(hdr)) != 0 ||
+            read_all(fd, buf, b.size) != 0) {
+            int code = errno;
+            free(buf);
+            errno = code;
+            return NULL;
+        }
+    }
+
+    // Fix the members that do not survive a checkpoint.
+    lbfgsb_context* ctx = buf;
+    lbfgsb_workspace* w = &ctx->wrks;
+    int nthreads = ctx->nthreads;
+    int ntrials = ctx->trials;
+    w->itfile   = NULL;
+    w->output   = NULL;
+    w->summary  = NULL;
+    w->part     = NULL;
+    w->trial    = NULL;
+    w->trace    = NULL;
+    w->hsiz     = 0;
+    w->alloc    = alloc;
+    w->mapsiz   = (alloc == ALLOC_MAPPED ? len : 0);
+    w->wtime1   = lbfgsb_wall_time() - hdr.wall;
+    w->time1    = lbfgsb_timer() - hdr.cpu;
+    w->wall_exit = lbfgsb_clock_ns() - hdr.wall_ns;
+    w->cpu_exit = lbfgsb_cpu_clock_ns() - hdr.cpu_ns;
+    ctx->nthreads = 1;
+    ctx->trials = 1;
+    if (w->layout != LBFGSB_LAYOUT_COLUMNS &&
+        w->layout != LBFGSB_LAYOUT_INTERLEAVED) {
+        lbfgsb_destroy(ctx);
+        errno = EINVAL;
+        return NULL;
+    }
+    link_block(buf, &b, n, m, single);
+    if ((nthreads > 1 && lbfgsb_set_threads(ctx, nthreads) != 0) ||
+        (ntrials > 1 && set_trials(ctx, ntrials,
+                                   (single ? sizeof(float) :
+                                    sizeof(double))) != 0)) {
+        int code = errno;
+        lbfgsb_destroy(ctx);
+        errno = code;
+        return NULL;
+    }
+    return ctx;
+}
+
+#else // not HAVE_POSIX
+
+static int save_context(
+    const lbfgsb_context* ctx,
+    int                   single,
+    int                   fd)
+{
+    (void)ctx;
+    (void)single;
+    (void)fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+static lbfgsb_context* load_context(
+    int single,
+    int fd)
+{
+    (void)single;
+    (void)fd;
+    errno = ENOSYS;
+    return NULL;
+}
+
+#endif // HAVE_POSIX
+
+int lbfgsb_save(
+    const lbfgsb_context* ctx,
+    int                   fd)
+{
+    return save_context(ctx, 0, fd);
+}
+
+int lbfgsb_save_f32(
+    const lbfgsb_context_f32* ctx,
+    int                       fd)
+{
+    return save_context(&ctx->base, 1, fd);
+}
+
+lbfgsb_context* lbfgsb_load(
+    int fd)
+{
+    return load_context(0, fd);
+}
+
+lbfgsb_context_f32* lbfgsb_load_f32(
+    int fd)
+{
+    return (lbfgsb_context_f32*)load_context(1, fd);
+}
+
+//-----------------------------------------------------------------------------
+// BATCHES
+
+// Message of the problems of a batch which request other evaluations than
+// the function and its gradient at their variables.
+#define BATCH_ERROR "ERROR: TRIALS AND LAZY GRADIENT NOT SUPPORTED IN A BATCH"
+
+static inline lbfgsb_context* batch_context(
+    const lbfgsb_batch* batch,
+    long                k)
+{
+    return (lbfgsb_context*)((char*)batch->ctxs + k*batch->stride);
+}
+
+lbfgsb_batch* lbfgsb_batch_create(
+    long count,
+    long n,
+    long m)
+{
+    if (count < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t stride = lbfgsb_workspace_size(n, m);
+    if (stride == 0) {
+        return NULL;
+    }
 
-    // The latest iterate is contained in `wa[j..j+n-1]` where:
-    long j = 3*n + 2*m*n + 11*m*m;
-    return ctx->wrks.wa + j;
+    // Layout of the block: batch structure, bounds, tasks and contexts.
+    long len = muladd(count, n, 0);
+    long lower = align_up(sizeof(lbfgsb_batch));
+    long upper = align_up(muladd(len, sizeof(double), lower));
+    long task = align_up(muladd(len, sizeof(double), upper));
+    long ctxs = align_up(muladd(count, sizeof(lbfgsb_task), task));
+    long size = (stride > LONG_MAX ? -1 : muladd(count, (long)stride, ctxs));
+    if (size < 0) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+    char* buf = aligned_alloc(LBFGSB_ALIGNMENT, size);
+    double* work = malloc(2*n*sizeof(double));
+    if (buf == NULL || work == NULL) {
+        free(buf);
+        free(work);
+        errno = ENOMEM;
+        return NULL;
+    }
+    lbfgsb_batch* batch = (lbfgsb_batch*)buf;
+    memset(batch, 0, sizeof(lbfgsb_batch));
+    batch->count = count;
+    batch->siz = n;
+    batch->mem = m;
+    batch->lower = (double*)(buf + lower);
+    batch->upper = (double*)(buf + upper);
+    batch->task = (lbfgsb_task*)(buf + task);
+    batch->nthreads = 1;
+    batch->stride = stride;
+    batch->ctxs = buf + ctxs;
+    batch->work = work;
+    for (long k = 0; k < count; ++k) {
+        lbfgsb_init_in_buffer(batch_context(batch, k), n, m);
+    }
+    lbfgsb_batch_reset(batch, 1);
+    return batch;
+}
+
+void lbfgsb_batch_destroy(
+    lbfgsb_batch* batch)
+{
+    if (batch != NULL) {
+        for (long k = 0; k < batch->count; ++k) {
+            lbfgsb_destroy(batch_context(batch, k));
+        }
+        free(batch->work);
+        free(batch);
+    }
+}
+
+void lbfgsb_batch_reset(
+    lbfgsb_batch* batch,
+    int           full)
+{
+    if (full != 0) {
+        long len = batch->siz*batch->count;
+        for (long j = 0; j < len; ++j) {
+            batch->lower[j] = -INFINITY;
+            batch->upper[j] = +INFINITY;
+        }
+    }
+    for (long k = 0; k < batch->count; ++k) {
+        lbfgsb_reset(batch_context(batch, k), 0);
+        batch->task[k] = LBFGSB_START;
+    }
+}
+
+long lbfgsb_batch_iterate(
+    lbfgsb_batch* batch,
+    double        x[],
+    double        f[],
+    double        g[])
+{
+    const long K = batch->count;
+    const long n = batch->siz;
+    long nrun = 0;
+    LBFGSB_OMP(omp parallel for num_threads(batch->nthreads)
+               schedule(dynamic, 16) reduction(+:nrun)
+               if(batch->nthreads > 1))
+    for (long k = 0; k < K; ++k) {
+        lbfgsb_context* ctx = batch_context(batch, k);
+        lbfgsb_task task = ctx->task;
+        if (task == LBFGSB_START && (ctx->trials > 1 || ctx->lazy)) {
+            // The caller only computes f and g at the variables of the
+            // problems.
+            lbfgsb_set_task_(ctx, LBFGSB_ERROR, LBFGSB_STAGE_DONE,
+                             BATCH_ERROR);
+            task = LBFGSB_ERROR;
+        }
+        if (task == LBFGSB_START || task == LBFGSB_FG ||
+            task == LBFGSB_NEW_X) {
+            // Gather the variables (and the gradient, except at start) of
+            // the problem, iterate until f and g are needed or the problem
+            // is finished and scatter them.
+            double* xk = &batch->work[2*n*lbfgsb_thread_index()];
+            double* gk = xk + n;
+            int start = (task == LBFGSB_START);
+            for (long i = 0; i < n; ++i) {
+                xk[i] = x[i*K + k];
+            }
+            if (start) {
+                for (long i = 0; i < n; ++i) {
+                    ctx->lower[i] = batch->lower[i*K + k];
+                    ctx->upper[i] = batch->upper[i*K + k];
+                }
+            } else {
+                for (long i = 0; i < n; ++i) {
+                    gk[i] = g[i*K + k];
+                }
+            }
+            do {
+                task = lbfgsb_iterate(ctx, xk, &f[k], gk);
+            } while (task == LBFGSB_NEW_X);
+            if (task == LBFGSB_FG_TRIALS || task == LBFGSB_F ||
+                task == LBFGSB_G) {
+                // The settings of the context have been changed during the
+                // optimization.
+                lbfgsb_set_task_(ctx, LBFGSB_ERROR, LBFGSB_STAGE_DONE,
+                                 BATCH_ERROR);
+                task = LBFGSB_ERROR;
+            }
+            for (long i = 0; i < n; ++i) {
+                x[i*K + k] = xk[i];
+            }
+            if (!start) {
+                for (long i = 0; i < n; ++i) {
+                    g[i*K + k] = gk[i];
+                }
+            }
+        }
+        batch->task[k] = task;
+        if (task == LBFGSB_FG) {
+            ++nrun;
+        }
+    }
+    return nrun;
+}
+
+lbfgsb_context* lbfgsb_batch_get_context(
+    const lbfgsb_batch* batch,
+    long                k)
+{
+    return (k < 0 || k >= batch->count ? NULL : batch_context(batch, k));
+}
+
+int lbfgsb_batch_get_threads(
+    const lbfgsb_batch* batch)
+{
+    return batch->nthreads;
+}
+
+int lbfgsb_batch_set_threads(
+    lbfgsb_batch* batch,
+    int           nthreads)
+{
+    if (nthreads < 1 || nthreads > LBFGSB_MAX_THREADS) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Storage for the variables and the gradient of the problem processed
+    // by each thread.
+    double* work = realloc(batch->work,
+                           2*batch->siz*nthreads*sizeof(double));
+    if (work == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    batch->work = work;
+    batch->nthreads = nthreads;
+    return 0;
 }
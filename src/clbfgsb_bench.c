@@ -0,0 +1,418 @@
+// clbfgsb_bench.c -
+//
+// Reproducible benchmark of the L-BFGS-B engine.  Usage:
+//
+//     clbfgsb_bench [-i iters] [-t nthreads] [-m mem,...] [-p problem,...]
+//                   [-b bounds,...] [-l limit] [n ...]
+//
+// The program runs the algorithm for at most `iters` iterations (50 by
+// default) on all the combinations of the number of variables `n` (1e3, 1e4
+// and 1e5 by default, up to 1e8 if memory permits), the number `mem` of
+// memorized steps (3, 10 and 50 by default), the problems and the kinds of
+// bounds.  The problems are:
+//
+// - `quadratic`: an ill-conditioned (condition number about 1e3) quadratic
+//   function with a chain coupling of the variables;
+//
+// - `rosenbrock`: the extended Rosenbrock function of `clbfgsb_test1.c`;
+//
+// - `deconv`: the deconvolution of a piecewise constant signal blurred by a
+//   Gaussian kernel with an edge-preserving (total variation) regularization.
+//
+// The kinds of bounds are: `none`, `lower` (x ≥ 0, the positivity of the
+// deconvolution), `boxed` (0 ≤ x ≤ 2, mostly inactive) and `active`
+// (0 ≤ x ≤ 0.25, most variables are at a bound).  All runs start at x = 0.5
+// and the data are generated deterministically, so the iterates only depend
+// on the engine.  The runs whose memory exceeds `limit` bytes (4e9 by
+// default) are skipped.
+//
+// The results are printed in JSON: for each run, the reason of the
+// termination, the numbers of iterations and of evaluations, the wall-clock
+// times spent in the engine and in the objective function, the engine time
+// per iteration, the size of the workspace, the estimated memory traffic of
+// the engine and the corresponding throughput (see lbfgsb_get_stats()).  Use
+// `make bench` to build and run it.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "lbfgsb_private.h"
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+static inline double pow2(double x) { return x*x; }
+
+//-----------------------------------------------------------------------------
+// PROBLEMS
+
+typedef enum {QUADRATIC, ROSENBROCK, DECONV, NPROBLEMS} problem;
+
+static const char* problem_names[] = {"quadratic", "rosenbrock", "deconv"};
+
+typedef enum {NONE, LOWER, BOXED, ACTIVE, NBOUNDS} bounds;
+
+static const char* bounds_names[] = {"none", "lower", "boxed", "active"};
+
+// Half-width of the blur and regularization parameters of the deconvolution.
+#define DECONV_HALF_WIDTH 3
+#define DECONV_MU         1e-2
+#define DECONV_EPS        1e-2
+
+// Data of a problem (the arrays are only allocated for the deconvolution).
+typedef struct {
+    problem prob;
+    long    n;
+    double  h[2*DECONV_HALF_WIDTH + 1]; // Blur kernel.
+    double* y; // Data.
+    double* r; // Residuals.
+} instance;
+
+// Number of arrays of `n` elements needed by a problem.
+static long problem_arrays(problem prob)
+{
+    return (prob == DECONV ? 2 : 0);
+}
+
+// Pseudo-random numbers uniformly distributed in [-1,1).
+static double uniform(unsigned long* seed)
+{
+    *seed = (*seed*1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (double)*seed/(double)0x40000000UL - 1.0;
+}
+
+// Blur `x` with the kernel `h` (with zeros outside) and store it in `dst`
+// minus `y` if `y` is not NULL.
+static void blur(
+    const double h[], long n, const double x[], const double y[],
+    double dst[])
+{
+    const long w = DECONV_HALF_WIDTH;
+    for (long i = 0; i < n; ++i) {
+        double s = 0.0;
+        long k0 = (i >= w ? -w : -i);
+        long k1 = (i + w < n ? w : n - 1 - i);
+        for (long k = k0; k <= k1; ++k) {
+            s += h[w + k]*x[i + k];
+        }
+        dst[i] = (y == NULL ? s : s - y[i]);
+    }
+}
+
+static int init_instance(
+    instance* inst, problem prob, long n)
+{
+    inst->prob = prob;
+    inst->n = n;
+    inst->y = NULL;
+    inst->r = NULL;
+    if (prob == DECONV) {
+        const long w = DECONV_HALF_WIDTH;
+        double s = 0.0;
+        for (long k = -w; k <= w; ++k) {
+            inst->h[w + k] = exp(-0.5*pow2((double)k/1.5));
+            s += inst->h[w + k];
+        }
+        for (long k = -w; k <= w; ++k) {
+            inst->h[w + k] /= s;
+        }
+        inst->y = malloc(n*sizeof(double));
+        inst->r = malloc(n*sizeof(double));
+        if (inst->y == NULL || inst->r == NULL) {
+            free(inst->y);
+            free(inst->r);
+            return -1;
+        }
+        // The true signal is made of steps of 50 samples with levels 0, 0.5
+        // and 1, the data are the blurred signal plus a small noise.
+        for (long i = 0; i < n; ++i) {
+            inst->r[i] = 0.5*(double)((i/50)%3);
+        }
+        blur(inst->h, n, inst->r, NULL, inst->y);
+        unsigned long seed = 1;
+        for (long i = 0; i < n; ++i) {
+            inst->y[i] += 0.01*uniform(&seed);
+        }
+    }
+    return 0;
+}
+
+static void free_instance(
+    instance* inst)
+{
+    free(inst->y);
+    free(inst->r);
+}
+
+static double compute_fg(
+    instance* inst, const double x[], double g[])
+{
+    long n = inst->n;
+    double f = 0.0;
+    switch (inst->prob) {
+    case QUADRATIC:
+        // f(x) = 1/2 sum_i a_i (x_i - c_i)^2 + 1/2 sum_i (x_{i+1} - x_i)^2
+        // with a_i from 1 to 1e3 and c_i = sin(0.01 i).
+        for (long i = 0; i < n; ++i) {
+            double a = pow(1e3, (double)i/(double)(n > 1 ? n - 1 : 1));
+            double e = x[i] - sin(0.01*(double)i);
+            f += 0.5*a*e*e;
+            g[i] = a*e;
+        }
+        for (long i = 0; i < n - 1; ++i) {
+            double e = x[i+1] - x[i];
+            f += 0.5*e*e;
+            g[i] -= e;
+            g[i+1] += e;
+        }
+        break;
+    case ROSENBROCK:
+        f = pow2(x[0] - 1);
+        for (long i = 1; i < n; ++i) {
+            f += 4*pow2(x[i] - pow2(x[i-1]));
+        }
+        double t1 = x[1] - pow2(x[0]);
+        g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+        for (long i = 1; i < n-1; ++i) {
+            double t2 = t1;
+            t1 = x[i+1] - pow2(x[i]);
+            g[i] = 8*t2 - 16*x[i]*t1;
+        }
+        g[n-1] = 8*t1;
+        break;
+    case DECONV:
+        // f(x) = 1/2 ||h*x - y||^2 + mu sum_i sqrt((x_{i+1} - x_i)^2 + eps^2)
+        // the kernel being symmetric, the gradient of the first term is
+        // h*(h*x - y).
+        blur(inst->h, n, x, inst->y, inst->r);
+        for (long i = 0; i < n; ++i) {
+            f += 0.5*pow2(inst->r[i]);
+        }
+        blur(inst->h, n, inst->r, NULL, g);
+        for (long i = 0; i < n - 1; ++i) {
+            double e = x[i+1] - x[i];
+            double s = sqrt(e*e + DECONV_EPS*DECONV_EPS);
+            f += DECONV_MU*s;
+            g[i] -= DECONV_MU*e/s;
+            g[i+1] += DECONV_MU*e/s;
+        }
+        break;
+    default:
+        break;
+    }
+    return f;
+}
+
+//-----------------------------------------------------------------------------
+// BENCHMARK
+
+static long iters = 50;
+static int nthreads = 1;
+static double limit = 4e9;
+static int nruns = 0;
+
+static int bench(
+    problem prob, bounds bnds, long n, long m)
+{
+    // Skip the runs that need too much memory.
+    double need = (double)lbfgsb_workspace_size(n, m) +
+        (double)(2 + problem_arrays(prob))*sizeof(double)*(double)n;
+    if (need > limit) {
+        fprintf(stderr, "skipping %s/%s with n = %ld and m = %ld "
+                "(%.3g bytes needed)\n", problem_names[prob],
+                bounds_names[bnds], n, m, need);
+        return 0;
+    }
+    instance inst;
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    double* x = malloc(n*sizeof(double));
+    double* g = malloc(n*sizeof(double));
+    if (ctx == NULL || x == NULL || g == NULL ||
+        init_instance(&inst, prob, n) != 0) {
+        fprintf(stderr, "not enough memory for n = %ld and m = %ld\n", n, m);
+        return -1;
+    }
+    if (nthreads > 1 && lbfgsb_set_threads(ctx, nthreads) != 0) {
+        fprintf(stderr, "invalid number of threads\n");
+        return -1;
+    }
+    ctx->print = -1;
+    ctx->factr = 0.0;
+    ctx->pgtol = 0.0;
+    lbfgsb_set_maxiter(ctx, iters);
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (bnds == NONE ? -INFINITY : 0.0);
+        ctx->upper[i] = (bnds == BOXED ? 2.0 : bnds == ACTIVE ? 0.25 :
+                         INFINITY);
+        x[i] = 0.5;
+    }
+    double f = 0.0;
+    double t0 = wall_time();
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(&inst, x, g);
+        } else if (task != LBFGSB_NEW_X) {
+            break;
+        }
+    }
+    double t = wall_time() - t0;
+    lbfgsb_stats stats;
+    int measured = (lbfgsb_get_stats(ctx, &stats) == 0);
+    char reason[LBFGSB_TASK_LENGTH+1];
+    lbfgsb_get_task_string(ctx, reason, sizeof(reason));
+    printf("%s    {\"problem\": \"%s\", \"bounds\": \"%s\", \"n\": %ld, "
+           "\"m\": %ld,\n", (nruns > 0 ? ",\n" : ""), problem_names[prob],
+           bounds_names[bnds], n, m);
+    printf("     \"reason\": \"%s\", \"f\": %.15e,\n", reason, f);
+    printf("     \"iterations\": %ld, \"evaluations\": %ld, "
+           "\"total_time\": %.6e,\n", stats.iters, stats.evals, t);
+    if (measured) {
+        double te = 1e-9*(double)stats.wall_ns[LBFGSB_PHASE_ENGINE];
+        double tc = 1e-9*(double)stats.wall_ns[LBFGSB_PHASE_CALLER];
+        printf("     \"engine_time\": %.6e, \"fg_time\": %.6e, "
+               "\"engine_time_per_iteration\": %.6e,\n", te, tc,
+               (stats.iters > 0 ? te/(double)stats.iters : te));
+        printf("     \"workspace_bytes\": %zu, \"traffic_bytes\": %lld, "
+               "\"throughput\": %.3f}", lbfgsb_workspace_size(n, m),
+               (long long)stats.bytes,
+               (te > 0.0 ? 1e-9*(double)stats.bytes/te : 0.0));
+    } else {
+        printf("     \"engine_time\": null, \"fg_time\": null, "
+               "\"engine_time_per_iteration\": null,\n");
+        printf("     \"workspace_bytes\": %zu, \"traffic_bytes\": null, "
+               "\"throughput\": null}", lbfgsb_workspace_size(n, m));
+    }
+    fflush(stdout);
+    ++nruns;
+    free_instance(&inst);
+    free(g);
+    free(x);
+    lbfgsb_destroy(ctx);
+    return 0;
+}
+
+// Parse a comma separated list of at most `max` names among `names` into
+// `list`, yield the number of names or -1 on error.
+static int parse_names(
+    const char* str, const char* names[], int nnames, int list[], int max)
+{
+    int cnt = 0;
+    while (*str != '\0') {
+        size_t len = strcspn(str, ",");
+        int k = 0;
+        while (k < nnames && (strlen(names[k]) != len ||
+                              strncmp(str, names[k], len) != 0)) {
+            ++k;
+        }
+        if (k >= nnames || cnt >= max) {
+            return -1;
+        }
+        list[cnt++] = k;
+        str += len;
+        if (*str == ',') {
+            ++str;
+        }
+    }
+    return cnt;
+}
+
+// Same as parse_names() for a comma separated list of positive integers.
+static int parse_longs(
+    const char* str, long list[], int max)
+{
+    int cnt = 0;
+    while (*str != '\0') {
+        char* end;
+        double val = strtod(str, &end);
+        if (end == str || (*end != ',' && *end != '\0') || val < 1 ||
+            cnt >= max) {
+            return -1;
+        }
+        list[cnt++] = (long)val;
+        str = (*end == ',' ? end + 1 : end);
+    }
+    return cnt;
+}
+
+#define MAX_LIST 32
+
+int main(int argc, char* argv[])
+{
+    long sizes[MAX_LIST] = {1000L, 10000L, 100000L};
+    long mems[MAX_LIST] = {3, 10, 50};
+    int probs[MAX_LIST] = {QUADRATIC, ROSENBROCK, DECONV};
+    int bnds[MAX_LIST] = {NONE, LOWER, BOXED, ACTIVE};
+    int nsizes = 3, nmems = 3, nprobs = NPROBLEMS, nbnds = NBOUNDS;
+    int i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        const char* opt = argv[i];
+        const char* arg = (i + 1 < argc ? argv[i+1] : NULL);
+        int ok = (arg != NULL && strlen(opt) == 2);
+        if (ok && opt[1] == 'i') {
+            iters = atol(arg);
+            ok = (iters >= 1);
+        } else if (ok && opt[1] == 't') {
+            nthreads = atoi(arg);
+            ok = (nthreads >= 1 && nthreads <= LBFGSB_MAX_THREADS);
+        } else if (ok && opt[1] == 'l') {
+            limit = strtod(arg, NULL);
+            ok = (limit > 0);
+        } else if (ok && opt[1] == 'm') {
+            nmems = parse_longs(arg, mems, MAX_LIST);
+            ok = (nmems > 0);
+        } else if (ok && opt[1] == 'p') {
+            nprobs = parse_names(arg, problem_names, NPROBLEMS, probs,
+                                 MAX_LIST);
+            ok = (nprobs > 0);
+        } else if (ok && opt[1] == 'b') {
+            nbnds = parse_names(arg, bounds_names, NBOUNDS, bnds, MAX_LIST);
+            ok = (nbnds > 0);
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "invalid option \"%s\" or argument\n", opt);
+            return EXIT_FAILURE;
+        }
+        i += 2;
+    }
+    if (i < argc) {
+        nsizes = 0;
+        for (; i < argc; ++i) {
+            double val = strtod(argv[i], NULL);
+            if (val < 2 || nsizes >= MAX_LIST) {
+                fprintf(stderr, "invalid size \"%s\"\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            sizes[nsizes++] = (long)val;
+        }
+    }
+    printf("{\"blas\": \"%s\", \"threads\": %d, \"max_iterations\": %ld,\n",
+           lbfgsb_blas_backend(), nthreads, iters);
+    printf(" \"runs\": [\n");
+    for (int ip = 0; ip < nprobs; ++ip) {
+        for (int ib = 0; ib < nbnds; ++ib) {
+            for (int is = 0; is < nsizes; ++is) {
+                for (int im = 0; im < nmems; ++im) {
+                    if (bench(probs[ip], bnds[ib], sizes[is],
+                              mems[im]) != 0) {
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+        }
+    }
+    printf("\n ]}\n");
+    return EXIT_SUCCESS;
+}
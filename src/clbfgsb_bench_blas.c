@@ -0,0 +1,121 @@
+// clbfgsb_bench_blas.c -
+//
+// Benchmark of the level-1 BLAS kernels used by the L-BFGS-B engine on
+// vectors of length `n`.  Usage:
+//
+//     clbfgsb_bench_blas [-t nthreads] [n ...]
+//
+// with default sizes 1e6, 1e7 and 1e8 and a single thread (more threads are
+// only used by the bundled kernels if the code is compiled with OpenMP).  To
+// measure the speedup provided by an external BLAS library, compare the
+// outputs of this program built with the bundled kernels and with the
+// external library (see `make bench-blas` in `Makefile`).
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lbfgsb_private.h"
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+// Minimal total amount of memory traffic per measurement (in bytes).
+#define TRAFFIC (4.0e9)
+
+static volatile double sink;
+
+// Maximum number of threads.
+static int nthreads = 1;
+
+typedef enum {DDOT, DAXPY, DCOPY, DSCAL} kernel;
+
+static void bench(
+    kernel k, long n, double* x, double* y)
+{
+    static const char* name[] = {"ddot", "daxpy", "dcopy", "dscal"};
+    static const int nrd[] = {2, 2, 1, 1}; // number of vectors read
+    static const int nwr[] = {0, 1, 1, 1}; // number of vectors written
+
+    // Number of bytes read and written by a call.
+    double bytes = (double)(nrd[k] + nwr[k])*sizeof(double)*(double)n;
+    long reps = (long)(TRAFFIC/bytes);
+    if (reps < 3) {
+        reps = 3;
+    }
+    double best = -1.0;
+    for (long r = 0; r < reps; ++r) {
+        double t0 = wall_time();
+        switch (k) {
+        case DDOT:
+            sink = lbfgsb_ddot(nthreads, n, x, y);
+            break;
+        case DAXPY:
+            lbfgsb_daxpy(nthreads, n, 1e-9, x, y);
+            break;
+        case DCOPY:
+            lbfgsb_dcopy(nthreads, n, x, y);
+            break;
+        case DSCAL:
+            lbfgsb_dscal(nthreads, n, 1.0 + 1e-12, y);
+            break;
+        }
+        double t = wall_time() - t0;
+        if (best < 0.0 || t < best) {
+            best = t;
+        }
+    }
+    printf("%-8s %12ld %12.3f %10.2f\n", name[k], n, 1e3*best,
+           1e-9*bytes/best);
+}
+
+int main(int argc, char* argv[])
+{
+    static const long default_sizes[] = {1000000L, 10000000L, 100000000L};
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        nthreads = atoi(argv[2]);
+        if (nthreads < 1 || nthreads > LBFGSB_MAX_THREADS) {
+            fprintf(stderr, "invalid number of threads \"%s\"\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        first = 3;
+    }
+    int nsizes = (argc > first ? argc - first : 3);
+    printf("# BLAS backend: %s\n", lbfgsb_blas_backend());
+    printf("# Threads: %d\n", nthreads);
+    printf("# %-6s %12s %12s %10s\n", "kernel", "n", "time (ms)", "GB/s");
+    for (int k = 0; k < nsizes; ++k) {
+        long n = (argc > first ? (long)strtod(argv[first+k], NULL) :
+                  default_sizes[k]);
+        if (n < 1) {
+            fprintf(stderr, "invalid size \"%s\"\n", argv[first+k]);
+            return EXIT_FAILURE;
+        }
+        double* x = malloc(n*sizeof(double));
+        double* y = malloc(n*sizeof(double));
+        if (x == NULL || y == NULL) {
+            fprintf(stderr, "not enough memory for n = %ld\n", n);
+            return EXIT_FAILURE;
+        }
+        for (long i = 0; i < n; ++i) {
+            x[i] = 1.0/(double)(i + 1);
+            y[i] = 1.0;
+        }
+        bench(DDOT,  n, x, y);
+        bench(DAXPY, n, x, y);
+        bench(DCOPY, n, x, y);
+        bench(DSCAL, n, x, y);
+        free(x);
+        free(y);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+// clbfgsb_bench_cauchy.c -
+//
+// Benchmark of the search for the generalized Cauchy point on the
+// bound-constrained problem of `clbfgsb_test3.c` (the extended Rosenbrock
+// function with bounds on the variables, starting at x = 3) for which most
+// variables hit their bounds, so that the number of Cauchy segments is of
+// the order of the number of variables.  Usage:
+//
+//     clbfgsb_bench_cauchy [-i iters] [n ...]
+//
+// with default sizes 1e5, 1e6 and 1e7 and 20 iterations.  For each size, the
+// program prints the total number of Cauchy segments, the wall-clock time
+// spent in the search for the generalized Cauchy point and the total time of
+// the run.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lbfgsb_private.h"
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+static inline double pow2(double x) { return x*x; }
+
+// Same objective function as in `clbfgsb_test3.c`.
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+    return f;
+}
+
+static int bench(
+    long n, long m, long iters)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    double* x = malloc(n*sizeof(double));
+    double* g = malloc(n*sizeof(double));
+    if (ctx == NULL || x == NULL || g == NULL) {
+        fprintf(stderr, "not enough memory for n = %ld\n", n);
+        return -1;
+    }
+    ctx->print = -1;
+    ctx->factr = 0.0;
+    ctx->pgtol = 0.0;
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    double f = 0.0;
+    double t0 = wall_time();
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, n);
+        } else if (task != LBFGSB_NEW_X || ctx->wrks.iter >= iters) {
+            break;
+        }
+    }
+    double t = wall_time() - t0;
+    lbfgsb_stats stats;
+    lbfgsb_get_stats(ctx, &stats);
+    printf("%12ld %6ld %14ld %12.3f %12.3f\n", n, stats.iters,
+           stats.segments, 1e-6*(double)stats.wall_ns[LBFGSB_PHASE_CAUCHY],
+           1e3*t);
+    free(g);
+    free(x);
+    lbfgsb_destroy(ctx);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    static const long default_sizes[] = {100000L, 1000000L, 10000000L};
+    long iters = 20;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-i") == 0) {
+        iters = atol(argv[2]);
+        if (iters < 1) {
+            fprintf(stderr, "invalid number of iterations \"%s\"\n",
+                    argv[2]);
+            return EXIT_FAILURE;
+        }
+        first = 3;
+    }
+    int nsizes = (argc > first ? argc - first : 3);
+    printf("# %10s %6s %14s %12s %12s\n", "n", "iter", "segments",
+           "cauchy (ms)", "total (ms)");
+    for (int k = 0; k < nsizes; ++k) {
+        long n = (argc > first ? (long)strtod(argv[first+k], NULL) :
+                  default_sizes[k]);
+        if (n < 2) {
+            fprintf(stderr, "invalid size \"%s\"\n", argv[first+k]);
+            return EXIT_FAILURE;
+        }
+        if (bench(n, 10, iters) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,520 @@
+// clbfgsb_bench_kernels.c -
+//
+// Microbenchmarks of the hot routines of the L-BFGS-B engine.  Usage:
+//
+//     clbfgsb_bench_kernels [-m mem] [-f free] [-b bounded] [-t nthreads]
+//                           [n ...]
+//
+// with default sizes 1e5 and 1e6, `mem = 5` memorized steps, a fraction
+// `free = 0.5` of the bounded variables that are free at the solution and a
+// fraction `bounded = 1` of the variables that have bounds (and hence a
+// breakpoint in the search for the Cauchy point).  To call the routines,
+// which are private, this file includes the source of the engine (for
+// variables in double precision).
+//
+// For each size, the state of the algorithm is obtained by running the
+// engine on a coupled ill-conditioned quadratic problem for `mem + 5`
+// iterations, so that the correction history is filled, then by performing
+// the first steps of the next iteration.  Each routine is then called
+// repeatedly on this state (which is restored between calls when the
+// routine modifies it) and the program prints the best time per call and
+// the corresponding memory throughput and floating-point rate.  The numbers
+// of bytes and of operations of a call are estimated from the dominant loops
+// of the routine, so they are meant to compare the results with the
+// bandwidth and the peak rate of the machine (its roofline), not to be
+// exact.  `bp_sort` is the sort of the breakpoints of the Cauchy search
+// which replaces the heap of the FORTRAN code (`hpsolb`).
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include "lbfgsb_engine.c"
+
+#include <stdlib.h>
+
+// Minimal total amount of memory traffic per measurement (in bytes) and
+// minimal number of calls.
+#define TRAFFIC   (2.0e9)
+#define MIN_CALLS 5
+
+typedef enum {
+    PROJGR, BMV, CAUCHY, BP_SORT, FORMK, CMPRLB, SUBSM, TWOLOOP, LNSRLB,
+    FORMT, MATUPD, NKERNELS
+} kernel;
+
+static const char* kernel_names[] = {
+    "projgr", "bmv", "cauchy", "bp_sort", "formk", "cmprlb", "subsm",
+    "twoloop", "lnsrlb", "formt", "matupd"
+};
+
+// State of the benchmark.
+typedef struct {
+    lbfgsb_context* ctx;
+    long   n, m, nbreak;
+    double f;
+    double *x, *g, *a, *c;
+    // Snapshots of the vectors modified by some routines, breakpoints of
+    // the Cauchy search (tb, ib) and their sorted copies (ts, is).
+    double *x0, *z0, *r0, *d0, *s1, *y1, *tb, *ts, *wa0, *wn0, *snd0;
+    integer *iwhere0, *ib, *is;
+    lbfgsb_workspace w0;
+} state;
+
+static int nthreads = 1;
+static volatile double sink;
+
+// Coupled quadratic problem with condition number about 1e3.
+static double compute_fg(
+    const state* s, const double x[], double g[])
+{
+    long n = s->n;
+    double f = 0.0;
+    for (long i = 0; i < n; ++i) {
+        double e = x[i] - s->c[i];
+        f += 0.5*s->a[i]*e*e;
+        g[i] = s->a[i]*e;
+    }
+    for (long i = 0; i < n - 1; ++i) {
+        double e = x[i+1] - x[i];
+        f += 0.5*e*e;
+        g[i] -= e;
+        g[i+1] += e;
+    }
+    return f;
+}
+
+// Pseudo-random number in [0,1) depending on `i` and `k`.
+static double hash(long i, unsigned long k)
+{
+    unsigned long h = ((unsigned long)i + 1)*2654435761UL + k*40503UL;
+    h ^= h >> 13;
+    h *= 0x5bd1e995UL;
+    h ^= h >> 15;
+    return (double)(h & 0xffffffUL)/(double)0x1000000UL;
+}
+
+static void* new_vector(long n, size_t elsize)
+{
+    return malloc((n > 0 ? n : 1)*elsize);
+}
+
+// Run the engine to obtain a realistic state and prepare the inputs of the
+// routines.
+static int setup(
+    state* s, long n, long m, double free, double bounded)
+{
+    memset(s, 0, sizeof(*s));
+    s->n = n;
+    s->m = m;
+    s->ctx = lbfgsb_create(n, m);
+    s->x = new_vector(n, sizeof(double));
+    s->g = new_vector(n, sizeof(double));
+    s->a = new_vector(n, sizeof(double));
+    s->c = new_vector(n, sizeof(double));
+    s->x0 = new_vector(n, sizeof(double));
+    s->z0 = new_vector(n, sizeof(double));
+    s->r0 = new_vector(n, sizeof(double));
+    s->d0 = new_vector(n, sizeof(double));
+    s->s1 = new_vector(n, sizeof(double));
+    s->y1 = new_vector(n, sizeof(double));
+    s->tb = new_vector(n, sizeof(double));
+    s->ts = new_vector(n, sizeof(double));
+    s->wa0 = new_vector(8*m, sizeof(double));
+    s->wn0 = new_vector(4*m*m, sizeof(double));
+    s->snd0 = new_vector(4*m*m, sizeof(double));
+    s->iwhere0 = new_vector(n, sizeof(integer));
+    s->ib = new_vector(n, sizeof(integer));
+    s->is = new_vector(n, sizeof(integer));
+    if (s->ctx == NULL || s->x == NULL || s->g == NULL || s->a == NULL ||
+        s->c == NULL || s->x0 == NULL || s->z0 == NULL || s->r0 == NULL ||
+        s->d0 == NULL || s->s1 == NULL || s->y1 == NULL || s->tb == NULL ||
+        s->ts == NULL || s->wa0 == NULL || s->wn0 == NULL ||
+        s->snd0 == NULL || s->iwhere0 == NULL || s->ib == NULL ||
+        s->is == NULL) {
+        fprintf(stderr, "not enough memory for n = %ld\n", n);
+        return -1;
+    }
+    lbfgsb_context* ctx = s->ctx;
+    if (nthreads > 1 && lbfgsb_set_threads(ctx, nthreads) != 0) {
+        fprintf(stderr, "invalid number of threads\n");
+        return -1;
+    }
+    // A variable i is bounded with probability `bounded`; if bounded, it is
+    // free at the solution with probability `free`, at its lower bound
+    // otherwise.
+    for (long i = 0; i < n; ++i) {
+        s->a[i] = pow(1e3, (double)i/(double)(n - 1));
+        s->c[i] = sin(0.01*(double)i);
+        if (hash(i, 1) < bounded) {
+            int active = (hash(i, 2) >= free);
+            ctx->lower[i] = s->c[i] + (active ? 0.5 : -10.0);
+            ctx->upper[i] = s->c[i] + 10.0;
+        } else {
+            ctx->lower[i] = -INFINITY;
+            ctx->upper[i] = INFINITY;
+        }
+        s->x[i] = s->c[i] + 1.0;
+    }
+    ctx->print = -1;
+    ctx->factr = 0.0;
+    ctx->pgtol = 0.0;
+    lbfgsb_set_maxiter(ctx, m + 5);
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, s->x, &s->f, s->g);
+        if (task == LBFGSB_FG) {
+            s->f = compute_fg(s, s->x, s->g);
+        } else if (task != LBFGSB_NEW_X) {
+            break;
+        }
+    }
+    lbfgsb_workspace* w = &ctx->wrks;
+    if (w->col < m || w->uncons) {
+        fprintf(stderr, "failed to fill the correction history (%s)\n",
+                lbfgsb_get_task_string(ctx, (char[80]){0}, 80));
+        return -1;
+    }
+
+    // Perform the first steps of the next iteration as in mainlb: search
+    // for the Cauchy point, find the free variables, factorize the middle
+    // matrix and compute the reduced gradient.
+    double* wa = w->wa8;
+    w->info = cauchy(ctx->nthreads, n, s->x, ctx->lower, ctx->upper, w->nbd,
+                     s->g, w->indx2, w->iwhere, w->t, w->d, w->z, m, w->wy,
+                     w->ws, w->hinc, w->hld, w->sy, w->wt, w->theta, w->col,
+                     w->head, &wa[0], &wa[2*m], &wa[4*m], &wa[6*m], w->part,
+                     &w->nseg, -1, stdout, w->sbgnrm, w->epsmch);
+    freev(n, &w->nfree, w->index, &w->nenter, &w->ileave, w->indx2,
+          w->iwhere, 1, w->cnstnd, -1, stdout, w->iter, 0);
+    w->updatd = 1;
+    if (w->info != 0 ||
+        formk(n, w->nfree, w->index, w->nenter, w->ileave, w->indx2,
+              w->updatd, w->wn, w->snd, m, w->ws, w->wy, w->hinc, w->hld,
+              w->sy, w->theta, w->col, w->head, &wa[4*m]) != 0 ||
+        cmprlb(ctx->nthreads, n, m, s->x, s->g, w->ws, w->wy, w->hinc, w->hld,
+               w->sy, w->wt, w->z, w->r, wa, w->index, w->theta, w->col,
+               w->head, w->nfree, w->cnstnd) != 0) {
+        fprintf(stderr, "failed to prepare the state\n");
+        return -1;
+    }
+    memcpy(s->x0, s->x, n*sizeof(double));
+    memcpy(s->z0, w->z, n*sizeof(double));
+    memcpy(s->r0, w->r, n*sizeof(double));
+    memcpy(s->iwhere0, w->iwhere, n*sizeof(integer));
+    for (long i = 0; i < n; ++i) {
+        s->d0[i] = ((double*)w->z)[i] - s->x[i];
+    }
+
+    // Breakpoints of the Cauchy search, as computed by cauchy().
+    const integer* nbd = w->nbd;
+    s->nbreak = 0;
+    for (long i = 0; i < n; ++i) {
+        double gi = s->g[i];
+        double tl = s->x[i] - ctx->lower[i];
+        double tu = ctx->upper[i] - s->x[i];
+        if (nbd[i] == 0 || (nbd[i] <= 2 && tl <= 0.0 && gi >= 0.0) ||
+            (nbd[i] >= 2 && tu <= 0.0 && gi <= 0.0)) {
+            continue;
+        }
+        if (nbd[i] <= 2 && gi > 0.0) {
+            s->tb[s->nbreak] = tl/gi;
+            s->ib[s->nbreak++] = i;
+        } else if (nbd[i] >= 2 && gi < 0.0) {
+            s->tb[s->nbreak] = tu/(-gi);
+            s->ib[s->nbreak++] = i;
+        }
+    }
+
+    // The newest correction pair, to update the history with.
+    long k = w->itail;
+    for (long i = 0; i < n; ++i) {
+        s->s1[i] = ((double*)w->ws)[i*w->hinc + k*w->hld];
+        s->y1[i] = ((double*)w->wy)[i*w->hinc + k*w->hld];
+    }
+    memcpy(&s->w0, w, sizeof(*w));
+    memcpy(s->wa0, wa, 8*m*sizeof(double));
+    memcpy(s->wn0, w->wn, 4*m*m*sizeof(double));
+    memcpy(s->snd0, w->snd, 4*m*m*sizeof(double));
+    return 0;
+}
+
+static void cleanup(
+    state* s)
+{
+    lbfgsb_destroy(s->ctx);
+    free(s->x);
+    free(s->g);
+    free(s->a);
+    free(s->c);
+    free(s->x0);
+    free(s->z0);
+    free(s->r0);
+    free(s->d0);
+    free(s->s1);
+    free(s->y1);
+    free(s->tb);
+    free(s->ts);
+    free(s->wa0);
+    free(s->wn0);
+    free(s->snd0);
+    free(s->iwhere0);
+    free(s->ib);
+    free(s->is);
+}
+
+// Estimated numbers of bytes and of floating-point operations of a call.
+static void estimate(
+    const state* s, kernel k, double* bytes, double* flops)
+{
+    const lbfgsb_workspace* w = &s->ctx->wrks;
+    double n = (double)s->n;
+    double col = (double)w->col;
+    double nfree = (double)w->nfree;
+    double nb = (double)s->nbreak;
+    double rs = sizeof(double);
+    double is = sizeof(integer);
+    switch (k) {
+    case PROJGR:
+        *bytes = n*(4*rs + is);
+        *flops = 2*n;
+        break;
+    case BMV:
+        *bytes = 8*(2*col*col + 4*col);
+        *flops = 3*col*col;
+        break;
+    case CAUCHY:
+        *bytes = n*((6 + 2*col)*rs + 2*is);
+        *flops = n*(4*col + 10);
+        break;
+    case BP_SORT:
+        *bytes = (nb > 1 ? 2*nb*log2(nb)*(rs + is) : 0.0);
+        *flops = (nb > 1 ? nb*log2(nb) : 0.0);
+        break;
+    case FORMK:
+        *bytes = n*(4*col*rs + is);
+        *flops = 4*col*n + 8*col*col*col/3;
+        break;
+    case CMPRLB:
+        *bytes = nfree*((2*col + 4)*rs + is);
+        *flops = nfree*(4*col + 4);
+        break;
+    case SUBSM:
+        *bytes = nfree*((4*col + 8)*rs + 2*is);
+        *flops = nfree*(4*col + 10) + 8*col*col;
+        break;
+    case TWOLOOP:
+        *bytes = n*(10*col + 4)*rs;
+        *flops = n*(8*col + 2);
+        break;
+    case LNSRLB:
+        *bytes = n*(14*rs + is);
+        *flops = 8*n;
+        break;
+    case FORMT:
+        *bytes = 8*3*col*col;
+        *flops = 5*col*col*col/6;
+        break;
+    case MATUPD:
+        *bytes = n*(4 + 4*col)*rs;
+        *flops = 4*col*n;
+        break;
+    default:
+        *bytes = 0.0;
+        *flops = 0.0;
+    }
+}
+
+// Restore the state modified by a routine (not timed).
+static void restore(
+    state* s, kernel k)
+{
+    lbfgsb_workspace* w = &s->ctx->wrks;
+    long n = s->n;
+    long m = s->m;
+    switch (k) {
+    case CAUCHY:
+        memcpy(w->iwhere, s->iwhere0, n*sizeof(integer));
+        break;
+    case BP_SORT:
+        memcpy(s->ts, s->tb, s->nbreak*sizeof(double));
+        memcpy(s->is, s->ib, s->nbreak*sizeof(integer));
+        break;
+    case FORMK:
+        memcpy(w->wn, s->wn0, 4*m*m*sizeof(double));
+        memcpy(w->snd, s->snd0, 4*m*m*sizeof(double));
+        break;
+    case SUBSM:
+        memcpy(w->z, s->z0, n*sizeof(double));
+        memcpy(w->r, s->r0, n*sizeof(double));
+        memcpy(w->wa8, s->wa0, 8*m*sizeof(double));
+        break;
+    case LNSRLB:
+        memcpy(s->x, s->x0, n*sizeof(double));
+        memcpy(w->d, s->d0, n*sizeof(double));
+        *w = s->w0;
+        break;
+    default:
+        break;
+    }
+}
+
+static void call(
+    state* s, kernel k)
+{
+    lbfgsb_context* ctx = s->ctx;
+    lbfgsb_workspace* w = &ctx->wrks;
+    long n = s->n;
+    long m = s->m;
+    int nt = ctx->nthreads;
+    double* wa = w->wa8;
+    switch (k) {
+    case PROJGR:
+        sink = projgr(nt, n, ctx->lower, ctx->upper, w->nbd, s->x, s->g);
+        break;
+    case BMV:
+        sink = bmv(m, w->sy, w->wt, w->col, w->head, &wa[2*m], &wa[4*m]);
+        break;
+    case CAUCHY:
+        sink = cauchy(nt, n, s->x, ctx->lower, ctx->upper, w->nbd, s->g,
+                      w->indx2, w->iwhere, w->t, w->d, w->z, m, w->wy, w->ws,
+                      w->hinc, w->hld, w->sy, w->wt, w->theta, w->col,
+                      w->head, &wa[0], &wa[2*m], &wa[4*m], &wa[6*m],
+                      w->part, &w->nseg, -1, stdout, w->sbgnrm, w->epsmch);
+        break;
+    case BP_SORT:
+        bp_sort(s->ts, s->is, 0, s->nbreak);
+        break;
+    case FORMK:
+        sink = formk(n, w->nfree, w->index, w->nenter, w->ileave, w->indx2,
+                     w->updatd, w->wn, w->snd, m, w->ws, w->wy, w->hinc,
+                     w->hld, w->sy, w->theta, w->col, w->head, &wa[4*m]);
+        break;
+    case CMPRLB:
+        sink = cmprlb(nt, n, m, s->x, s->g, w->ws, w->wy, w->hinc, w->hld,
+                      w->sy, w->wt, w->z, w->r, wa, w->index, w->theta,
+                      w->col, w->head, w->nfree, w->cnstnd);
+        break;
+    case SUBSM:
+        sink = subsm(nt, n, m, w->nfree, w->index, ctx->lower, ctx->upper,
+                     w->nbd, w->z, w->r, w->xp, w->ws, w->wy, w->hinc,
+                     w->hld, w->theta, s->x, s->g, w->col, w->head,
+                     &w->iword, wa, &wa[2*m], w->part, w->wn, -1, stdout);
+        break;
+    case TWOLOOP:
+        twoloop(nt, n, m, w->ws, w->wy, w->hinc, w->hld, w->sy, w->theta,
+                w->col, w->head, s->g, w->d, wa);
+        break;
+    case LNSRLB:
+        sink = lnsrlb(w, nt, n, ctx->lower, ctx->upper, w->nbd, s->x, s->f,
+                      s->g, w->d, w->r, w->t, w->z, 1);
+        break;
+    case FORMT:
+        sink = formt(m, w->wt, w->sy, w->ss, w->col, w->head, w->theta);
+        break;
+    case MATUPD:
+        {
+            double rr = lbfgsb_ddot(nt, n, s->y1, s->y1);
+            double dr = lbfgsb_ddot(nt, n, s->y1, s->s1);
+            double dtd = lbfgsb_ddot(nt, n, s->s1, s->s1);
+            ++w->iupdat;
+            matupd(nt, n, m, w->ws, w->wy, w->hinc, w->hld, w->sy, w->ss,
+                   s->s1, s->y1, &w->itail, w->iupdat, &w->col, &w->head,
+                   &w->theta, rr, dr, 1.0, dtd, wa, w->part, 0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void bench(
+    state* s, kernel k)
+{
+    double bytes, flops;
+    estimate(s, k, &bytes, &flops);
+    long reps = (bytes > 0.0 ? (long)(TRAFFIC/bytes) : MIN_CALLS);
+    if (reps < MIN_CALLS) {
+        reps = MIN_CALLS;
+    } else if (reps > 100000) {
+        reps = 100000;
+    }
+    int64_t best = -1;
+    for (long r = 0; r < reps; ++r) {
+        restore(s, k);
+        int64_t t0 = lbfgsb_clock_ns();
+        call(s, k);
+        int64_t t = lbfgsb_clock_ns() - t0;
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    if (best < 1) {
+        best = 1;
+    }
+    printf("%-8s %12ld %4ld %14.1f %10.2f %10.3f\n", kernel_names[k], s->n,
+           s->m, (double)best, bytes/(double)best, flops/(double)best);
+}
+
+int main(int argc, char* argv[])
+{
+    static const long default_sizes[] = {100000L, 1000000L};
+    long m = 5;
+    double free = 0.5, bounded = 1.0;
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-' &&
+           strlen(argv[first]) == 2) {
+        const char* arg = argv[first+1];
+        int ok = 1;
+        switch (argv[first][1]) {
+        case 'm':
+            m = atol(arg);
+            ok = (m >= 1);
+            break;
+        case 'f':
+            free = strtod(arg, NULL);
+            ok = (free >= 0.0 && free <= 1.0);
+            break;
+        case 'b':
+            bounded = strtod(arg, NULL);
+            ok = (bounded > 0.0 && bounded <= 1.0);
+            break;
+        case 't':
+            nthreads = atoi(arg);
+            ok = (nthreads >= 1 && nthreads <= LBFGSB_MAX_THREADS);
+            break;
+        default:
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "invalid option \"%s %s\"\n", argv[first], arg);
+            return EXIT_FAILURE;
+        }
+        first += 2;
+    }
+    int nsizes = (argc > first ? argc - first : 2);
+    printf("# BLAS backend: %s\n", lbfgsb_blas_backend());
+    printf("# Threads: %d\n", nthreads);
+    printf("# %-6s %12s %4s %14s %10s %10s\n", "kernel", "n", "m",
+           "time (ns)", "GB/s", "Gflop/s");
+    for (int i = 0; i < nsizes; ++i) {
+        long n = (argc > first ? (long)strtod(argv[first+i], NULL) :
+                  default_sizes[i]);
+        if (n < 2) {
+            fprintf(stderr, "invalid size \"%s\"\n", argv[first+i]);
+            return EXIT_FAILURE;
+        }
+        state s;
+        if (setup(&s, n, m, free, bounded) != 0) {
+            return EXIT_FAILURE;
+        }
+        const lbfgsb_workspace* w = &s.ctx->wrks;
+        printf("# n = %ld: %ld memorized pairs, %ld free variables, "
+               "%ld breakpoints\n", n, (long)w->col, (long)w->nfree,
+               s.nbreak);
+        for (int k = 0; k < NKERNELS; ++k) {
+            bench(&s, k);
+        }
+        cleanup(&s);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,377 @@
+// clbfgsb_bench_threads.c -
+//
+// Stress benchmark of concurrent L-BFGS-B contexts.  Usage:
+//
+//     clbfgsb_bench_threads [-t maxthreads] [-i iters] [-r solves] [-m mem]
+//                           [n]
+//
+// For `nthreads = 1, 2, 4, ...` up to `maxthreads` (the number of online
+// processors by default), the program starts `nthreads` threads which each
+// solve `solves` times (4 by default) a bound constrained problem of size
+// `n` (1e4 by default) with their own context for `iters` iterations (100 by
+// default) with `mem` memorized steps (5 by default).  The contexts print
+// their messages and their summary in streams of their own.  The program
+// prints the throughput (number of solves per second), the speedup with
+// respect to a single thread and the parallel efficiency, which should be
+// close to one as long as the threads do not compete for the memory
+// bandwidth (the problem and the workspace of a context fit in the cache for
+// the default size).  Each solve is checked against a first solve done alone:
+// the variables, the function value and the summary must be the same (the
+// lines with timings excepted), which would not be the case if the contexts
+// shared any mutable state.  Finally, the program solves `maxthreads*solves`
+// times the problem as the jobs of a pool of `maxthreads` workers (see
+// lbfgsb_pool_create()), checks their variables and function values and
+// prints the same figures with the number of jobs stolen by the workers and
+// their utilization reported by the pool.  Use `make bench-threads` to build
+// and run it.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lbfgsb.h"
+
+static double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+static long n = 10000;
+static long m = 5;
+static long iters = 100;
+static long solves = 4;
+
+// Coefficients of the problem (shared by all threads, read only).
+static double* a;
+static double* c;
+
+// Result of the first solve.
+static double* x_ref;
+static double f_ref;
+static char* summary_ref;
+
+// Work of a thread.
+typedef struct {
+    pthread_t thread;
+    double* x;
+    double* g;
+    char* summary;
+    long failures;
+    int status;
+} worker;
+
+// Coupled quadratic problem with condition number about 1e3 whose solution
+// has about half of its variables at a bound.
+static double compute_fg(
+    const double x[], double g[])
+{
+    double f = 0.0;
+    for (long i = 0; i < n; ++i) {
+        double e = x[i] - c[i];
+        f += 0.5*a[i]*e*e;
+        g[i] = a[i]*e;
+    }
+    for (long i = 0; i < n - 1; ++i) {
+        double e = x[i+1] - x[i];
+        f += 0.5*e*e;
+        g[i] -= e;
+        g[i+1] += e;
+    }
+    return f;
+}
+
+// Callback of the jobs of the pool (which always request the function and
+// its gradient).
+static int pool_fg(
+    void* data, long siz, const double x[], double* f, double g[])
+{
+    *f = compute_fg(x, g);
+    return 0;
+}
+
+// Set the bounds and the start point of the problem.
+static void start(
+    lbfgsb_context* ctx, double x[])
+{
+    ctx->factr = 0.0;
+    ctx->pgtol = 0.0;
+    lbfgsb_set_maxiter(ctx, iters);
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = c[i] + (i%2 == 0 ? 0.1 : -1.0);
+        ctx->upper[i] = INFINITY;
+        x[i] = 1.5;
+    }
+}
+
+// Read the contents of a temporary stream.
+static char* read_stream(
+    FILE* file)
+{
+    long len = ftell(file);
+    char* buf = (len < 0 ? NULL : malloc(len + 1));
+    if (buf != NULL) {
+        rewind(file);
+        if (fread(buf, 1, len, file) != (size_t)len) {
+            free(buf);
+            return NULL;
+        }
+        buf[len] = '\0';
+    }
+    return buf;
+}
+
+// Compare two summaries, skipping the lines with timings.
+static int same_summary(
+    const char* a,
+    const char* b)
+{
+    while (*a != '\0' && *b != '\0') {
+        const char* ea = strchr(a, '\n');
+        const char* eb = strchr(b, '\n');
+        size_t la = (ea == NULL ? strlen(a) : (size_t)(ea - a));
+        size_t lb = (eb == NULL ? strlen(b) : (size_t)(eb - b));
+        int timing = (strstr(a, "time") != NULL &&
+                      strstr(a, "time") < a + la);
+        if (!timing && (la != lb || strncmp(a, b, la) != 0)) {
+            return 0;
+        }
+        a += la + (ea != NULL);
+        b += lb + (eb != NULL);
+    }
+    return (*a == '\0' && *b == '\0');
+}
+
+// Solve the problem once with a new context, storing the solution in `x`,
+// the function value in `*f` and the summary in `*summary`.  Returns 0 on
+// success or -1 on error (the status is checked rather than `*f`, as NaN
+// cannot be detected when compiled with -ffast-math).
+static int solve(
+    double x[], double g[], double* f, char** summary)
+{
+    int status = -1;
+    *summary = NULL;
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    FILE* out = tmpfile();
+    FILE* file = tmpfile();
+    if (ctx != NULL && out != NULL && file != NULL) {
+        lbfgsb_set_output(ctx, out);
+        lbfgsb_set_summary(ctx, file);
+        ctx->print = 1;
+        start(ctx, x);
+        while (1) {
+            lbfgsb_task task = lbfgsb_iterate(ctx, x, f, g);
+            if (task == LBFGSB_FG) {
+                *f = compute_fg(x, g);
+            } else if (task != LBFGSB_NEW_X) {
+                break;
+            }
+        }
+        if (lbfgsb_get_status(ctx) != LBFGSB_FAILURE) {
+            status = 0;
+        }
+        lbfgsb_destroy(ctx);
+        *summary = read_stream(file);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    return (*summary == NULL ? -1 : status);
+}
+
+static void* run(
+    void* arg)
+{
+    worker* w = arg;
+    for (long k = 0; k < solves; ++k) {
+        double f;
+        if (solve(w->x, w->g, &f, &w->summary) != 0) {
+            w->status = -1;
+        } else if (f != f_ref ||
+                   memcmp(w->x, x_ref, n*sizeof(double)) != 0 ||
+                   !same_summary(w->summary, summary_ref)) {
+            ++w->failures;
+        }
+        free(w->summary);
+        w->summary = NULL;
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    long maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-' &&
+           strlen(argv[first]) == 2) {
+        long val = atol(argv[first+1]);
+        switch (argv[first][1]) {
+        case 't': maxthreads = val; break;
+        case 'i': iters = val; break;
+        case 'r': solves = val; break;
+        case 'm': m = val; break;
+        default:  val = 0;
+        }
+        if (val < 1) {
+            fprintf(stderr, "invalid option \"%s %s\"\n", argv[first],
+                    argv[first+1]);
+            return EXIT_FAILURE;
+        }
+        first += 2;
+    }
+    if (argc > first) {
+        n = (long)strtod(argv[first], NULL);
+        if (n < 2) {
+            fprintf(stderr, "invalid size \"%s\"\n", argv[first]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (maxthreads < 1) {
+        maxthreads = 1;
+    }
+
+    // Reference solve.
+    worker* workers = calloc(maxthreads, sizeof(worker));
+    a = malloc(n*sizeof(double));
+    c = malloc(n*sizeof(double));
+    x_ref = malloc(n*sizeof(double));
+    double* g = malloc(n*sizeof(double));
+    if (workers == NULL || a == NULL || c == NULL || x_ref == NULL ||
+        g == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < n; ++i) {
+        a[i] = pow(1e3, (double)i/(double)(n - 1));
+        c[i] = sin(0.01*(double)i);
+    }
+    int status = solve(x_ref, g, &f_ref, &summary_ref);
+    free(g);
+    if (status != 0) {
+        fprintf(stderr, "reference solve failed\n");
+        return EXIT_FAILURE;
+    }
+    for (long k = 0; k < maxthreads; ++k) {
+        workers[k].x = malloc(n*sizeof(double));
+        workers[k].g = malloc(n*sizeof(double));
+        if (workers[k].x == NULL || workers[k].g == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("# Size: %ld, memory: %ld, iterations: %ld, solves per thread: "
+           "%ld\n", n, m, iters, solves);
+    printf("# %-6s %12s %10s %10s %9s\n", "threads", "solves/s", "speedup",
+           "efficiency", "failures");
+    double rate1 = 0.0;
+    long total_failures = 0;
+    for (long nt = 1; ; nt *= 2) {
+        if (nt > maxthreads) {
+            nt = maxthreads;
+        }
+        double t0 = wall_time();
+        for (long k = 0; k < nt; ++k) {
+            workers[k].failures = 0;
+            workers[k].status = 0;
+            if (pthread_create(&workers[k].thread, NULL, run,
+                               &workers[k]) != 0) {
+                fprintf(stderr, "cannot create thread\n");
+                return EXIT_FAILURE;
+            }
+        }
+        long failures = 0;
+        for (long k = 0; k < nt; ++k) {
+            pthread_join(workers[k].thread, NULL);
+            if (workers[k].status != 0) {
+                fprintf(stderr, "solve failed\n");
+                return EXIT_FAILURE;
+            }
+            failures += workers[k].failures;
+        }
+        double rate = (double)(nt*solves)/(wall_time() - t0);
+        if (nt == 1) {
+            rate1 = rate;
+        }
+        printf("%8ld %12.2f %10.2f %10.3f %9ld\n", nt, rate, rate/rate1,
+               rate/(rate1*(double)nt), failures);
+        total_failures += failures;
+        if (nt == maxthreads) {
+            break;
+        }
+    }
+
+    // Same solves as the jobs of a pool.
+    long njobs = maxthreads*solves;
+    lbfgsb_pool* pool = lbfgsb_pool_create(maxthreads);
+    lbfgsb_context** ctxs = calloc(njobs, sizeof(lbfgsb_context*));
+    double* xs = malloc(2*njobs*n*sizeof(double));
+    if (pool == NULL || ctxs == NULL || xs == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return EXIT_FAILURE;
+    }
+    for (long j = 0; j < njobs; ++j) {
+        double* x = xs + 2*j*n;
+        ctxs[j] = lbfgsb_create(n, m);
+        if (ctxs[j] == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return EXIT_FAILURE;
+        }
+        start(ctxs[j], x);
+        if (lbfgsb_pool_submit(pool, ctxs[j], x, x + n, pool_fg,
+                               NULL) != j) {
+            fprintf(stderr, "cannot submit job\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (lbfgsb_pool_wait(pool) != 0) {
+        fprintf(stderr, "solve failed\n");
+        return EXIT_FAILURE;
+    }
+    long failures = 0;
+    for (long j = 0; j < njobs; ++j) {
+        lbfgsb_job_stats js;
+        lbfgsb_pool_get_job_stats(pool, j, &js);
+        if (js.f != f_ref ||
+            memcmp(xs + 2*j*n, x_ref, n*sizeof(double)) != 0) {
+            ++failures;
+        }
+    }
+    lbfgsb_pool_stats ps;
+    lbfgsb_pool_get_stats(pool, &ps);
+    printf("# %-6s %12s %10s %10s %9s %7s %6s\n", "workers", "solves/s",
+           "speedup", "efficiency", "failures", "steals", "usage");
+    printf("%8d %12.2f %10.2f %10.3f %9ld %7ld %6.3f\n", ps.workers,
+           ps.job_rate, ps.job_rate/rate1,
+           ps.job_rate/(rate1*(double)ps.workers), failures, ps.steals,
+           ps.utilization);
+    total_failures += failures;
+    lbfgsb_pool_destroy(pool);
+    for (long j = 0; j < njobs; ++j) {
+        lbfgsb_destroy(ctxs[j]);
+    }
+    free(ctxs);
+    free(xs);
+
+    for (long k = 0; k < maxthreads; ++k) {
+        free(workers[k].x);
+        free(workers[k].g);
+    }
+    free(workers);
+    free(a);
+    free(c);
+    free(x_ref);
+    free(summary_ref);
+    return (total_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
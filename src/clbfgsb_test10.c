@@ -0,0 +1,252 @@
+// clbfgsb_test10.c -
+//
+// This example checks the stopping criteria of the engine and the reasons of
+// the termination given by lbfgsb_get_status().  The problem is that of
+// `clbfgsb_test1.c` (the extended Rosenbrock function subject to bounds on
+// the variables).  It is solved with a threshold on the function value, with
+// absolute and relative tolerances on the step, with maximum numbers of
+// iterations and of evaluations and with a deadline.  For each criterion, the
+// status and the numbers of iterations and of evaluations must be those
+// expected, and the variables, the function value and the gradient must be
+// those of the last iterate.  This is checked for all the maximum numbers of
+// evaluations smaller than that needed to converge, so that the line search
+// is interrupted before exceeding the limit in some cases.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Stopping criteria, as in the context.
+typedef struct {
+    double fatol;
+    double xatol;
+    double xrtol;
+    long   maxiter;
+    long   maxeval;
+    double deadline;
+} criteria;
+
+// Result of an optimization.
+typedef struct {
+    lbfgsb_task   task;
+    lbfgsb_status status;
+    long   niter;        // Number of iterations.
+    long   nfgv;         // Number of evaluations counted by the engine.
+    long   nevals;       // Number of evaluations done by the driver.
+    int    restored;     // Whether the line search has been interrupted.
+    int    same;         // Whether the last iterate is returned.
+    double fprev;        // Function value at the iterate before the last.
+    double step;         // Euclidean norm of the last step.
+    double xnorm;        // Euclidean norm of the last iterate.
+    double f;            // Function value at the last iterate.
+} result;
+
+// Solve the sample problem with the stopping criteria `crit` in addition to
+// the default ones.
+static void solve(
+    result*         res,
+    long            n,
+    long            m,
+    const criteria* crit)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    double x[n], f, g[n];
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    lbfgsb_set_fatol(ctx, crit->fatol);
+    lbfgsb_set_xatol(ctx, crit->xatol);
+    lbfgsb_set_xrtol(ctx, crit->xrtol);
+    lbfgsb_set_maxiter(ctx, crit->maxiter);
+    lbfgsb_set_maxeval(ctx, crit->maxeval);
+    lbfgsb_set_deadline(ctx, crit->deadline);
+
+    // The last iterate, starting with the initial variables.
+    double xlast[n], flast = NAN, glast[n];
+    res->nevals = 0;
+    res->fprev = NAN;
+    res->step = NAN;
+    lbfgsb_task task, prev = LBFGSB_START;
+    while (1) {
+        task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, n);
+            if (++res->nevals == 1) {
+                memcpy(xlast, x, sizeof(x));
+                memcpy(glast, g, sizeof(g));
+                flast = f;
+            }
+        } else if (task == LBFGSB_NEW_X) {
+            double s = 0.0;
+            for (long i = 0; i < n; ++i) {
+                s += pow2(x[i] - xlast[i]);
+            }
+            res->step = sqrt(s);
+            res->fprev = flast;
+            memcpy(xlast, x, sizeof(x));
+            memcpy(glast, g, sizeof(g));
+            flast = f;
+        } else {
+            break;
+        }
+        prev = task;
+    }
+    double s = 0.0;
+    for (long i = 0; i < n; ++i) {
+        s += pow2(x[i]);
+    }
+    res->xnorm = sqrt(s);
+    res->task = task;
+    res->status = lbfgsb_get_status(ctx);
+    res->niter = LBFGSB_NUM_ITER(ctx);
+    res->nfgv = LBFGSB_NTOT_FG(ctx);
+    res->restored = (prev == LBFGSB_FG);
+    res->same = (f == flast && memcmp(x, xlast, sizeof(x)) == 0 &&
+                 memcmp(g, glast, sizeof(g)) == 0);
+    res->f = f;
+    lbfgsb_destroy(ctx);
+}
+
+// Print the result of a test and yield whether it has failed.
+static int report(
+    const char*   name,
+    const result* res,
+    int           ok)
+{
+    ok = (ok && res->same && res->nevals == res->nfgv);
+    printf(" %-23s: %2ld iterations, %2ld evaluations, status %d: %s\n",
+           name, res->niter, res->nfgv, (int)res->status, (ok ? "yes" : "NO"));
+    return !ok;
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+    const criteria none = {
+        .fatol = -INFINITY, .xatol = 0.0, .xrtol = 0.0,
+        .maxiter = -1, .maxeval = -1, .deadline = INFINITY};
+    criteria crit;
+    result ref, res;
+
+    // Without other criteria.
+    solve(&ref, n, m, &none);
+    failures += report("Default criteria", &ref,
+                       (ref.task == LBFGSB_CONVERGENCE &&
+                        (ref.status == LBFGSB_FACTR_TEST ||
+                         ref.status == LBFGSB_PGTOL_TEST)));
+
+    // Threshold on the function value.
+    crit = none;
+    crit.fatol = 1.0;
+    solve(&res, n, m, &crit);
+    failures += report("Function threshold", &res,
+                       (res.task == LBFGSB_CONVERGENCE &&
+                        res.status == LBFGSB_FATOL_TEST &&
+                        res.f <= crit.fatol && res.fprev > crit.fatol));
+
+    // Absolute and relative tolerances on the step.
+    crit = none;
+    crit.xatol = 1e-2;
+    solve(&res, n, m, &crit);
+    failures += report("Absolute step tolerance", &res,
+                       (res.task == LBFGSB_CONVERGENCE &&
+                        res.status == LBFGSB_XTOL_TEST &&
+                        res.step <= 1.0001*crit.xatol &&
+                        res.niter < ref.niter));
+    crit = none;
+    crit.xrtol = 1e-3;
+    solve(&res, n, m, &crit);
+    failures += report("Relative step tolerance", &res,
+                       (res.task == LBFGSB_CONVERGENCE &&
+                        res.status == LBFGSB_XTOL_TEST &&
+                        res.step <= 1.0001*crit.xrtol*res.xnorm &&
+                        res.niter < ref.niter));
+
+    // Maximum number of iterations.
+    crit = none;
+    crit.maxiter = 5;
+    solve(&res, n, m, &crit);
+    failures += report("Maximum iterations", &res,
+                       (res.task == LBFGSB_WARNING &&
+                        res.status == LBFGSB_TOO_MANY_ITERATIONS &&
+                        res.niter == crit.maxiter));
+
+    // Maximum number of evaluations.
+    int nrestored = 0;
+    for (crit = none, crit.maxeval = 1; crit.maxeval < ref.nfgv;
+         ++crit.maxeval) {
+        char name[48];
+        solve(&res, n, m, &crit);
+        sprintf(name, "Maximum evaluations %ld", crit.maxeval);
+        failures += report(name, &res,
+                           (res.task == LBFGSB_WARNING &&
+                            res.status == LBFGSB_TOO_MANY_EVALUATIONS &&
+                            res.nfgv == crit.maxeval));
+        nrestored += res.restored;
+    }
+    printf(" Line searches interrupted by the maximum evaluations: %d\n",
+           nrestored);
+    failures += (nrestored == 0);
+
+    // Deadline.
+    crit = none;
+    crit.deadline = 0.0;
+    solve(&res, n, m, &crit);
+    failures += report("Deadline", &res,
+                       (res.task == LBFGSB_WARNING &&
+                        res.status == LBFGSB_DEADLINE_REACHED &&
+                        res.niter >= 1 && res.niter < ref.niter));
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,161 @@
+// clbfgsb_test11.c -
+//
+// This example checks the iteration trace (see lbfgsb_set_trace() and
+// lbfgsb_read_trace()).  The problem is that of `clbfgsb_test1.c` (the
+// extended Rosenbrock function subject to bounds on the variables).  The
+// trace is first drained at each new iterate: the records must be those of
+// all the iterates with the numbers of iterations and of evaluations given by
+// `LBFGSB_NUM_ITER` and `LBFGSB_NTOT_FG`.  Then the trace is given a small
+// capacity and only drained once during the optimization: the records of the
+// iterates found while the buffer was full must be dropped.  Finally, a trace
+// too large to be allocated must be refused.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+// Maximum number of records read at once.
+#define MAXREC 200
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Create a context for the sample problem with a trace of `capacity` records
+// and set the initial variables.
+static lbfgsb_context* start(
+    double x[],
+    long   n,
+    long   m,
+    long   capacity)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL || lbfgsb_set_trace(ctx, capacity) != 0) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    return ctx;
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+    static lbfgsb_trace_record rec[MAXREC];
+    double x[n], f, g[n];
+
+    // Drain the trace at each new iterate.
+    lbfgsb_context* ctx = start(x, n, m, 4);
+    long next = 0; // Expected iteration number of the next record.
+    int ok = 1;
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, n);
+        } else if (task == LBFGSB_NEW_X) {
+            long k = lbfgsb_read_trace(ctx, rec, MAXREC);
+            for (long j = 0; j < k; ++j) {
+                ok &= (rec[j].iter == next++);
+            }
+            // The last record is that of the new iterate.
+            ok &= (k > 0 && rec[k-1].iter == LBFGSB_NUM_ITER(ctx) &&
+                   rec[k-1].nfgv == LBFGSB_NTOT_FG(ctx) && rec[k-1].f == f);
+        } else {
+            break;
+        }
+    }
+    ok &= (lbfgsb_read_trace(ctx, rec, MAXREC) == 0 &&
+           next == LBFGSB_NUM_ITER(ctx) + 1);
+    printf(" Trace drained at each iterate: %ld records, all read: %s\n",
+           next, (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Drain a small trace only once, at the 10th iteration.
+    long capacity = 4, drain = 10;
+    ctx = start(x, n, m, capacity);
+    long k1 = 0;
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, n);
+        } else if (task == LBFGSB_NEW_X) {
+            if (LBFGSB_NUM_ITER(ctx) == drain) {
+                k1 = lbfgsb_read_trace(ctx, rec, MAXREC);
+            }
+        } else {
+            break;
+        }
+    }
+    long k2 = lbfgsb_read_trace(ctx, rec + k1, MAXREC - k1);
+    ok = (k1 == capacity && k2 == capacity);
+    for (long j = 0; ok && j < k1 + k2; ++j) {
+        // The records 0 to capacity-1 are read at the drain, which is too
+        // late for the record of the drained iteration.
+        long iter = (j < k1 ? j : drain + 1 + j - k1);
+        ok &= (rec[j].iter == iter);
+    }
+    printf(" Trace of %ld records drained at iteration %ld: "
+           "%ld and %ld records, gap in iterations: %s\n", capacity, drain,
+           k1, k2, (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Too large trace.
+    ctx = lbfgsb_create(n, m);
+    errno = 0;
+    ok = (lbfgsb_set_trace(ctx, LONG_MAX) == -1 && errno == EOVERFLOW &&
+          lbfgsb_read_trace(ctx, rec, MAXREC) == 0);
+    printf(" Too large trace refused: %s\n", (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,233 @@
+// clbfgsb_test12.c -
+//
+// This example demonstrates how to run the L-BFGS-B code by a single call to
+// lbfgsb_minimize() with callbacks computing the objective function and its
+// gradient and inspecting the new iterates, instead of writing the loop of
+// reverse communication around lbfgsb_iterate() (see `clbfgsb_test1.c`).  The
+// problem is that of `clbfgsb_test1.c` (the extended Rosenbrock function
+// subject to bounds on the variables).  It checks that:
+//
+// - the solution and the counts are exactly those of the loop calling
+//   lbfgsb_iterate(), and the callback `newx` sees each iterate;
+//
+// - an optimization interrupted in the loop at a request of the function and
+//   its gradient is completed by lbfgsb_minimize();
+//
+// - the optimization stops at the iterate for which `newx` yields a non-zero
+//   value and nothing is done if lbfgsb_minimize() is called again;
+//
+// - if `fg` fails, the optimization stops with the variables, the function
+//   value and the gradient of the last iterate.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Data of the callbacks.
+typedef struct {
+    long   nevals;      // Number of calls to `fg`.
+    long   fail;        // Call of `fg` which fails (none if 0).
+    long   niter;       // Number of calls to `newx`.
+    long   stop;        // Call of `newx` which stops (none if 0).
+    double f;           // Function value at the last iterate.
+    double x[N];        // Variables at the last iterate.
+    double g[N];        // Gradient at the last iterate.
+} problem;
+
+static int fg(
+    void*        data,
+    long         n,
+    const double x[],
+    double*      f,
+    double       g[])
+{
+    problem* p = data;
+    if (++p->nevals == p->fail) {
+        return -1;
+    }
+    *f = compute_fg(x, g, n);
+    return 0;
+}
+
+static int newx(
+    void*           data,
+    lbfgsb_context* ctx,
+    const double    x[],
+    double          f,
+    const double    g[])
+{
+    problem* p = data;
+    p->f = f;
+    memcpy(p->x, x, ctx->siz*sizeof(double));
+    memcpy(p->g, g, ctx->siz*sizeof(double));
+    return (++p->niter == p->stop);
+}
+
+// Create a context for the sample problem, set the initial variables and
+// reset the data of the callbacks.
+static lbfgsb_context* start(
+    problem* p,
+    double   x[],
+    long     n,
+    long     m)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    memset(p, 0, sizeof(*p));
+    p->f = NAN;
+    return ctx;
+}
+
+// Yield whether the task message of the context starts with `mesg`.
+static int has_message(
+    lbfgsb_context* ctx,
+    const char*     mesg)
+{
+    char buf[LBFGSB_TASK_LENGTH + 1];
+    lbfgsb_get_task_string(ctx, buf, sizeof(buf));
+    return (strncmp(buf, mesg, strlen(mesg)) == 0);
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+    problem p;
+    double x0[n], f0, g0[n];
+    double x[n], f, g[n];
+
+    // Reference solution by the loop of reverse communication.
+    lbfgsb_context* ctx0 = start(&p, x0, n, m);
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx0, x0, &f0, g0);
+        if (task == LBFGSB_FG) {
+            f0 = compute_fg(x0, g0, n);
+        } else if (task != LBFGSB_NEW_X) {
+            break;
+        }
+    }
+
+    // Same optimization by lbfgsb_minimize().
+    lbfgsb_context* ctx = start(&p, x, n, m);
+    lbfgsb_task task = lbfgsb_minimize(ctx, fg, newx, &p, x, &f, g);
+    int ok = (task == lbfgsb_get_task(ctx0) && f == f0 &&
+              memcmp(x, x0, sizeof(x)) == 0 &&
+              LBFGSB_NUM_ITER(ctx) == LBFGSB_NUM_ITER(ctx0) &&
+              LBFGSB_NTOT_FG(ctx) == LBFGSB_NTOT_FG(ctx0) &&
+              p.nevals == LBFGSB_NTOT_FG(ctx) &&
+              p.niter == LBFGSB_NUM_ITER(ctx));
+    printf(" Minimized with callbacks: %ld iterations, %ld evaluations, "
+           "same solution: %s\n", p.niter, p.nevals, (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Optimization started by the loop and completed by lbfgsb_minimize().
+    ctx = start(&p, x, n, m);
+    for (long k = 0; k < 10; ) {
+        task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG && ++k < 10) {
+            f = compute_fg(x, g, n);
+        }
+    }
+    task = lbfgsb_minimize(ctx, fg, NULL, &p, x, &f, g);
+    ok = (task == lbfgsb_get_task(ctx0) && f == f0 &&
+          memcmp(x, x0, sizeof(x)) == 0 &&
+          LBFGSB_NTOT_FG(ctx) == LBFGSB_NTOT_FG(ctx0));
+    printf(" Resumed at a pending evaluation: same solution: %s\n",
+           (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Optimization stopped by the callback inspecting the iterates.
+    ctx = start(&p, x, n, m);
+    p.stop = 5;
+    task = lbfgsb_minimize(ctx, fg, newx, &p, x, &f, g);
+    ok = (task == LBFGSB_STOP && lbfgsb_get_status(ctx) == LBFGSB_STOPPED &&
+          has_message(ctx, "STOP: REQUESTED BY THE CALLBACK") &&
+          LBFGSB_NUM_ITER(ctx) == p.stop && f == p.f &&
+          memcmp(x, p.x, sizeof(x)) == 0);
+    long nevals = p.nevals;
+    task = lbfgsb_minimize(ctx, fg, newx, &p, x, &f, g);
+    ok = (ok && task == LBFGSB_STOP && p.nevals == nevals &&
+          p.niter == p.stop);
+    printf(" Stopped by newx at iteration %ld: %s\n", p.stop,
+           (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Optimizations stopped by a failure of the callback computing the
+    // objective function, at the start and in a line search.
+    for (long fail = 1; fail <= 12; fail += 11) {
+        ctx = start(&p, x, n, m);
+        p.fail = fail;
+        task = lbfgsb_minimize(ctx, fg, newx, &p, x, &f, g);
+        ok = (task == LBFGSB_STOP &&
+              lbfgsb_get_status(ctx) == LBFGSB_STOPPED &&
+              has_message(ctx, "STOP: EVALUATION FAILED") &&
+              p.nevals == fail);
+        if (fail > 1) {
+            // The last iterate is restored.
+            ok = (ok && f == p.f && memcmp(x, p.x, sizeof(x)) == 0 &&
+                  memcmp(g, p.g, sizeof(g)) == 0);
+        }
+        printf(" Stopped by a failure of fg at evaluation %ld: %s\n", fail,
+               (ok ? "yes" : "NO"));
+        failures += !ok;
+        lbfgsb_destroy(ctx);
+    }
+
+    lbfgsb_destroy(ctx0);
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -150,7 +150,7 @@ int main(int argc, char* argv[])
             // 4) the norm of the projected gradient,
             printf("Iterate %4d    nfg = %4d    "
                    "f =%12.5E    |proj g| =%12.5E\n",
-                   LBFGSB_NUM_ITER(ctx), LBFGSB_NTOT_FG(ctx),
+                   (int)LBFGSB_NUM_ITER(ctx), (int)LBFGSB_NTOT_FG(ctx),
                    f, LBFGSB_PG_NORMINF(ctx));
 
             // If the run is to be terminated, we print also the information
@@ -0,0 +1,188 @@
+// clbfgsb_test5.c -
+//
+// This example demonstrates how to solve many small independent problems
+// with a batch.  Each problem is the extended Rosenbrock function
+// subject to bounds on the variables of `clbfgsb_test1.c`, with a different
+// starting point.  The objective functions and gradients of all the problems
+// are computed in a single pass over the variables stored as a structure of
+// arrays.  The solutions are compared to those found with a context per
+// problem.
+//
+// The dimension `N` of the problems, the maximum number `M` of steps to
+// memorize and the number `K` of problems can be set by compiling with
+// `-DN=...`, `-DM=...` and/or `-DK=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 16
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+// Number of problems.
+#ifndef K
+# define K 500
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+// Compute the objective function values and the gradients of the `nprobs`
+// problems whose variables `x` and gradients `g` are stored as a structure
+// of arrays.  The innermost loops are over the problems, which are all
+// computed (those whose task is not `LBFGSB_FG` are simply ignored by the
+// batch).
+static void compute_fg(
+    const double x[],
+    double       f[],
+    double       g[],
+    long         n,
+    long         nprobs)
+{
+#define X(i) x[(i)*nprobs + k]
+#define G(i) g[(i)*nprobs + k]
+    // Compute function values f for the sample problem.
+    for (long k = 0; k < nprobs; ++k) {
+        f[k] = pow2(X(0) - 1);
+    }
+    for (long i = 1; i < n; ++i) {
+        for (long k = 0; k < nprobs; ++k) {
+            f[k] += 4*pow2(X(i) - pow2(X(i-1)));
+        }
+    }
+
+    // Compute gradients g for the sample problem.
+    for (long k = 0; k < nprobs; ++k) {
+        G(0) = 2*(X(0) - 1) - 16*X(0)*(X(1) - pow2(X(0)));
+    }
+    for (long i = 1; i < n-1; ++i) {
+        for (long k = 0; k < nprobs; ++k) {
+            G(i) = 8*(X(i) - pow2(X(i-1))) - 16*X(i)*(X(i+1) - pow2(X(i)));
+        }
+    }
+    for (long k = 0; k < nprobs; ++k) {
+        G(n-1) = 8*(X(n-1) - pow2(X(n-2)));
+    }
+#undef X
+#undef G
+}
+
+// Starting point of the i-th variable of the k-th problem.
+static double initial_x(long i, long k)
+{
+    return 3.0 + 0.01*(double)((i + 7*k)%11);
+}
+
+int main(int argc, char* argv[])
+{
+    long n = N, m = M, nprobs = K;
+
+    // Create a new batch.
+    lbfgsb_batch* batch = lbfgsb_batch_create(nprobs, n, m);
+    if (batch == NULL) {
+        fprintf(stderr, "failed to allocate batch\n");
+        return EXIT_FAILURE;
+    }
+
+    // Initialize bounds and variables.
+    double* x = malloc(n*nprobs*sizeof(double));
+    double* g = malloc(n*nprobs*sizeof(double));
+    double* f = malloc(nprobs*sizeof(double));
+    if (x == NULL || g == NULL || f == NULL) {
+        fprintf(stderr, "failed to allocate variables\n");
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < n; ++i) {
+        for (long k = 0; k < nprobs; ++k) {
+            batch->lower[i*nprobs + k] = (i&1) == 0 ? 1.0 : -1.0e2;
+            batch->upper[i*nprobs + k] = 1.0e2;
+            x[i*nprobs + k] = initial_x(i, k);
+        }
+    }
+
+    // Run algorithm.
+    long ncalls = 0;
+    while (lbfgsb_batch_iterate(batch, x, f, g) > 0) {
+        compute_fg(x, f, g, n, nprobs);
+        ++ncalls;
+    }
+
+    // Solve each problem with its own context and compare.
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    double xk[n], gk[n], fk = 0.0;
+    long nconv = 0, niter = 0, nfg = 0;
+    double maxdiff = 0.0;
+    for (long k = 0; k < nprobs; ++k) {
+        const lbfgsb_context* bctx = lbfgsb_batch_get_context(batch, k);
+        if (batch->task[k] == LBFGSB_CONVERGENCE) {
+            ++nconv;
+        }
+        niter += LBFGSB_NUM_ITER(bctx);
+        nfg += LBFGSB_NTOT_FG(bctx);
+        lbfgsb_reset(ctx, 0);
+        for (long i = 0; i < n; ++i) {
+            ctx->lower[i] = batch->lower[i*nprobs + k];
+            ctx->upper[i] = batch->upper[i*nprobs + k];
+            xk[i] = initial_x(i, k);
+        }
+        while (1) {
+            int task = lbfgsb_iterate(ctx, xk, &fk, gk);
+            if (task == LBFGSB_FG) {
+                compute_fg(xk, &fk, gk, n, 1);
+            } else if (task != LBFGSB_NEW_X) {
+                break;
+            }
+        }
+        maxdiff = fmax(maxdiff, fabs(fk - f[k]));
+        for (long i = 0; i < n; ++i) {
+            maxdiff = fmax(maxdiff, fabs(xk[i] - x[i*nprobs + k]));
+        }
+    }
+    printf(" Number of problems       = %ld\n", nprobs);
+    printf(" Number of variables      = %ld\n", n);
+    printf(" Calls to batch_iterate   = %ld\n", ncalls);
+    printf(" Converged problems       = %ld\n", nconv);
+    printf(" Total iterations         = %ld\n", niter);
+    printf(" Total f and g evaluations= %ld\n", nfg);
+    // The differences are only due to rounding errors in compute_fg (which
+    // may be vectorized differently for one or several problems).
+    printf(" Same solutions as with separate contexts: %s\n",
+           (maxdiff <= 1e-10 ? "yes" : "NO"));
+
+    // The lazy gradient is not supported by a batch, a problem using it must
+    // be finished with an error while the other ones are solved.
+    lbfgsb_batch_reset(batch, 0);
+    lbfgsb_set_lazy_gradient(lbfgsb_batch_get_context(batch, 1), 1);
+    for (long i = 0; i < n; ++i) {
+        for (long k = 0; k < nprobs; ++k) {
+            x[i*nprobs + k] = initial_x(i, k);
+        }
+    }
+    while (lbfgsb_batch_iterate(batch, x, f, g) > 0) {
+        compute_fg(x, f, g, n, nprobs);
+    }
+    long nerr = 0;
+    nconv = 0;
+    for (long k = 0; k < nprobs; ++k) {
+        nerr += (batch->task[k] == LBFGSB_ERROR);
+        nconv += (batch->task[k] == LBFGSB_CONVERGENCE);
+    }
+    printf(" Problem in lazy gradient mode rejected: %s\n",
+           (nerr == 1 && batch->task[1] == LBFGSB_ERROR &&
+            nconv == nprobs - 1 ? "yes" : "NO"));
+
+    // Release resources.
+    lbfgsb_destroy(ctx);
+    lbfgsb_batch_destroy(batch);
+    free(x);
+    free(g);
+    free(f);
+    return EXIT_SUCCESS;
+}
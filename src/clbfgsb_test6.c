@@ -0,0 +1,173 @@
+// clbfgsb_test6.c -
+//
+// This example checks that an optimization can be checkpointed with
+// lbfgsb_save() and resumed with lbfgsb_load().  The problem is that of
+// `clbfgsb_test1.c` (the extended Rosenbrock function subject to bounds on
+// the variables).  The optimization is interrupted at a request of the
+// function and its gradient (task `LBFGSB_FG`) and at a new iterate (task
+// `LBFGSB_NEW_X`), the context is saved, destroyed and loaded again, then the
+// optimization is continued.  The checkpoint is written at the beginning of a
+// file, so that it is mapped by lbfgsb_load(), and after a single byte, so
+// that it is read.  The resumed optimizations must yield exactly the same
+// solution and counts as an uninterrupted one.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Create a context for the sample problem and set the initial variables.
+static lbfgsb_context* start(
+    double x[],
+    long   n,
+    long   m)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    return ctx;
+}
+
+// Save the context in a temporary file, after `skip` bytes, destroy it and
+// load it again.
+static lbfgsb_context* reload(
+    lbfgsb_context* ctx,
+    int             skip)
+{
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        fprintf(stderr, "failed to create temporary file\n");
+        exit(EXIT_FAILURE);
+    }
+    int fd = fileno(file);
+    if ((skip > 0 && write(fd, "#", skip) != skip) ||
+        lbfgsb_save(ctx, fd) != 0) {
+        fprintf(stderr, "failed to save context\n");
+        exit(EXIT_FAILURE);
+    }
+    lbfgsb_destroy(ctx);
+    if (lseek(fd, skip, SEEK_SET) != skip ||
+        (ctx = lbfgsb_load(fd)) == NULL) {
+        fprintf(stderr, "failed to load context\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    return ctx;
+}
+
+// Solve the sample problem and store the solution in `x` and `*f`.  If
+// `stop` is `LBFGSB_FG` or `LBFGSB_NEW_X`, the context is reloaded when this
+// task is returned for the `count`-th time, after `skip` bytes of the file.
+// Yields the context.
+static lbfgsb_context* solve(
+    double      x[],
+    double*     f,
+    long        n,
+    long        m,
+    lbfgsb_task stop,
+    long        count,
+    int         skip)
+{
+    lbfgsb_context* ctx = start(x, n, m);
+    double g[n];
+    long k = 0;
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, f, g);
+        if (task == stop && ++k == count) {
+            ctx = reload(ctx, skip);
+        }
+        if (task == LBFGSB_FG) {
+            *f = compute_fg(x, g, n);
+        } else if (task != LBFGSB_NEW_X) {
+            return ctx;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+
+    // Uninterrupted optimization.
+    double x0[n], f0;
+    lbfgsb_context* ctx0 = solve(x0, &f0, n, m, LBFGSB_START, 0, 0);
+    printf(" Iterations and evaluations: %ld %ld\n",
+           (long)LBFGSB_NUM_ITER(ctx0), (long)LBFGSB_NTOT_FG(ctx0));
+
+    // Interrupted optimizations.
+    const struct {
+        lbfgsb_task task;
+        const char* name;
+    } stops[] = {{LBFGSB_FG, "FG"}, {LBFGSB_NEW_X, "NEW_X"}};
+    int failures = 0;
+    for (int j = 0; j < 2; ++j) {
+        for (int skip = 0; skip <= 1; ++skip) {
+            double x[n], f;
+            lbfgsb_context* ctx = solve(x, &f, n, m, stops[j].task, 10, skip);
+            int same = (f == f0 && memcmp(x, x0, sizeof(x)) == 0 &&
+                        ctx->task == ctx0->task &&
+                        LBFGSB_NUM_ITER(ctx) == LBFGSB_NUM_ITER(ctx0) &&
+                        LBFGSB_NTOT_FG(ctx) == LBFGSB_NTOT_FG(ctx0));
+            printf(" Reloaded at %-5s %-8s: same solution: %s\n",
+                   stops[j].name, (skip ? "(read)" : "(mapped)"),
+                   (same ? "yes" : "NO"));
+            failures += !same;
+            lbfgsb_destroy(ctx);
+        }
+    }
+
+    // Release resources.
+    lbfgsb_destroy(ctx0);
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,171 @@
+// clbfgsb_test7.c -
+//
+// This example checks the speculative line search with several trial steps
+// (see lbfgsb_set_trials()).  The problem is that of `clbfgsb_test1.c` (the
+// extended Rosenbrock function subject to bounds on the variables).  With a
+// single trial step, the iterates must be exactly those obtained without
+// setting the number of trials.  With several trial steps, the algorithm must
+// converge, the evaluations of all the trials must be counted by
+// `LBFGSB_NTOT_FG` and a maximum number of evaluations must not be exceeded.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+// Maximum number of recorded iterates.
+#define MAXITER 200
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Result of an optimization.
+typedef struct {
+    lbfgsb_status status;
+    long   niter;        // Number of iterations.
+    long   nfgv;         // Number of evaluations counted by the engine.
+    long   nevals;       // Number of evaluations done by the driver.
+    long   nspec;        // Number of speculative line searches.
+    long   naccept;      // Number of them ended by a trial.
+    double f[MAXITER];   // Function value at each iterate.
+    double x[N];         // Solution.
+} result;
+
+// Solve the sample problem with `ntrials` trial steps (none set if 0) and
+// at most `maxeval` evaluations (no limit if negative).
+static void solve(
+    result* res,
+    long    n,
+    long    m,
+    int     ntrials,
+    long    maxeval)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL ||
+        (ntrials > 0 && lbfgsb_set_trials(ctx, ntrials) != 0)) {
+        fprintf(stderr, "failed to create context\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        res->x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    lbfgsb_set_maxeval(ctx, maxeval);
+    memset(res->f, 0, sizeof(res->f));
+    res->nevals = res->nspec = res->naccept = 0;
+    double f, g[n];
+    lbfgsb_task prev = LBFGSB_START;
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, res->x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(res->x, g, n);
+            ++res->nevals;
+        } else if (task == LBFGSB_FG_TRIALS) {
+            double* ft = lbfgsb_get_trial_f(ctx);
+            for (int j = 0; j < ntrials; ++j) {
+                ft[j] = compute_fg(lbfgsb_get_trial_x(ctx, j),
+                                   lbfgsb_get_trial_g(ctx, j), n);
+            }
+            res->nevals += ntrials;
+            ++res->nspec;
+        } else if (task == LBFGSB_NEW_X) {
+            long k = LBFGSB_NUM_ITER(ctx);
+            if (k < MAXITER) {
+                res->f[k] = f;
+            }
+            res->naccept += (prev == LBFGSB_FG_TRIALS);
+        } else {
+            break;
+        }
+        prev = task;
+    }
+    res->status = lbfgsb_get_status(ctx);
+    res->niter = LBFGSB_NUM_ITER(ctx);
+    res->nfgv = LBFGSB_NTOT_FG(ctx);
+    lbfgsb_destroy(ctx);
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+    static result ref, res;
+
+    // Without trials and with a single trial.
+    solve(&ref, n, m, 0, -1);
+    solve(&res, n, m, 1, -1);
+    int same = (res.niter == ref.niter && res.nfgv == ref.nfgv &&
+                memcmp(res.f, ref.f, sizeof(ref.f)) == 0 &&
+                memcmp(res.x, ref.x, sizeof(ref.x)) == 0);
+    printf(" One trial: %ld iterations, %ld evaluations, same iterates: %s\n",
+           res.niter, res.nfgv, (same ? "yes" : "NO"));
+    failures += !same;
+
+    // With several trials.
+    for (int ntrials = 2; ntrials <= 8; ntrials *= 2) {
+        solve(&res, n, m, ntrials, -1);
+        int ok = ((res.status == LBFGSB_FACTR_TEST ||
+                   res.status == LBFGSB_PGTOL_TEST) &&
+                  res.nevals == res.nfgv && res.nspec > 0 &&
+                  res.f[res.niter < MAXITER ? res.niter : MAXITER-1] < 1e-6);
+        printf(" %d trials: %ld iterations, %ld evaluations, "
+               "%ld/%ld speculative line searches ended by a trial, "
+               "converged with correct counts: %s\n", ntrials, res.niter,
+               res.nfgv, res.naccept, res.nspec, (ok ? "yes" : "NO"));
+        failures += !ok;
+    }
+
+    // With several trials and a maximum number of evaluations.
+    for (long maxeval = 10; maxeval <= 13; ++maxeval) {
+        solve(&res, n, m, 4, maxeval);
+        int ok = (res.status == LBFGSB_TOO_MANY_EVALUATIONS &&
+                  res.nevals == res.nfgv && res.nfgv <= maxeval);
+        printf(" 4 trials, at most %ld evaluations: %ld evaluations, "
+               "limit respected: %s\n", maxeval, res.nfgv,
+               (ok ? "yes" : "NO"));
+        failures += !ok;
+    }
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
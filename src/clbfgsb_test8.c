@@ -0,0 +1,199 @@
+// clbfgsb_test8.c -
+//
+// This example checks the line search with lazy gradient (see
+// lbfgsb_set_lazy_gradient()).  The problem is that of `clbfgsb_test1.c` (the
+// extended Rosenbrock function subject to bounds on the variables).  The
+// algorithm must converge and the trial points rejected on their function
+// value must not be charged the computation of the gradient.  Then the
+// optimization is run by lbfgsb_minimize() with a callback failing at a
+// request of the function alone (task `LBFGSB_F`) or of the gradient alone
+// (task `LBFGSB_G`): the variables, the function value and the gradient must
+// be restored to those of the last iterate.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Create a context for the sample problem in lazy gradient mode and set the
+// initial variables.
+static lbfgsb_context* start(
+    double x[],
+    long   n,
+    long   m)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) {
+        ctx->lower[i] = (i&1) == 0 ? 1.0 : -1.0e2;
+        ctx->upper[i] = 1.0e2;
+        x[i] = 3.0;
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    lbfgsb_set_lazy_gradient(ctx, 1);
+    return ctx;
+}
+
+// Data of the callbacks of lbfgsb_minimize().
+typedef struct {
+    lbfgsb_context* ctx;
+    lbfgsb_task fail;   // Task at which the evaluation fails.
+    long count;         // Number of requests of this task before failing.
+    double f;           // Function value at the last iterate.
+    double x[N];        // Variables at the last iterate.
+    double g[N];        // Gradient at the last iterate.
+} problem;
+
+static int fg(
+    void*        data,
+    long         n,
+    const double x[],
+    double*      f,
+    double       g[])
+{
+    problem* p = data;
+    if (lbfgsb_get_task(p->ctx) == p->fail && --p->count <= 0) {
+        return -1;
+    }
+    // Only the function (`g` is `NULL`) or only the gradient (`f` is
+    // `NULL`) may be requested.
+    if (lbfgsb_get_task(p->ctx) != (f == NULL ? LBFGSB_G :
+                                    g == NULL ? LBFGSB_F : LBFGSB_FG)) {
+        return -1;
+    }
+    double gx[n];
+    double fx = compute_fg(x, gx, n);
+    if (f != NULL) {
+        *f = fx;
+    }
+    if (g != NULL) {
+        memcpy(g, gx, n*sizeof(double));
+    }
+    return 0;
+}
+
+static int newx(
+    void*           data,
+    lbfgsb_context* ctx,
+    const double    x[],
+    double          f,
+    const double    g[])
+{
+    problem* p = data;
+    p->f = f;
+    memcpy(p->x, x, ctx->siz*sizeof(double));
+    memcpy(p->g, g, ctx->siz*sizeof(double));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+
+    // Solve the problem by reverse communication and count the requests.
+    double x[n], f, g[n];
+    lbfgsb_context* ctx = start(x, n, m);
+    long nfg = 0, nf = 0, ng = 0, nrej = 0;
+    lbfgsb_task prev = LBFGSB_START;
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (prev == LBFGSB_F && task != LBFGSB_G) {
+            // The trial point has been rejected on its function value.
+            ++nrej;
+        }
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, n);
+            ++nfg;
+        } else if (task == LBFGSB_F) {
+            double gx[n];
+            f = compute_fg(x, gx, n);
+            ++nf;
+        } else if (task == LBFGSB_G) {
+            compute_fg(x, g, n);
+            ++ng;
+        } else if (task != LBFGSB_NEW_X) {
+            break;
+        }
+        prev = task;
+    }
+    lbfgsb_status status = lbfgsb_get_status(ctx);
+    int ok = ((status == LBFGSB_FACTR_TEST || status == LBFGSB_PGTOL_TEST) &&
+              f < 1e-6 && nfg == 1 && nf > 0 && nrej > 0 &&
+              ng == nf - nrej && LBFGSB_NTOT_FG(ctx) == nfg + nf);
+    printf(" Lazy gradient: %ld iterations, %ld FG, %ld F and %ld G "
+           "requests\n", (long)LBFGSB_NUM_ITER(ctx), nfg, nf, ng);
+    printf(" Converged without gradients at %ld rejected points: %s\n",
+           nrej, (ok ? "yes" : "NO"));
+    failures += !ok;
+    lbfgsb_destroy(ctx);
+
+    // Make the evaluations fail in the line search.
+    const struct {
+        lbfgsb_task task;
+        const char* name;
+        long count;
+    } fails[] = {{LBFGSB_F, "F", 10}, {LBFGSB_G, "G", 5}};
+    for (int j = 0; j < 2; ++j) {
+        problem p;
+        p.ctx = start(x, n, m);
+        p.fail = fails[j].task;
+        p.count = fails[j].count;
+        p.f = NAN;
+        lbfgsb_task task = lbfgsb_minimize(p.ctx, fg, newx, &p, x, &f, g);
+        int same = (task == LBFGSB_STOP && p.count == 0 && f == p.f &&
+                    memcmp(x, p.x, sizeof(x)) == 0 &&
+                    memcmp(g, p.g, sizeof(g)) == 0);
+        printf(" Failure at %s request %ld: last iterate restored: %s\n",
+               fails[j].name, fails[j].count, (same ? "yes" : "NO"));
+        failures += !same;
+        lbfgsb_destroy(p.ctx);
+    }
+
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,159 @@
+// clbfgsb_test9.c -
+//
+// This example checks that an optimization can be started with the L-BFGS
+// memory of the previous one (see lbfgsb_restart_warm()) after changing the
+// bounds.  The problem is that of `clbfgsb_test1.c` (the extended Rosenbrock
+// function subject to bounds on the variables).  After solving it, the bounds
+// are tightened, then loosened, and the problem is solved again each time
+// from the previous solution with a warm start.  The warm starts must
+// converge to the same function value as cold starts with the same bounds.
+//
+// The dimension `N` of this problem and/or the maximum number `M` of steps to
+// memorize can be set by compiling with `-DN=...` and/or `-DM=...`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <lbfgsb.h>
+
+// Number of variables.
+#ifndef N
+# define N 25
+#endif
+
+// Number of steps to memorize.
+#ifndef M
+# define M 5
+#endif
+
+static inline double pow2(double x) { return x*x; }
+
+static double compute_fg(
+    const double x[],
+    double       g[],
+    long         n)
+{
+    // Compute function value f for the sample problem.
+    double f = pow2(x[0] - 1);
+    for (long i = 1; i < n; ++i) {
+        f += 4*pow2(x[i] - pow2(x[i-1]));
+    }
+
+    // Compute gradient g for the sample problem.
+    double t1 = x[1] - pow2(x[0]);
+    g[0] = 2*(x[0] - 1) - 16*x[0]*t1;
+    for (long i = 1; i < n-1; ++i) {
+        double t2 = t1;
+        t1 = x[i+1] - pow2(x[i]);
+        g[i] = 8*t2 - 16*x[i]*t1;
+    }
+    g[n-1] = 8*t1;
+
+    return f;
+}
+
+// Set the bounds of the sample problem: the original ones if `kind` is 0,
+// tighter ones if `kind` is 1 and looser ones otherwise.
+static void set_bounds(
+    lbfgsb_context* ctx,
+    int             kind)
+{
+    for (long i = 0; i < ctx->siz; ++i) {
+        int even = ((i&1) == 0);
+        ctx->lower[i] = (kind == 0 ? (even ? 1.0 : -1.0e2) :
+                         kind == 1 ? (even ? 1.5 : -1.0e2) : -1.0e2);
+        ctx->upper[i] = (kind == 1 && !even ? 2.0 : 1.0e2);
+    }
+}
+
+// Create a context for the sample problem.
+static lbfgsb_context* create(
+    long n,
+    long m)
+{
+    lbfgsb_context* ctx = lbfgsb_create(n, m);
+    if (ctx == NULL) {
+        fprintf(stderr, "failed to allocate context\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->factr = 1.0e+7;
+    ctx->pgtol = 1.0e-5;
+    return ctx;
+}
+
+// Solve the sample problem from the variables `x` and yield the function
+// value at the solution.
+static double solve(
+    lbfgsb_context* ctx,
+    double          x[])
+{
+    double f, g[ctx->siz];
+    while (1) {
+        lbfgsb_task task = lbfgsb_iterate(ctx, x, &f, g);
+        if (task == LBFGSB_FG) {
+            f = compute_fg(x, g, ctx->siz);
+        } else if (task != LBFGSB_NEW_X) {
+            return f;
+        }
+    }
+}
+
+// Yield whether the algorithm has converged.
+static int converged(
+    const lbfgsb_context* ctx)
+{
+    lbfgsb_status status = lbfgsb_get_status(ctx);
+    return (status == LBFGSB_FACTR_TEST || status == LBFGSB_PGTOL_TEST);
+}
+
+int main(int argc, char* argv[])
+{
+    // Problem size and maximum number of memorized steps.
+    long n = N, m = M;
+    int failures = 0;
+
+    // Solve the original problem.
+    double x[n];
+    lbfgsb_context* ctx = create(n, m);
+    set_bounds(ctx, 0);
+    for (long i = 0; i < n; ++i) {
+        x[i] = 3.0;
+    }
+    solve(ctx, x);
+    int ok = converged(ctx);
+    printf(" Original bounds: %ld iterations, converged: %s\n",
+           (long)LBFGSB_NUM_ITER(ctx), (ok ? "yes" : "NO"));
+    failures += !ok;
+
+    // Solve the problem with other bounds, warm and cold.
+    const char* names[] = {"Tighter", "Looser"};
+    for (int kind = 1; kind <= 2; ++kind) {
+        long kept = lbfgsb_restart_warm(ctx);
+        set_bounds(ctx, kind);
+        double fw = solve(ctx, x);
+        int okw = converged(ctx);
+        long iw = LBFGSB_NUM_ITER(ctx);
+
+        double xc[n];
+        lbfgsb_context* cold = create(n, m);
+        set_bounds(cold, kind);
+        for (long i = 0; i < n; ++i) {
+            xc[i] = 3.0;
+        }
+        double fc = solve(cold, xc);
+        int okc = converged(cold);
+        long ic = LBFGSB_NUM_ITER(cold);
+        lbfgsb_destroy(cold);
+
+        ok = (kept > 0 && okw && okc &&
+              fabs(fw - fc) <= 1e-6*fmax(1.0, fabs(fc)));
+        printf(" %s bounds: %ld steps kept, %ld iterations (cold: %ld), "
+               "converged: %s\n", names[kind-1], kept, iw, ic,
+               (ok ? "yes" : "NO"));
+        failures += !ok;
+    }
+
+    lbfgsb_destroy(ctx);
+    return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
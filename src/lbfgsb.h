@@ -2,6 +2,10 @@
 #define LBFGSB_H 1
 
 #include <math.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 /*
  * Since C99, the macro `NAN`, defined in `<math.h>`, expands a to constant
@@ -31,38 +35,22 @@
 extern "C" {
 #endif
 
-// The following definitions must match FORTRAN compiler settings.
+// Integer types used by the L-BFGS-B engine.  These were historically
+// dictated by the FORTRAN compiler settings and are kept for compatibility.
+// The `integer` type stores indices of variables, so the number of variables
+// cannot exceed `LBFGSB_INTEGER_MAX`.  The ILP64 variant of the library
+// (`libclbfgsb3_64`) is compiled with the macro `LBFGSB_ILP64` defined and
+// uses 64-bit integers, its header is "lbfgsb64.h".
 typedef int  logical;
+#ifdef LBFGSB_ILP64
+typedef int64_t integer;
+#  define LBFGSB_INTEGER_MAX INT64_MAX
+#else
 typedef int  integer;
+#  define LBFGSB_INTEGER_MAX INT_MAX
+#endif
 typedef char character;
 
-// Link name of a few FORTRAN subroutines in L-BFGS-B code.
-#define LBFGSB_SETULB_ setulb_
-#define LBFGSB_TIMER_  timer_
-
-extern void LBFGSB_TIMER_(
-    double* t);
-
-extern void LBFGSB_SETULB_(
-    const integer* n,
-    const integer* m,
-    double         x[],
-    const double   l[],
-    const double   u[],
-    const integer  nbd[],
-    double*        f,
-    double         g[],
-    const double*  factr,
-    const double*  pgtol,
-    double         wa[],
-    integer        iwa[],
-    character      task[],
-    integer*       iprint,
-    character      csave[],
-    logical        lsave[],
-    integer        isave[],
-    double         dsave[]);
-
 /**
  * L-BFGS-B task codes
  *
@@ -76,10 +64,322 @@ typedef enum {
     LBFGSB_STOP        =  4,
     LBFGSB_WARNING     =  5,
     LBFGSB_ERROR       =  6,
+    LBFGSB_FG_TRIALS   =  7,
+    LBFGSB_F           =  8,
+    LBFGSB_G           =  9,
 } lbfgsb_task;
 
 #define LBFGSB_TASK_LENGTH 60
 
+/**
+ * Reasons of the termination of the algorithm
+ *
+ * The first ones correspond to the stopping criteria checked by the engine
+ * (see lbfgsb_set_factr(), lbfgsb_set_pgtol(), lbfgsb_set_fatol(),
+ * lbfgsb_set_xatol(), lbfgsb_set_xrtol(), lbfgsb_set_maxiter(),
+ * lbfgsb_set_maxeval() and lbfgsb_set_deadline()), `LBFGSB_STOPPED` is for
+ * an algorithm stopped by the caller and `LBFGSB_FAILURE` for any other
+ * error or warning.
+ *
+ * @see lbfgsb_get_status().
+ */
+typedef enum {
+    LBFGSB_RUNNING              = 0,
+    LBFGSB_PGTOL_TEST           = 1,
+    LBFGSB_FACTR_TEST           = 2,
+    LBFGSB_FATOL_TEST           = 3,
+    LBFGSB_XTOL_TEST            = 4,
+    LBFGSB_TOO_MANY_ITERATIONS  = 5,
+    LBFGSB_TOO_MANY_EVALUATIONS = 6,
+    LBFGSB_DEADLINE_REACHED     = 7,
+    LBFGSB_STOPPED              = 8,
+    LBFGSB_FAILURE              = 9,
+} lbfgsb_status;
+
+/**
+ * Phases of the algorithm whose duration is measured
+ *
+ * `LBFGSB_PHASE_ENGINE` accounts for all the time spent in the engine (that
+ * is, in lbfgsb_iterate() and the like), including the previous phases;
+ * `LBFGSB_PHASE_CALLER` for the time spent by the caller between two calls
+ * to the engine (to compute the objective function and its gradient).
+ *
+ * @see lbfgsb_stats and lbfgsb_get_stats().
+ */
+typedef enum {
+    LBFGSB_PHASE_CAUCHY   = 0, ///> Search for the generalized Cauchy point.
+    LBFGSB_PHASE_SUBSPACE = 1, ///> Subspace minimization or two-loop.
+    LBFGSB_PHASE_LNSRCH   = 2, ///> Line search (without the evaluations).
+    LBFGSB_PHASE_UPDATE   = 3, ///> Update of the L-BFGS memory.
+    LBFGSB_PHASE_ENGINE   = 4, ///> Whole engine.
+    LBFGSB_PHASE_CALLER   = 5, ///> Outside the engine.
+    LBFGSB_NPHASES        = 6
+} lbfgsb_phase;
+
+/**
+ * Performance statistics of an optimization
+ *
+ * The wall-clock times are measured by a monotonic clock, the CPU times are
+ * those of the whole process, so they account for all the threads.  The
+ * number of bytes is an estimate of the memory traffic of the engine based
+ * on the number of passes over the vectors of length `n`.
+ *
+ * @see lbfgsb_get_stats().
+ */
+typedef struct lbfgsb_stats {
+    int64_t wall_ns[LBFGSB_NPHASES]; ///> Wall-clock time per phase (ns).
+    int64_t cpu_ns[LBFGSB_NPHASES];  ///> CPU time per phase (ns).
+    int64_t bytes;    ///> Number of bytes read or written by the engine.
+    long    iters;    ///> Number of iterations.
+    long    evals;    ///> Number of evaluations of the objective function.
+    long    restarts; ///> Number of resets of the L-BFGS memory.
+    long    skips;    ///> Number of skipped L-BFGS updates.
+    long    segments; ///> Number of explored Cauchy segments.
+} lbfgsb_stats;
+
+/**
+ * Record of the iteration trace
+ *
+ * One record is stored for the initial point and for each iterate.  The
+ * times are the cumulated wall-clock times of the phases of the algorithm
+ * since its start (see `lbfgsb_stats`).
+ *
+ * @see lbfgsb_set_trace() and lbfgsb_read_trace().
+ */
+typedef struct lbfgsb_trace_record {
+    long    iter;   ///> Iteration number.
+    long    nfgv;   ///> Total number of evaluations.
+    long    nseg;   ///> Number of Cauchy segments explored by the iteration.
+    long    nact;   ///> Number of active variables at the Cauchy point.
+    double  f;      ///> Objective function at the iterate.
+    double  sbgnrm; ///> Infinite norm of the projected gradient.
+    double  stp;    ///> Step length.
+    double  xstep;  ///> Euclidean norm of the step.
+    int64_t wall_ns[LBFGSB_NPHASES]; ///> Wall-clock time per phase (ns).
+} lbfgsb_trace_record;
+
+/**
+ * Objective function of an optimization job
+ *
+ * The callback stores, unless `f` is `NULL`, in `*f` the objective function
+ * at the `n` variables `x` and, unless `g` is `NULL`, its gradient in `g`.
+ * Only one of `f` and `g` is `NULL` when the line search requests the
+ * function alone or the gradient alone (see lbfgsb_set_lazy_gradient()), so
+ * the callback need not compute what is not requested.  `data` is the
+ * pointer given with the job.  It yields 0 on success; any other value stops
+ * the job.
+ *
+ * @see lbfgsb_minimize() and lbfgsb_pool_submit().
+ */
+typedef int (*lbfgsb_fg_callback)(
+    void*        data,
+    long         n,
+    const double x[],
+    double*      f,
+    double       g[]);
+
+/**
+ * Pool of worker threads solving optimization jobs (opaque)
+ *
+ * @see lbfgsb_pool_create().
+ */
+typedef struct lbfgsb_pool lbfgsb_pool;
+
+/**
+ * Statistics of an optimization job
+ *
+ * The wall-clock time runs from the submission of the job to its completion
+ * (or to now if it is not finished), the running time is the part of it
+ * spent by the workers on the job and the evaluation time the part of the
+ * latter spent in the callback.
+ *
+ * @see lbfgsb_pool_get_job_stats().
+ */
+typedef struct lbfgsb_job_stats {
+    lbfgsb_status status;    ///> Status, `LBFGSB_RUNNING` until completion.
+    double        f;         ///> Objective function at the latest iterate.
+    long          iters;     ///> Number of iterations.
+    long          evals;     ///> Number of calls to the callback.
+    long          steals;    ///> Number of times stolen by another worker.
+    int64_t       wall_ns;   ///> Wall-clock time (ns).
+    int64_t       run_ns;    ///> Running time (ns).
+    int64_t       fg_ns;     ///> Evaluation time (ns).
+    double        iter_rate; ///> Iterations per second of running time.
+} lbfgsb_job_stats;
+
+/**
+ * Aggregate statistics of a pool of workers
+ *
+ * The wall-clock time runs from the first submission to the latest
+ * completion (or to now if some jobs are not finished), the busy time is the
+ * sum over the workers of the time spent on jobs.  The utilization is the
+ * busy time divided by the wall-clock time and the number of workers.
+ *
+ * @see lbfgsb_pool_get_stats().
+ */
+typedef struct lbfgsb_pool_stats {
+    int     workers;     ///> Number of worker threads.
+    long    jobs;        ///> Number of submitted jobs.
+    long    done;        ///> Number of finished jobs.
+    long    iters;       ///> Number of iterations of all the jobs.
+    long    evals;       ///> Number of calls to the callbacks.
+    long    steals;      ///> Number of jobs taken from another worker.
+    int64_t wall_ns;     ///> Wall-clock time (ns).
+    int64_t busy_ns;     ///> Busy time of the workers (ns).
+    double  job_rate;    ///> Finished jobs per second of wall-clock time.
+    double  iter_rate;   ///> Iterations per second of wall-clock time.
+    double  utilization; ///> Fraction of the time the workers are busy.
+} lbfgsb_pool_stats;
+
+/*
+ * Alignment (in bytes) of the block of memory storing a context and its
+ * arrays, see lbfgsb_init_in_buffer().  The arrays are aligned on the same
+ * boundary inside the block.
+ */
+#define LBFGSB_ALIGNMENT 64
+
+/**
+ * Storage layouts of the correction history
+ *
+ * With `LBFGSB_LAYOUT_COLUMNS` (the default), the `m` memorized steps and
+ * gradient changes are stored as the columns of two n-by-m matrices, as in
+ * the FORTRAN code.  With `LBFGSB_LAYOUT_INTERLEAVED`, the `2*m` history
+ * entries of each variable are stored contiguously which yields better
+ * memory locality in the search of the Cauchy point and in the subspace
+ * minimization for large problems.  Both layouts produce the same iterates.
+ *
+ * @see lbfgsb_set_layout().
+ */
+typedef enum {
+    LBFGSB_LAYOUT_COLUMNS     = 0,
+    LBFGSB_LAYOUT_INTERLEAVED = 1,
+} lbfgsb_layout;
+
+/**
+ * Kinds of pages for the memory of a context
+ *
+ * With `LBFGSB_PAGES_TRANSPARENT`, the memory is mapped on a huge page
+ * boundary and the kernel is advised to back it with transparent huge pages.
+ * With `LBFGSB_PAGES_HUGETLB`, the memory is mapped with explicit huge pages
+ * (which must have been reserved by the administrator), falling back to
+ * transparent huge pages if none are available.
+ *
+ * @see lbfgsb_create_mapped().
+ */
+typedef enum {
+    LBFGSB_PAGES_DEFAULT     = 0,
+    LBFGSB_PAGES_TRANSPARENT = 1,
+    LBFGSB_PAGES_HUGETLB     = 2,
+} lbfgsb_pages;
+
+/**
+ * Private workspace and state of the L-BFGS-B engine.
+ *
+ * The members of this structure are managed by the engine and should not be
+ * accessed directly, use the `LBFGSB_...` macros defined at the end of this
+ * file to retrieve information about the current state of the algorithm.
+ */
+typedef struct lbfgsb_workspace {
+    integer*   nbd;    ///> Kind of bounds of each variable.
+    void*      wa;     ///> Floating-point workspace.
+    integer*   iwa;    ///> Integer workspace.
+    character  task[LBFGSB_TASK_LENGTH]; ///> Task message (space padded).
+    int        stage;  ///> Where to resume the algorithm.
+    void*      itfile; ///> Stream for the summary (a `FILE*`) or `NULL`.
+    void*      output; ///> Stream for the messages or `NULL` for `stdout`.
+    void*      summary; ///> Stream for the summary set by the caller.
+    int        alloc;  ///> How the block of the context was allocated.
+    int        primed; ///> Whether the vectors have been first touched.
+    size_t     mapsiz; ///> Size of the mapping of the block (if mapped).
+    void*      hist;   ///> Storage of the correction history (2*m*n).
+    size_t     hsiz;   ///> Size of the mapping of the history file or 0.
+    int        layout; ///> Layout of `ws` and `wy` in use.
+    long       hinc;   ///> Stride between variables in `ws` and `wy`.
+    long       hld;    ///> Stride between memorized pairs in `ws` and `wy`.
+    double*    part;   ///> Partial sums of the threads (2*m per thread).
+    void*      trial;  ///> Steps and values, then points and gradients of
+                       ///  the trials of the speculative line search.
+
+    // Partitions of `wa` and `iwa`.  The elements of the vectors of length
+    // `n` (first part of `wa`) have the same type as the variables (`double`
+    // or `float`), the other arrays are in double precision.
+    void*      ws;     ///> Correction history of steps `S` (n-by-m).
+    void*      wy;     ///> Correction history of gradient changes `Y`.
+    void*      z;      ///> Generalized Cauchy point, then subspace minimum.
+    void*      r;      ///> Reduced gradient, then saved gradient.
+    void*      d;      ///> Search direction.
+    void*      t;      ///> Breakpoints, then variables at start of step.
+    void*      xp;     ///> Safeguard copy of `x` in subspace minimization.
+    double*    sy;     ///> Matrix `S'Y` (m-by-m).
+    double*    ss;     ///> Matrix `S'S` (m-by-m).
+    double*    wt;     ///> Cholesky factor of `theta*S'S + L*D^(-1)*L'`.
+    double*    wn;     ///> Factorization of the 2m-by-2m middle matrix.
+    double*    snd;    ///> Un-factored part of the middle matrix.
+    double*    wa8;    ///> Small scratch vectors (8*m).
+    integer*   index;  ///> Free then active variables at the GCP.
+    integer*   iwhere; ///> Status of each variable with respect to bounds.
+    integer*   indx2;  ///> Entering then leaving variables.
+
+    // State of the main algorithm.
+    logical    prjctd; ///> Initial `x` has been projected.
+    logical    cnstnd; ///> Problem is constrained.
+    logical    boxed;  ///> All variables have both bounds.
+    logical    updatd; ///> The L-BFGS matrix has been updated.
+    logical    uncons; ///> No finite bounds, use the two-loop recursion.
+    logical    warm;   ///> Start with the L-BFGS memory of the previous run.
+    integer    nintol; ///> Total number of Cauchy segments.
+    integer    iback;  ///> Number of backtracks in the line search.
+    integer    nskip;  ///> Total number of skipped BFGS updates.
+    integer    head;   ///> Index of the oldest pair in `ws`/`wy` (0-based).
+    integer    col;    ///> Number of stored pairs.
+    integer    itail;  ///> Index of the newest pair in `ws`/`wy` (0-based).
+    integer    iter;   ///> Iteration number.
+    integer    iupdat; ///> Total number of BFGS updates.
+    integer    nseg;   ///> Number of Cauchy segments in current iteration.
+    integer    nfgv;   ///> Total number of function evaluations.
+    integer    info;   ///> Status of the last factorization or search.
+    integer    ifun;   ///> Number of evaluations in current line search.
+    integer    iword;  ///> How the subspace minimization terminated.
+    integer    nfree;  ///> Number of free variables at the GCP.
+    integer    nact;   ///> Number of active variables at the GCP.
+    integer    ileave; ///> First leaving variable in `indx2` (0-based).
+    integer    nenter; ///> Number of entering variables.
+    double     theta;  ///> Scaling of the L-BFGS matrix.
+    double     fold;   ///> Function value at start of the line search.
+    double     tol;    ///> `factr*epsmch`.
+    double     dnorm;  ///> Euclidean norm of the search direction.
+    double     epsmch; ///> Machine precision.
+    double     time1;  ///> Time at start.
+    double     wtime1; ///> Wall-clock time at start.
+    double     gd;     ///> Directional derivative at current step.
+    double     stpmx;  ///> Maximum step length.
+    double     sbgnrm; ///> Infinite norm of projected gradient.
+    double     stp;    ///> Current step length.
+    double     gdold;  ///> Directional derivative at start of step.
+    double     dtd;    ///> Squared Euclidean norm of the search direction.
+    double     xstep;  ///> Euclidean norm of the current step.
+    integer    nreset; ///> Total number of resets of the L-BFGS memory.
+    void*      trace;  ///> Ring buffer of the iteration trace or `NULL`.
+
+    // Performance statistics (see lbfgsb_get_stats()).
+    int64_t    wall_ns[LBFGSB_NPHASES]; ///> Wall-clock time per phase.
+    int64_t    cpu_ns[LBFGSB_NPHASES];  ///> CPU time per phase.
+    int64_t    bytes;  ///> Estimated memory traffic.
+    int64_t    wall0;  ///> Wall-clock time at start of current phase.
+    int64_t    cpu0;   ///> CPU time at start of current phase.
+    int64_t    wall_exit; ///> Wall-clock time of last return to the caller.
+    int64_t    cpu_exit;  ///> CPU time of last return to the caller.
+
+    // State of the Moré & Thuente line search.
+    struct lbfgsb_lnsrch {
+        int    task;
+        int    brackt;
+        int    stage;
+        double ginit, gtest, gx, gy, finit, fx, fy, stx, sty;
+        double stmin, stmax, width, width1;
+    } lnsrch;
+} lbfgsb_workspace;
+
 typedef struct lbfgsb_context {
     long        siz;   ///> Size of the problem (number of variables).
     long        mem;   ///> Maximum number of memorized steps.
@@ -87,21 +387,63 @@ typedef struct lbfgsb_context {
     double*     upper; ///> Array of upper bounds.
     double      factr; ///> Tolerance factor for convergence in function value.
     double      pgtol; ///> Tolerance for convergence in projected gradient.
+    double      fatol; ///> Threshold for convergence in function value.
+    double      xatol; ///> Absolute tolerance for convergence in variables.
+    double      xrtol; ///> Relative tolerance for convergence in variables.
+    double      deadline; ///> Limit on the elapsed time (in seconds).
+    long        maxiter; ///> Maximum number of iterations (< 0 if none).
+    long        maxeval; ///> Maximum number of evaluations (< 0 if none).
     int         task;  ///> Task to execute.
     int         print; ///> Verbosity setting.
-    // Private workspaces.
-    struct {
-        integer*   nbd;
-        double*    wa;
-        integer*   iwa;
-        character  task[LBFGSB_TASK_LENGTH];
-        character  csave[LBFGSB_TASK_LENGTH];
-        logical    lsave[4];
-        integer    isave[44];
-        double     dsave[29];
-    } wrks;
+    int         layout; ///> Storage layout of the correction history.
+    int         nthreads; ///> Maximum number of threads.
+    int         trials; ///> Number of trial steps per line search.
+    int         lazy;  ///> Only request gradients when needed.
+    lbfgsb_workspace wrks; ///> Private workspaces.
 } lbfgsb_context;
 
+/**
+ * Context for variables in single precision.
+ *
+ * With this kind of context, the variables, the gradient, the bounds, the
+ * correction history and the other vectors of length `siz` are stored in
+ * single precision, which halves the memory footprint and bandwidth of the
+ * algorithm compared to a `lbfgsb_context`.  The small matrices and the
+ * scalars (including the objective function value) are still computed in
+ * double precision, but the tolerance `factr` is relative to the single
+ * precision machine epsilon.
+ *
+ * The settings and the state of the algorithm are stored in `base` (whose
+ * members `lower` and `upper` are not used).  The functions of the API that
+ * do not involve the variables nor the bounds (lbfgsb_get_task(),
+ * lbfgsb_set_factr(), lbfgsb_set_threads(), etc.) and the `LBFGSB_...`
+ * macros can be applied to `&ctx->base`.  The other functions have a
+ * `_f32` counterpart.
+ */
+typedef struct lbfgsb_context_f32 {
+    lbfgsb_context base;  ///> Settings, state and workspaces.
+    float*         lower; ///> Array of lower bounds.
+    float*         upper; ///> Array of upper bounds.
+} lbfgsb_context_f32;
+
+/**
+ * Inspection of the iterates of an optimization
+ *
+ * The callback is called with the context, the variables `x`, the objective
+ * function `f` and its gradient `g` at each new iterate.  `data` is the
+ * pointer given with the callback.  It yields 0 to continue; any other value
+ * stops the algorithm (the callback may also call lbfgsb_set_task() to stop
+ * the algorithm with a message of its own).
+ *
+ * @see lbfgsb_minimize().
+ */
+typedef int (*lbfgsb_newx_callback)(
+    void*           data,
+    lbfgsb_context* ctx,
+    const double    x[],
+    double          f,
+    const double    g[]);
+
 /**
  * @brief Create a new L-BFGS-B context.
  *
@@ -117,13 +459,18 @@ typedef struct lbfgsb_context {
  * The same context can be used to solve several problems with the same numebr
  * of variables and maximum number of memorized steps, see lbfgsb_reset().
  *
- * It is the caller's responsibility to release allocated resources by calling
- * lbfgsb_destroy().
+ * The context and all its arrays are stored in a single block of memory (see
+ * lbfgsb_init_in_buffer()).  It is the caller's responsibility to release
+ * allocated resources by calling lbfgsb_destroy().
  *
  * @param siz     The number of variables of the problem.
  * @param mem     The maximum number of memorized steps.
  *
- * @return The address of the new context or `NULL` in case of failure.
+ * @return The address of the new context or `NULL` in case of failure with
+ *         `errno` set to `EINVAL` if `siz` or `mem` is less than 1, to
+ *         `EOVERFLOW` if `siz` exceeds `LBFGSB_INTEGER_MAX` or if the size of
+ *         the workspaces cannot be represented, or to `ENOMEM` if memory
+ *         cannot be allocated.
  */
 extern lbfgsb_context* lbfgsb_create(
     long siz,
@@ -133,15 +480,190 @@ extern lbfgsb_context* lbfgsb_create(
  * @brief Destroy L-BFGS-B context.
  *
  * Release resources associated with L-BFGS-B context created by
- * lbfgsb_create().
+ * lbfgsb_create() or lbfgsb_init_in_buffer().  In the latter case, the block
+ * of memory provided by the caller is not freed.
  *
  * @param ctx   The L-BFGS-B context.
- *
- * @return The next task for the given context.
  */
 extern void lbfgsb_destroy(
     lbfgsb_context* ctx);
 
+/**
+ * @brief Size of the block of memory needed by a context.
+ *
+ * @param siz     The number of variables of the problem.
+ * @param mem     The maximum number of memorized steps.
+ *
+ * @return The number of bytes (a multiple of `LBFGSB_ALIGNMENT`) needed by
+ *         lbfgsb_init_in_buffer() to store a context and all its arrays, or
+ *         0 in case of error with `errno` set as by lbfgsb_create().
+ */
+extern size_t lbfgsb_workspace_size(
+    long siz,
+    long mem);
+
+/**
+ * @brief Create a L-BFGS-B context in a block of memory.
+ *
+ * This function is like lbfgsb_create() except that the context and all its
+ * arrays are stored in the block `buf` provided by the caller, so this
+ * function allocates no memory.  The block must be aligned on
+ * `LBFGSB_ALIGNMENT` bytes and have at least `lbfgsb_workspace_size(siz,
+ * mem)` bytes.  Its contents need not be initialized.  The block can come
+ * from an arena, a memory pool, a mapping with huge pages, etc.  It must not
+ * be freed nor reused before the context is no longer needed.
+ *
+ * The returned context is at address `buf`.  lbfgsb_destroy() must always be
+ * called when the context is no longer needed, before the block is freed or
+ * reused: it does not release the block, but it releases the memory
+ * allocated out of the block by setters such as lbfgsb_set_threads(),
+ * lbfgsb_set_trials() and lbfgsb_set_trace().
+ *
+ * @param buf     The block of memory.
+ * @param siz     The number of variables of the problem.
+ * @param mem     The maximum number of memorized steps.
+ *
+ * @return The address of the new context or `NULL` in case of failure with
+ *         `errno` set to `EINVAL` if `buf` is not suitably aligned or as by
+ *         lbfgsb_create().
+ */
+extern lbfgsb_context* lbfgsb_init_in_buffer(
+    void* buf,
+    long  siz,
+    long  mem);
+
+/**
+ * @brief Create a L-BFGS-B context in memory backed by huge pages.
+ *
+ * This function is like lbfgsb_create() except that the block of memory
+ * storing the context and its arrays is directly mapped with the kind of
+ * pages given by `pages` (with `LBFGSB_PAGES_DEFAULT`, this is the same as
+ * lbfgsb_create()).  For very large problems, this reduces the number of
+ * TLB misses in the passes over the variables.
+ *
+ * The vectors of the size of the problem are only touched at the start of
+ * the first optimization, by the threads which later sweep each chunk of
+ * them (see lbfgsb_set_threads()).  Under the first-touch policy of the
+ * system, their pages are thus local to the NUMA nodes of these threads if
+ * the threads are bound to processors (for instance with `OMP_PROC_BIND`).
+ * The number of threads must hence be set before the first optimization.
+ *
+ * @param siz     The number of variables of the problem.
+ * @param mem     The maximum number of memorized steps.
+ * @param pages   The kind of pages.
+ *
+ * @return The address of the new context or `NULL` in case of failure with
+ *         `errno` set as by lbfgsb_create().
+ *
+ * @see lbfgsb_get_page_size().
+ */
+extern lbfgsb_context* lbfgsb_create_mapped(
+    long         siz,
+    long         mem,
+    lbfgsb_pages pages);
+
+/**
+ * @brief Create a L-BFGS-B context with an out-of-core correction history.
+ *
+ * This function is like lbfgsb_create() except that the correction history
+ * (the `2*mem` memorized vectors of length `siz`, most of the memory needed
+ * by the algorithm) is stored in the file `path`, mapped in memory, instead
+ * of in the workspace of the context.  The other vectors of the size of the
+ * problem remain in memory.  This allows to memorize more steps than
+ * what would fit in memory.  The file is created or truncated and is not
+ * removed by lbfgsb_destroy() (the caller may remove it just after creating
+ * the context).
+ *
+ * The history is swept sequentially, so the system is advised to read ahead
+ * its pages and, in the passes that sweep its columns one by one, the next
+ * column is prefetched.  The interleaved layout (see lbfgsb_set_layout())
+ * yields a single sequential sweep of the history for most passes and is
+ * recommended for out-of-core problems.
+ *
+ * @param siz     The number of variables of the problem.
+ * @param mem     The maximum number of memorized steps.
+ * @param path    The name of the file to store the correction history.
+ *
+ * @return The address of the new context or `NULL` in case of failure with
+ *         `errno` set as by lbfgsb_create() or by the system calls used to
+ *         create and map the file.
+ */
+extern lbfgsb_context* lbfgsb_create_out_of_core(
+    long        siz,
+    long        mem,
+    const char* path);
+
+/**
+ * @brief Save a checkpoint of a L-BFGS-B context.
+ *
+ * This function writes the complete state of the context `ctx` (settings,
+ * bounds, correction history, workspaces and state of the algorithm and of
+ * the line search) to the file descriptor `fd` at its current position.
+ * The context can be restored by lbfgsb_load() to resume the optimization
+ * where it was stopped, with its L-BFGS memory intact.  For the algorithm to
+ * proceed as if it had not been interrupted, the caller must also save the
+ * variables, the function value and the gradient of the last call to
+ * lbfgsb_iterate().
+ *
+ * The checkpoint consists of a small versioned header followed, at a page
+ * boundary, by a raw copy of the memory of the context.  Saving and loading
+ * are thus essentially limited by the bandwidth of the storage.  A
+ * checkpoint can only be loaded by a library built with the same data model
+ * (integer sizes, byte order, etc.).  The times elapsed since the start of
+ * the optimization and since the last return of lbfgsb_iterate() are saved
+ * as durations, so that the deadline (see lbfgsb_set_deadline()) and the
+ * timers of lbfgsb_get_stats() resume from them after a load, even on
+ * another host or after a reboot.
+ *
+ * @param ctx   The L-BFGS-B context.
+ * @param fd    The file descriptor open for writing.
+ *
+ * @return 0 on success, -1 on failure with `errno` set.
+ */
+extern int lbfgsb_save(
+    const lbfgsb_context* ctx,
+    int                   fd);
+
+/**
+ * @brief Load a checkpoint of a L-BFGS-B context.
+ *
+ * This function reads a checkpoint written by lbfgsb_save() from the file
+ * descriptor `fd` at its current position and returns a new context with
+ * the same state.  If `fd` is a regular file and the checkpoint starts at a
+ * page boundary, the memory of the new context is mapped (copy-on-write)
+ * from the file instead of being read.  The file descriptor may be closed
+ * after the call.
+ *
+ * The correction history of the new context is stored in memory, even though
+ * it may have been stored in a file by the saved context (see
+ * lbfgsb_create_out_of_core()).  The streams set by lbfgsb_set_output() and
+ * lbfgsb_set_summary() are not restored.  The other settings (number of
+ * threads, layout, etc.) are restored.
+ *
+ * @param fd    The file descriptor open for reading.
+ *
+ * @return The address of the new context or `NULL` in case of failure with
+ *         `errno` set.  `errno` is set to `EINVAL` if the contents of the
+ *         file is not a suitable checkpoint.
+ */
+extern lbfgsb_context* lbfgsb_load(
+    int fd);
+
+/**
+ * @brief Get the size of the pages of the workspace of a context.
+ *
+ * Pages are only provided by the system when first touched, so the result is
+ * only meaningful after the start of the first optimization with the
+ * context.
+ *
+ * @param ctx   The L-BFGS-B context.
+ *
+ * @return The size (in bytes) of the largest pages backing the vectors of the
+ *         size of the problem stored by the context.
+ */
+extern long lbfgsb_get_page_size(
+    const lbfgsb_context* ctx);
+
 /**
  * @brief Restart L-BFGS-B algorithm.
  *
@@ -162,6 +684,34 @@ extern void lbfgsb_reset(
     lbfgsb_context* ctx,
     int full);
 
+/**
+ * @brief Restart L-BFGS-B algorithm with the current L-BFGS memory.
+ *
+ * This function is like lbfgsb_reset() with `full = 0` except that the
+ * memorized steps, gradient changes and the factorizations derived from them
+ * are kept for the next optimization with the context instead of being
+ * discarded.  This speeds up the solving of a sequence of closely related
+ * problems (successive frames, continuation in a regularization weight,
+ * etc.) for which the curvature information collected on a problem is
+ * relevant for the next one.
+ *
+ * As with lbfgsb_reset(), the caller may then set new bounds and call
+ * lbfgsb_iterate() with new initial variables.  The new bounds are checked
+ * and the sets of free and active variables are recomputed for them as
+ * usual.  The memory is nevertheless discarded if the storage layout of the
+ * correction history has been changed in the meantime (see
+ * lbfgsb_set_layout()).  The first step of a warm start is a quasi-Newton
+ * step instead of a scaled steepest descent step.
+ *
+ * @param ctx   The L-BFGS-B context.
+ *
+ * @return The number of memorized steps kept for the next optimization (0
+ *         if there are none or if the previous optimization ended with an
+ *         error, in which case this is the same as lbfgsb_reset()).
+ */
+extern long lbfgsb_restart_warm(
+    lbfgsb_context* ctx);
+
 /**
  * @brief Iterate L-BFGS-B algorithm.
  *
@@ -178,6 +728,40 @@ extern lbfgsb_task lbfgsb_iterate(
     double*         f,
     double          g[]);
 
+/**
+ * @brief Run L-BFGS-B algorithm with callbacks.
+ *
+ * This function runs the reverse communication loop of lbfgsb_iterate()
+ * until the algorithm terminates: the evaluations requested by the algorithm
+ * (tasks `LBFGSB_FG`, `LBFGSB_F`, `LBFGSB_G` and `LBFGSB_FG_TRIALS`) are
+ * computed by `fg` and each new iterate is given to `newx` (if not `NULL`).
+ * If `fg` or `newx` fails, the algorithm is stopped (at the previous iterate
+ * if the failure occurs in a line search) and the task is `LBFGSB_STOP`.  The
+ * algorithm is started if the task of the context is `LBFGSB_START` and
+ * resumed otherwise (the evaluation pending in the current task is done
+ * again); nothing is done if it is already terminated.
+ *
+ * @param ctx   The L-BFGS-B context.
+ * @param fg    The callback computing the function and its gradient.
+ * @param newx  The callback inspecting the new iterates or `NULL`.
+ * @param data  The pointer passed to the callbacks.
+ * @param x     The variables of the problem.
+ * @param f     A pointer to the objective function value.
+ * @param g     The gradient of the objective function.
+ *
+ * @return The final task of the context (`LBFGSB_CONVERGENCE`,
+ *         `LBFGSB_STOP`, `LBFGSB_WARNING` or `LBFGSB_ERROR`), see also
+ *         lbfgsb_get_status().
+ */
+extern lbfgsb_task lbfgsb_minimize(
+    lbfgsb_context*      ctx,
+    lbfgsb_fg_callback   fg,
+    lbfgsb_newx_callback newx,
+    void*                data,
+    double               x[],
+    double*              f,
+    double               g[]);
+
 /**
  * @brief Get current task.
  *
@@ -197,6 +781,19 @@ extern lbfgsb_task lbfgsb_iterate(
  * - `LBFGSB_FG`: The caller is requested to compute the value of the objective
  *   function and its gradient at the current variables `x`.
  *
+ * - `LBFGSB_FG_TRIALS`: The caller is requested to compute the values of the
+ *   objective function and the gradients at the trial points of a
+ *   speculative line search (see lbfgsb_set_trials()).  The variables `x`,
+ *   `*f` and `g` are left unchanged.
+ *
+ * - `LBFGSB_F`: The caller is requested to compute the value of the
+ *   objective function (but not its gradient) at the current variables `x`
+ *   (see lbfgsb_set_lazy_gradient()).
+ *
+ * - `LBFGSB_G`: The caller is requested to compute the gradient of the
+ *   objective function at the current variables `x`, for which the function
+ *   value has just been computed on a `LBFGSB_F` request.
+ *
  * - `LBFGSB_NEW_X`: The current variables `x` are available for inspection.
  *   This occurs for the initial variables (after they have been made feasible
  *   and the corresponding objective function and gradient computed) and after
@@ -228,6 +825,20 @@ extern char* lbfgsb_get_task_string(
     char*           buf,
     long            siz);
 
+/**
+ * @brief Get the reason of the termination of the algorithm.
+ *
+ * The reason is deduced from the task message, so it also accounts for
+ * messages set by the caller with lbfgsb_set_task().
+ *
+ * @param ctx   The L-BFGS-B context.
+ *
+ * @return `LBFGSB_RUNNING` if the algorithm has not terminated, one of the
+ *         other `lbfgsb_status` values otherwise.
+ */
+extern lbfgsb_status lbfgsb_get_status(
+    const lbfgsb_context* ctx);
+
 /**
  * @brief Get maximum number of memorized steps.
  *
@@ -294,6 +905,76 @@ extern void lbfgsb_set_pgtol(
     lbfgsb_context* ctx,
     double pgtol);
 
+/**
+ * @brief Get/set the other stopping criteria.
+ *
+ * Besides the tests involving `factr` and `pgtol`, the algorithm terminates
+ * when, after an iteration:
+ *
+ * - the objective function value `f` is less or equal `fatol`, with task
+ *   `LBFGSB_CONVERGENCE` (the default is `fatol = -Inf`);
+ *
+ * - the Euclidean norm of the last step is less or equal `max(xatol,
+ *   xrtol*‖x‖)`, with task `LBFGSB_CONVERGENCE` (this test is disabled if
+ *   `xatol` and `xrtol` are both zero, the default);
+ *
+ * - the number of iterations reaches `maxiter`, with task `LBFGSB_WARNING`;
+ *
+ * - the number of evaluations of the objective function reaches `maxeval`,
+ *   with task `LBFGSB_WARNING`;
+ *
+ * - more than `deadline` seconds of wall-clock time have elapsed since the
+ *   start of the optimization, with task `LBFGSB_WARNING` (the default is
+ *   `deadline = Inf`).
+ *
+ * Negative values of `maxiter` and `maxeval` (the default) mean no limit.
+ * To not exceed `maxeval`, the line search is also interrupted before an
+ * evaluation beyond the limit; the previous iterate is then restored in the
+ * variables, the objective function value and the gradient.  The reason of
+ * the termination is given by lbfgsb_get_status().
+ */
+extern double lbfgsb_get_fatol(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_fatol(
+    lbfgsb_context* ctx,
+    double fatol);
+
+extern double lbfgsb_get_xatol(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_xatol(
+    lbfgsb_context* ctx,
+    double xatol);
+
+extern double lbfgsb_get_xrtol(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_xrtol(
+    lbfgsb_context* ctx,
+    double xrtol);
+
+extern long lbfgsb_get_maxiter(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_maxiter(
+    lbfgsb_context* ctx,
+    long maxiter);
+
+extern long lbfgsb_get_maxeval(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_maxeval(
+    lbfgsb_context* ctx,
+    long maxeval);
+
+extern double lbfgsb_get_deadline(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_deadline(
+    lbfgsb_context* ctx,
+    double deadline);
+
 extern long lbfgsb_get_print(
     const lbfgsb_context* ctx);
 
@@ -301,120 +982,659 @@ extern void lbfgsb_set_print(
     lbfgsb_context* ctx,
     long print);
 
+/**
+ * @brief Get/set the storage layout of the correction history.
+ *
+ * The layout is one of the `lbfgsb_layout` values.  A new layout is taken
+ * into account at the start of the next optimization (that is, when
+ * lbfgsb_iterate() is called with task `LBFGSB_START`).
+ *
+ * @param ctx     The L-BFGS-B context.
+ * @param layout  The layout to use.
+ *
+ * @return lbfgsb_get_layout() yields the layout set in the context;
+ *         lbfgsb_set_layout() yields 0 on success or -1 if `layout` is
+ *         invalid.
+ */
+extern lbfgsb_layout lbfgsb_get_layout(
+    const lbfgsb_context* ctx);
+
+extern int lbfgsb_set_layout(
+    lbfgsb_context* ctx,
+    lbfgsb_layout layout);
+
+/**
+ * @brief Get/set the maximum number of threads.
+ *
+ * When the library is compiled with OpenMP support (see `OPENMP` in the
+ * Makefile), the passes over the variables carried out by the L-BFGS-B
+ * engine are split across up to `nthreads` threads.  Multi-threading is
+ * only used for problems with more than about 65,000 variables, each thread
+ * processing at least 32,768 variables.  The partial results of the threads
+ * are combined in a fixed order, so the iterates do not depend on the
+ * scheduling of the threads but may slightly differ from the sequential ones
+ * due to rounding errors.  The default is one thread.  Without OpenMP
+ * support, the number of threads is recorded but has no effect.  The number
+ * of threads can be changed at any time.
+ *
+ * @param ctx       The L-BFGS-B context.
+ * @param nthreads  The maximum number of threads (between 1 and 256).
+ *
+ * @return lbfgsb_get_threads() yields the maximum number of threads set in
+ *         the context; lbfgsb_set_threads() yields 0 on success or -1 on
+ *         failure with `errno` set to `EINVAL` if `nthreads` is invalid or to
+ *         `ENOMEM` if memory for the partial results cannot be allocated.
+ */
+extern int lbfgsb_get_threads(
+    const lbfgsb_context* ctx);
+
+extern int lbfgsb_set_threads(
+    lbfgsb_context* ctx,
+    int nthreads);
+
+/**
+ * @brief Get/set the number of trial steps of the line search.
+ *
+ * With `ntrials > 1`, each line search starts by requesting the objective
+ * function and its gradient at `ntrials` points along the search direction
+ * at once: lbfgsb_iterate() returns `LBFGSB_FG_TRIALS` and the caller is
+ * expected to compute, possibly in parallel, the function value
+ * `lbfgsb_get_trial_f(ctx)[j]` and the gradient `lbfgsb_get_trial_g(ctx,j)`
+ * at `lbfgsb_get_trial_x(ctx,j)` for `j = 0, ..., ntrials-1` before calling
+ * lbfgsb_iterate() again.  The first trial is the step that the line search
+ * would have tried alone, the others are successively halved.  The trial
+ * that satisfies the strong Wolfe conditions of the line search with the
+ * smallest function value is accepted.  If there is none, or if it is the
+ * first one, the line search proceeds as usual (with requests of type
+ * `LBFGSB_FG`) from the first trial.  This trades extra evaluations (all
+ * counted by `LBFGSB_NTOT_FG`) for fewer round trips when backtracking is
+ * frequent and the objective function is evaluated faster by several
+ * workers than by one.  The default is one trial step, which disables the
+ * speculative line search.
+ *
+ * The trial points and gradients are stored by the context (`2*ntrials`
+ * vectors of the size of the problem) and are not saved by lbfgsb_save(),
+ * so a context should not be saved while its task is `LBFGSB_FG_TRIALS`.
+ * Contexts for variables in single precision must use
+ * lbfgsb_set_trials_f32(), lbfgsb_get_trial_x_f32() and
+ * lbfgsb_get_trial_g_f32(); the function values are always in double
+ * precision.
+ *
+ * @param ctx      The L-BFGS-B context.
+ * @param ntrials  The number of trial steps (between 1 and 16).
+ * @param j        The index of the trial (between 0 and `ntrials-1`).
+ *
+ * @return lbfgsb_get_trials() yields the number of trial steps set in the
+ *         context; lbfgsb_set_trials() yields 0 on success or -1 on failure
+ *         with `errno` set to `EINVAL` if `ntrials` is invalid, to `EBUSY`
+ *         if the task is `LBFGSB_FG_TRIALS` or to `ENOMEM` if memory for the
+ *         trials cannot be allocated; the other
+ *         functions yield the address of the function values, of the
+ *         variables or of the gradient of the trials, or `NULL` if there are
+ *         no trials.
+ */
+extern int lbfgsb_get_trials(
+    const lbfgsb_context* ctx);
+
+extern int lbfgsb_set_trials(
+    lbfgsb_context* ctx,
+    int ntrials);
+
+extern double* lbfgsb_get_trial_f(
+    const lbfgsb_context* ctx);
+
+extern double* lbfgsb_get_trial_x(
+    const lbfgsb_context* ctx,
+    int j);
+
+extern double* lbfgsb_get_trial_g(
+    const lbfgsb_context* ctx,
+    int j);
+
+/**
+ * @brief Get/set whether gradients are only computed when needed.
+ *
+ * When `lazy` is non-zero, the trial points of the line search are first
+ * submitted for the computation of the objective function alone
+ * (lbfgsb_iterate() returns `LBFGSB_F`).  The gradient is then requested
+ * (`LBFGSB_G`) only if the trial point satisfies the sufficient decrease
+ * condition or if it ends the line search.  A trial point rejected on its
+ * function value is thus only charged the cost of the function.  Its
+ * directional derivative, needed by the line search to choose the next step,
+ * is replaced by that of the quadratic interpolating the function at the
+ * best step so far and at the trial step, so the iterates may differ from
+ * those obtained with `lazy = 0` (the default).  The setting can be changed
+ * at any time.
+ *
+ * @param ctx   The L-BFGS-B context.
+ * @param lazy  Whether to request gradients only when needed.
+ *
+ * @return lbfgsb_get_lazy_gradient() yields the setting of the context.
+ */
+extern int lbfgsb_get_lazy_gradient(
+    const lbfgsb_context* ctx);
+
+extern void lbfgsb_set_lazy_gradient(
+    lbfgsb_context* ctx,
+    int lazy);
+
 extern double lbfgsb_timer(
     void);
 
+/**
+ * @brief Get the performance statistics of the current optimization.
+ *
+ * The statistics are reset when the algorithm is started.  The measurement of
+ * the times and of the memory traffic can be suppressed, together with all
+ * the calls to the clocks it requires, by compiling the library with
+ * `-DLBFGSB_NO_STATS` (`make STATS=no`); the members `wall_ns`, `cpu_ns` and
+ * `bytes` are then left to zero.  The counters are always available.  Single
+ * precision contexts and the contexts of a batch are also supported (call
+ * this function with `&ctx->base` or with the result of
+ * lbfgsb_batch_get_context()).
+ *
+ * @param ctx    The L-BFGS-B context.
+ * @param stats  The structure to fill.
+ *
+ * @return 0 on success or -1 with `errno` set to `ENOSYS` if the times and
+ *         the memory traffic are not measured.
+ */
+extern int lbfgsb_get_stats(
+    const lbfgsb_context* ctx,
+    lbfgsb_stats*         stats);
+
+/**
+ * @brief Record the iterations in a ring buffer.
+ *
+ * lbfgsb_set_trace() gives the context a ring buffer of `capacity` records
+ * (see `lbfgsb_trace_record`) where the engine stores, without any formatted
+ * output, one record for the initial point and for each new iterate.  When
+ * the buffer is full, the new records are dropped until some are read (this
+ * shows as a gap in the iteration numbers of the records read).  The summary
+ * of the iterations (see lbfgsb_set_summary()) is not written while the
+ * context has a trace.  A `capacity` of 0 discards the trace.  The trace is
+ * not saved by lbfgsb_save().
+ *
+ * lbfgsb_read_trace() moves at most `max` of the oldest unread records of
+ * the trace to `rec` and yields their number.  It can be called by another
+ * thread than the one that runs the algorithm, while the latter is running,
+ * but not by several threads at the same time nor concurrently with
+ * lbfgsb_set_trace().  Single precision contexts and the contexts of a batch
+ * are also supported (call these functions with `&ctx->base` or with the
+ * result of lbfgsb_batch_get_context()).
+ *
+ * @param ctx       The L-BFGS-B context.
+ * @param capacity  The number of records of the ring buffer.
+ * @param rec       The array to store the records.
+ * @param max       The maximum number of records to read.
+ *
+ * @return lbfgsb_set_trace() yields 0 on success or -1 on failure with
+ *         `errno` set to `EINVAL` if `capacity` is negative, to `EOVERFLOW`
+ *         if the size of the buffer is too large or to `ENOMEM` if the
+ *         buffer cannot be allocated; lbfgsb_read_trace() yields the number
+ *         of records stored in `rec` (0 if the context has no trace).
+ */
+extern int lbfgsb_set_trace(
+    lbfgsb_context* ctx,
+    long            capacity);
+
+extern long lbfgsb_read_trace(
+    lbfgsb_context*      ctx,
+    lbfgsb_trace_record  rec[],
+    long                 max);
+
+/**
+ * @brief Set the streams where a context prints its messages.
+ *
+ * The contexts share no mutable state: distinct contexts can be used
+ * concurrently by different threads without any synchronization (a given
+ * context must not be used by several threads at the same time, except for
+ * lbfgsb_read_trace()).  The engine opens no file: a context only writes to
+ * the streams given by the caller and, if asked to print messages without a
+ * stream of its own, to the standard output.
+ *
+ * lbfgsb_set_output() makes the context print the messages selected by the
+ * verbosity level on `out` (the standard output if `out` is `NULL`, the
+ * default).  lbfgsb_set_summary() makes the context write a summary of the
+ * iterations in `file` when the verbosity is positive (no summary is written
+ * if `file` is `NULL`, the default).  Changing the stream of the summary
+ * during an optimization redirects the rest of its summary, a stream set
+ * while no summary is being written is used from the next optimization.
+ * These streams are not closed by the context and must remain open while the
+ * context may use them.  Single precision contexts and the contexts of a
+ * batch are also supported (call these functions with `&ctx->base` or with
+ * the result of lbfgsb_batch_get_context()).
+ *
+ * @param ctx    The L-BFGS-B context.
+ * @param out    The stream for the messages or `NULL`.
+ * @param file   The stream for the summary or `NULL`.
+ */
+extern void lbfgsb_set_output(
+    lbfgsb_context* ctx,
+    FILE*           out);
+
+extern void lbfgsb_set_summary(
+    lbfgsb_context* ctx,
+    FILE*           file);
+
 extern const double* lbfgsb_get_latest_x(
     const lbfgsb_context* ctx);
 
+/**
+ * @brief Functions for variables in single precision.
+ *
+ * These functions are the counterparts of lbfgsb_create(), lbfgsb_destroy(),
+ * lbfgsb_create_mapped(), lbfgsb_create_out_of_core(), lbfgsb_save(),
+ * lbfgsb_load(), lbfgsb_workspace_size(), lbfgsb_init_in_buffer(),
+ * lbfgsb_reset(), lbfgsb_iterate(), lbfgsb_get_lower(), lbfgsb_get_upper()
+ * and lbfgsb_get_latest_x() for variables in single precision (see
+ * `lbfgsb_context_f32`).  A checkpoint of a context for variables in single
+ * precision can only be loaded by lbfgsb_load_f32() and conversely.
+ */
+extern lbfgsb_context_f32* lbfgsb_create_f32(
+    long siz,
+    long mem);
+
+extern lbfgsb_context_f32* lbfgsb_create_mapped_f32(
+    long         siz,
+    long         mem,
+    lbfgsb_pages pages);
+
+extern lbfgsb_context_f32* lbfgsb_create_out_of_core_f32(
+    long        siz,
+    long        mem,
+    const char* path);
+
+extern int lbfgsb_save_f32(
+    const lbfgsb_context_f32* ctx,
+    int                       fd);
+
+extern lbfgsb_context_f32* lbfgsb_load_f32(
+    int fd);
+
+extern size_t lbfgsb_workspace_size_f32(
+    long siz,
+    long mem);
+
+extern lbfgsb_context_f32* lbfgsb_init_in_buffer_f32(
+    void* buf,
+    long  siz,
+    long  mem);
+
+extern void lbfgsb_destroy_f32(
+    lbfgsb_context_f32* ctx);
+
+extern void lbfgsb_reset_f32(
+    lbfgsb_context_f32* ctx,
+    int full);
+
+extern lbfgsb_task lbfgsb_iterate_f32(
+    lbfgsb_context_f32* ctx,
+    float               x[],
+    float*              f,
+    float               g[]);
+
+extern float* lbfgsb_get_lower_f32(
+    const lbfgsb_context_f32* ctx);
+
+extern float* lbfgsb_get_upper_f32(
+    const lbfgsb_context_f32* ctx);
+
+extern const float* lbfgsb_get_latest_x_f32(
+    const lbfgsb_context_f32* ctx);
+
+extern int lbfgsb_set_trials_f32(
+    lbfgsb_context_f32* ctx,
+    int ntrials);
+
+extern float* lbfgsb_get_trial_x_f32(
+    const lbfgsb_context_f32* ctx,
+    int j);
+
+extern float* lbfgsb_get_trial_g_f32(
+    const lbfgsb_context_f32* ctx,
+    int j);
+
+/**
+ * Batch of independent problems of the same size.
+ *
+ * A batch is a convenience to drive `count` problems with `siz` variables
+ * each by a single loop: each call to lbfgsb_batch_iterate() moves every
+ * unfinished problem to its next evaluation of the objective function and
+ * gradient, so that the caller can compute those of all the problems in a
+ * single pass.  The variables, the gradients and the bounds of the problems
+ * are stored in arrays of `siz*count` values with the layout of a structure
+ * of arrays: the `i`-th variable of the `k`-th problem is at index
+ * `i*count + k`, so that the same variable of consecutive problems are
+ * contiguous.
+ *
+ * A batch is a convenience loop with no speedup: the problems are not
+ * solved in lockstep and the engine is not vectorized across them.
+ * lbfgsb_batch_iterate() calls lbfgsb_iterate() for each unfinished problem
+ * in turn with an ordinary context (see lbfgsb_batch_get_context()) on
+ * copies of the variables and of the gradient of the problem, which are
+ * gathered from and scattered to the arrays of the batch at each call.  A
+ * batch thus costs the time of separate contexts plus these copies.  What a
+ * batch offers is the layout of the arrays, which lets the caller vectorize
+ * the computation of the objective functions, and, when the library is
+ * compiled with OpenMP support, the distribution of the problems across up
+ * to `nthreads` threads (see lbfgsb_batch_set_threads()).
+ */
+typedef struct lbfgsb_batch {
+    long         count;    ///> Number of problems.
+    long         siz;      ///> Number of variables of each problem.
+    long         mem;      ///> Maximum number of memorized steps.
+    double*      lower;    ///> Lower bounds of the problems.
+    double*      upper;    ///> Upper bounds of the problems.
+    lbfgsb_task* task;     ///> Task of each problem.
+    int          nthreads; ///> Maximum number of threads.
+    size_t       stride;   ///> Size of the block of each context.
+    void*        ctxs;     ///> Blocks of the contexts of the problems.
+    double*      work;     ///> Variables and gradient of each thread.
+} lbfgsb_batch;
+
+/**
+ * @brief Create a batch of problems.
+ *
+ * The bounds of all the problems are initialized to `-Inf` and `+Inf` and
+ * their tasks to `LBFGSB_START`.  The settings of each problem (`factr`,
+ * `pgtol`, etc.) are those of a new context and can be changed with the
+ * context returned by lbfgsb_batch_get_context().  It is the caller's
+ * responsibility to release allocated resources by calling
+ * lbfgsb_batch_destroy().
+ *
+ * @param count   The number of problems.
+ * @param siz     The number of variables of each problem.
+ * @param mem     The maximum number of memorized steps.
+ *
+ * @return The address of the new batch or `NULL` in case of failure with
+ *         `errno` set as by lbfgsb_create() or to `EINVAL` if `count` is
+ *         less than 1.
+ */
+extern lbfgsb_batch* lbfgsb_batch_create(
+    long count,
+    long siz,
+    long mem);
+
+extern void lbfgsb_batch_destroy(
+    lbfgsb_batch* batch);
+
+/**
+ * @brief Restart all the problems of a batch.
+ *
+ * @param batch   The batch of problems.
+ * @param full    Also reset the bounds to `-Inf` and `+Inf` if non-zero.
+ */
+extern void lbfgsb_batch_reset(
+    lbfgsb_batch* batch,
+    int           full);
+
+/**
+ * @brief Iterate the problems of a batch.
+ *
+ * This function calls lbfgsb_iterate() for each problem whose task is
+ * `LBFGSB_START`, `LBFGSB_FG` or `LBFGSB_NEW_X` until the task is no longer
+ * `LBFGSB_NEW_X` and stores the next task of each problem in `batch->task`.
+ * The caller shall then compute the objective function and its gradient for
+ * all the problems whose task is `LBFGSB_FG`, the other ones are finished.
+ * The bounds of a problem are taken from `batch->lower` and `batch->upper`
+ * when it starts.  A problem can be stopped by setting the task of its
+ * context with lbfgsb_set_task() (its number of iterations is given by
+ * `LBFGSB_NUM_ITER`).  The trial steps and the lazy gradient (see
+ * lbfgsb_set_trials() and lbfgsb_set_lazy_gradient()) are not supported:
+ * a problem whose context uses them is finished with the task
+ * `LBFGSB_ERROR`.
+ *
+ * @param batch   The batch of problems.
+ * @param x       The variables of the problems (`siz*count` values).
+ * @param f       The objective function values (`count` values).
+ * @param g       The gradients of the problems (`siz*count` values).
+ *
+ * @return The number of problems whose task is `LBFGSB_FG`, hence 0 when all
+ *         the problems are finished.
+ */
+extern long lbfgsb_batch_iterate(
+    lbfgsb_batch* batch,
+    double        x[],
+    double        f[],
+    double        g[]);
+
+/**
+ * @brief Get the context of a problem in a batch.
+ *
+ * @param batch   The batch of problems.
+ * @param k       The index of the problem (between 0 and `count-1`).
+ *
+ * @return The context solving the `k`-th problem or `NULL` if `k` is out of
+ *         range.  The bounds stored by the context are overwritten when the
+ *         problem starts.
+ */
+extern lbfgsb_context* lbfgsb_batch_get_context(
+    const lbfgsb_batch* batch,
+    long                k);
+
+/**
+ * @brief Get/set the maximum number of threads of a batch.
+ *
+ * The problems of a batch are distributed across up to `nthreads` threads
+ * when the library is compiled with OpenMP support, the iterates do not
+ * depend on the number of threads.  The default is one thread.
+ *
+ * @param batch     The batch of problems.
+ * @param nthreads  The maximum number of threads (between 1 and 256).
+ *
+ * @return lbfgsb_batch_get_threads() yields the maximum number of threads;
+ *         lbfgsb_batch_set_threads() yields 0 on success or -1 on failure
+ *         with `errno` set as by lbfgsb_set_threads().
+ */
+extern int lbfgsb_batch_get_threads(
+    const lbfgsb_batch* batch);
+
+extern int lbfgsb_batch_set_threads(
+    lbfgsb_batch* batch,
+    int           nthreads);
+
+/**
+ * @brief Create a pool of worker threads solving optimization jobs.
+ *
+ * A pool runs independent optimizations, the *jobs*, each with its own
+ * context, start point and objective function, on a fixed set of worker
+ * threads.  The step unit of a job is an iteration: a worker calls
+ * lbfgsb_iterate() and the callback of the job until the task is
+ * `LBFGSB_NEW_X` or the job is finished, then takes the next job.  Each
+ * worker has its own queue of jobs, it resumes the latest job of its queue
+ * (so a job tends to remain on the same worker) and, when its queue is
+ * empty, steals the oldest job of the queue of another worker, so that no
+ * worker is idle while some job waits.  The iterates of a job do not depend
+ * on the workers that run it.  It is the caller's responsibility to release
+ * the pool by calling lbfgsb_pool_destroy(), which waits for the jobs to
+ * finish.
+ *
+ * @param nworkers  The number of worker threads (the number of online
+ *                  processors if less than 1).
+ *
+ * @return The address of the new pool or `NULL` in case of failure with
+ *         `errno` set to `EINVAL` if `nworkers` is greater than 256, to
+ *         `ENOMEM` if there is not enough memory or as by pthread_create().
+ */
+extern lbfgsb_pool* lbfgsb_pool_create(
+    int nworkers);
+
+extern void lbfgsb_pool_destroy(
+    lbfgsb_pool* pool);
+
+/**
+ * @brief Submit an optimization job to a pool.
+ *
+ * The job minimizes the function computed by `fg` with the settings and the
+ * bounds of the context `ctx` from the variables `x`.  The context must be
+ * of double precision and its task `LBFGSB_START`.  Until the job is
+ * finished, the context and the arrays `x` and `g` belong to the pool; then
+ * `x` holds the solution, the task of the context tells why the job stopped
+ * (`LBFGSB_STOP` if the callback failed) and the objective function is
+ * given by lbfgsb_pool_get_job_stats().  The job can be stopped with
+ * lbfgsb_set_task() only when it is finished.  The pool keeps the status of
+ * the context when the job finished and never reads the context again, so
+ * the context may then be destroyed or submitted again.
+ *
+ * @param pool   The pool of workers.
+ * @param ctx    The context of the job.
+ * @param x      The variables (`ctx->siz` values).
+ * @param g      The workspace for the gradient (`ctx->siz` values).
+ * @param fg     The callback computing the function and its gradient.
+ * @param data   The pointer passed to the callback.
+ *
+ * @return The identifier of the job (the number of previously submitted
+ *         jobs) or -1 on failure with `errno` set to `EINVAL` if the context
+ *         belongs to an unfinished job of the pool, if its task is not
+ *         `LBFGSB_START` or if `fg` is `NULL` or to `ENOMEM` if there is not
+ *         enough memory.
+ */
+extern long lbfgsb_pool_submit(
+    lbfgsb_pool*       pool,
+    lbfgsb_context*    ctx,
+    double             x[],
+    double             g[],
+    lbfgsb_fg_callback fg,
+    void*              data);
+
+/**
+ * @brief Wait for all the jobs of a pool to finish.
+ *
+ * @param pool   The pool of workers.
+ *
+ * @return The number of jobs which finished with the status
+ *         `LBFGSB_STOPPED` or `LBFGSB_FAILURE`.
+ */
+extern long lbfgsb_pool_wait(
+    lbfgsb_pool* pool);
+
+/**
+ * @brief Get the throughput of the jobs of a pool.
+ *
+ * lbfgsb_pool_get_job_stats() yields the statistics of a job, they are
+ * updated after each of its iterations; lbfgsb_pool_get_stats() yields the
+ * aggregate statistics of the pool.  These functions can be called while the
+ * jobs are running.
+ *
+ * @param pool   The pool of workers.
+ * @param id     The identifier of the job.
+ * @param stats  The structure to fill.
+ *
+ * @return lbfgsb_pool_get_job_stats() yields 0 on success or -1 with `errno`
+ *         set to `EINVAL` if `id` is not the identifier of a job.
+ */
+extern int lbfgsb_pool_get_job_stats(
+    lbfgsb_pool*      pool,
+    long              id,
+    lbfgsb_job_stats* stats);
+
+extern void lbfgsb_pool_get_stats(
+    lbfgsb_pool*       pool,
+    lbfgsb_pool_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
 
-#define LBFGSB_DSAVE_(ctx, i) ((ctx)->wrks.dsave[i])
-#define LBFGSB_ISAVE_(ctx, i) ((ctx)->wrks.isave[i])
-#define LBFGSB_LSAVE_(ctx, i) ((ctx)->wrks.lsave[i])
+#define LBFGSB_WRKS_(ctx, memb) ((ctx)->wrks.memb)
+#define LBFGSB_PHASE_TIME_(ctx, p) (1e-9*(double)LBFGSB_WRKS_(ctx,cpu_ns)[p])
 
 // On exit with `task == LBFGSB_NEW_X`, the following information is available:
 
-// - `dsave[0]` = current `theta` in the BFGS matrix;
-#define LBFGSB_THETA(ctx) LBFGSB_DSAVE_(ctx,0)
+// - current `theta` in the BFGS matrix;
+#define LBFGSB_THETA(ctx) LBFGSB_WRKS_(ctx,theta)
 
-// - `dsave[1] = f(x)` in the previous iteration;
-#define LBFGSB_PREV_F(ctx) LBFGSB_DSAVE_(ctx,1)
+// - `f(x)` in the previous iteration;
+#define LBFGSB_PREV_F(ctx) LBFGSB_WRKS_(ctx,fold)
 
-// - `dsave[2] = factr*epsmch`;
-#define LBFGSB_F_TEST(ctx) LBFGSB_DSAVE_(ctx,2)
+// - `factr*epsmch`;
+#define LBFGSB_F_TEST(ctx) LBFGSB_WRKS_(ctx,tol)
 
-// - `dsave[3]` = 2-norm of the line search direction vector;
-#define LBFGSB_D_NORM2(ctx) LBFGSB_DSAVE_(ctx,3)
+// - 2-norm of the line search direction vector;
+#define LBFGSB_D_NORM2(ctx) LBFGSB_WRKS_(ctx,dnorm)
 
-// - `dsave[4]` = the machine precision epsmch generated by the code;
-#define LBFGSB_EPSMCH(ctx) LBFGSB_DSAVE_(ctx,4)
+// - the machine precision epsmch generated by the code;
+#define LBFGSB_EPSMCH(ctx) LBFGSB_WRKS_(ctx,epsmch)
 
-// - `dsave[6]` = the accumulated time spent on searching for Cauchy points;
-#define LBFGSB_CAUCHY_TIME(ctx) LBFGSB_DSAVE_(ctx,6)
+// - the accumulated CPU time (in seconds) spent on searching for Cauchy
+//   points;
+#define LBFGSB_CAUCHY_TIME(ctx) LBFGSB_PHASE_TIME_(ctx,LBFGSB_PHASE_CAUCHY)
 
-// - `dsave[7]` = the accumulated time spent on subspace minimization;
-#define LBFGSB_SUBSPACE_TIME(ctx) LBFGSB_DSAVE_(ctx,7)
+// - the accumulated CPU time spent on subspace minimization;
+#define LBFGSB_SUBSPACE_TIME(ctx) LBFGSB_PHASE_TIME_(ctx,LBFGSB_PHASE_SUBSPACE)
 
-// - `dsave[8]` = the accumulated time spent on line search;
-#define LBFGSB_LNSRCH_TIME(ctx) LBFGSB_DSAVE_(ctx,8)
+// - the accumulated CPU time spent on line search;
+#define LBFGSB_LNSRCH_TIME(ctx) LBFGSB_PHASE_TIME_(ctx,LBFGSB_PHASE_LNSRCH)
 
-// - `dsave[10]` = the slope of the line search function at the current
-//   point of line search;
-#define LBFGSB_DF(ctx) LBFGSB_DSAVE_(ctx,10)
+// - the slope of the line search function at the current point of line
+//   search;
+#define LBFGSB_DF(ctx) LBFGSB_WRKS_(ctx,gd)
 
-// - `dsave[11]` = the maximum relative step length imposed in line search;
-#define LBFGSB_MAX_STEP(ctx) LBFGSB_DSAVE_(ctx,11)
+// - the maximum relative step length imposed in line search;
+#define LBFGSB_MAX_STEP(ctx) LBFGSB_WRKS_(ctx,stpmx)
 
-// - `dsave[12]` = the infinity norm of the projected gradient;
-#define LBFGSB_PG_NORMINF(ctx) LBFGSB_DSAVE_(ctx,12)
+// - the infinity norm of the projected gradient;
+#define LBFGSB_PG_NORMINF(ctx) LBFGSB_WRKS_(ctx,sbgnrm)
 
-// - `dsave[13]` = the relative step length in the line search;
-#define LBFGSB_STEP(ctx) LBFGSB_DSAVE_(ctx,13)
+// - the relative step length in the line search;
+#define LBFGSB_STEP(ctx) LBFGSB_WRKS_(ctx,stp)
 
-// - `dsave[14]` = the slope of the line search function at the starting
-//   point of the line search;
-#define LBFGSB_DF0(ctx) LBFGSB_DSAVE_(ctx,14)
+// - the slope of the line search function at the starting point of the line
+//   search;
+#define LBFGSB_DF0(ctx) LBFGSB_WRKS_(ctx,gdold)
 
-// - `dsave[15]` = the square of the 2-norm of the line search direction
-//   vector.
-#define LBFGSB_D_NORM2_SQUARED(ctx) LBFGSB_DSAVE_(ctx,15)
+// - the square of the 2-norm of the line search direction vector.
+#define LBFGSB_D_NORM2_SQUARED(ctx) LBFGSB_WRKS_(ctx,dtd)
 
-// - If `lsave[0] == true` then the initial X has been replaced by its
-//   projection in the feasible set;
-#define LBFGSB_INITIAL_X_UNFEASIBLE(ctx) (LBFGSB_LSAVE_(ctx,0) != 0)
+// - true if the initial X has been replaced by its projection in the feasible
+//   set;
+#define LBFGSB_INITIAL_X_UNFEASIBLE(ctx) (LBFGSB_WRKS_(ctx,prjctd) != 0)
 
-// - If `lsave[1] == true` then the problem is constrained;
-#define LBFGSB_CONSTRAINED(ctx) (LBFGSB_LSAVE_(ctx,1) != 0)
+// - true if the problem is constrained;
+#define LBFGSB_CONSTRAINED(ctx) (LBFGSB_WRKS_(ctx,cnstnd) != 0)
 
-// - If `lsave[2] == true` then each variable has upper and lower bounds;
-#define LBFGSB_FULLY_CONSTRAINED(ctx) (DLBFGSB_LSAVE_(ctx,2) != 0)
+// - true if each variable has upper and lower bounds;
+#define LBFGSB_FULLY_CONSTRAINED(ctx) (LBFGSB_WRKS_(ctx,boxed) != 0)
 
-// - `isave[21]` is the total number of intervals explored in the search of
-//   Cauchy points;
-#define LBFGSB_NTOT_CAUCHY(ctx) LBFGSB_ISAVE_(ctx,21)
+// - the total number of intervals explored in the search of Cauchy points;
+#define LBFGSB_NTOT_CAUCHY(ctx) LBFGSB_WRKS_(ctx,nintol)
 
-// - `isave[25]` is the total number of skipped BFGS updates before the
-//   current iteration;
-#define LBFGSB_NTOT_SKIP(ctx) LBFGSB_ISAVE_(ctx,25)
+// - the total number of skipped BFGS updates before the current iteration;
+#define LBFGSB_NTOT_SKIP(ctx) LBFGSB_WRKS_(ctx,nskip)
 
-// - `isave[29]` is the number of current iteration;
-#define LBFGSB_NUM_ITER(ctx) LBFGSB_ISAVE_(ctx,29)
+// - the number of current iteration;
+#define LBFGSB_NUM_ITER(ctx) LBFGSB_WRKS_(ctx,iter)
 
-// - `isave[30]` is the total number of BFGS updates prior the current
-//   iteration;
-#define LBFGSB_NTOT_UPDT(ctx) LBFGSB_ISAVE_(ctx,30)
+// - the total number of BFGS updates prior the current iteration;
+#define LBFGSB_NTOT_UPDT(ctx) LBFGSB_WRKS_(ctx,iupdat)
 
-// - `isave[32]` is the number of intervals explored in the search of Cauchy
-//   point in the current iteration;
-#define LBFGSB_NUM_CAUCHY(ctx) LBFGSB_ISAVE_(ctx,32)
+// - the number of intervals explored in the search of Cauchy point in the
+//   current iteration;
+#define LBFGSB_NUM_CAUCHY(ctx) LBFGSB_WRKS_(ctx,nseg)
 
-// - `isave[33]` is the total number of function and gradient evaluations;
-#define LBFGSB_NTOT_FG(ctx) LBFGSB_ISAVE_(ctx,33)
+// - the total number of function and gradient evaluations;
+#define LBFGSB_NTOT_FG(ctx) LBFGSB_WRKS_(ctx,nfgv)
 
-// - `isave[35]` is the number of function value or gradient evaluations in
-//   the current iteration;
-#define LBFGSB_NUM_FG(ctx) LBFGSB_ISAVE_(ctx,35)
+// - the number of function value or gradient evaluations in the current
+//   iteration;
+#define LBFGSB_NUM_FG(ctx) LBFGSB_WRKS_(ctx,ifun)
 
-// - if `isave[36] == 0` then the subspace argmin is within the box;
-//   if `isave[36] == 1` then the subspace argmin is beyond the box;
-#define LBFGSB_WITHIN_BOX(ctx) (LBFGSB_ISAVE_(ctx,36) == 0)
+// - whether the subspace argmin is within the box;
+#define LBFGSB_WITHIN_BOX(ctx) (LBFGSB_WRKS_(ctx,iword) == 0)
 
-// - `isave[37]` is the number of free variables in the current iteration;
-#define LBFGSB_NUM_FREE(ctx) LBFGSB_ISAVE_(ctx,37)
+// - the number of free variables in the current iteration;
+#define LBFGSB_NUM_FREE(ctx) LBFGSB_WRKS_(ctx,nfree)
 
-// - `isave[38]` is the number of active constraints in the current
-//   iteration;
-#define LBFGSB_NUM_ACTIVE(ctx) LBFGSB_ISAVE_(ctx,38)
+// - the number of active constraints in the current iteration;
+#define LBFGSB_NUM_ACTIVE(ctx) LBFGSB_WRKS_(ctx,nact)
 
-// - `n + 1 - isave[39]` is the number of variables leaving the set of
-//   active constraints in the current iteration;
-#define LBFGSB_NUM_LEAVING(ctx) ((ctx)->siz + 1 - LBFGSB_ISAVE_(ctx,39))
+// - the number of variables leaving the set of active constraints in the
+//   current iteration;
+#define LBFGSB_NUM_LEAVING(ctx) ((ctx)->siz - LBFGSB_WRKS_(ctx,ileave))
 
-// - `isave[40]` is the number of variables entering the set of active
-//   constraints in the current iteration.
-#define LBFGSB_NUM_ENTERING(ctx) LBFGSB_ISAVE_(ctx,40)
+// - the number of variables entering the set of active constraints in the
+//   current iteration.
+#define LBFGSB_NUM_ENTERING(ctx) LBFGSB_WRKS_(ctx,nenter)
 
 #endif // LBFGS_H
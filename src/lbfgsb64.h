@@ -0,0 +1,23 @@
+// lbfgsb64.h -
+//
+// Header for the ILP64 variant of the L-BFGS-B library (`libclbfgsb3_64`)
+// which uses 64-bit integers for the indices of the variables.  Code linked
+// with this library must include this header instead of "lbfgsb.h".
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#ifndef LBFGSB64_H
+#define LBFGSB64_H 1
+
+#if defined(LBFGSB_H) && !defined(LBFGSB_ILP64)
+#  error "lbfgsb.h has already been included without LBFGSB_ILP64"
+#endif
+
+#ifndef LBFGSB_ILP64
+#  define LBFGSB_ILP64 1
+#endif
+#include "lbfgsb.h"
+
+#endif // LBFGSB64_H
@@ -0,0 +1,335 @@
+// lbfgsb_blas.c -
+//
+// Level-1 BLAS kernels applied by the L-BFGS-B engine to vectors of length
+// `n` (the number of variables).  At large `n`, these operations are memory
+// bound and may benefit from an optimized BLAS library.  If the macro
+// `LBFGSB_USE_BLAS` is defined at compile time, the kernels call the
+// `ddot`, `daxpy`, `dcopy` and `dscal` subroutines of an external BLAS
+// library (OpenBLAS, BLIS, MKL, etc.) which must be linked with the code.
+// Otherwise, the bundled kernels below are used; they perform the operations
+// in the same order as the reference BLAS.
+//
+// Note that optimized BLAS libraries may sum the terms of a dot product in a
+// different order, so the iterates may slightly differ from those obtained
+// with the bundled kernels.
+//
+// The kernels for single precision vectors (`lbfgsb_s...`) accumulate dot
+// products in double precision (`dsdot` for an external BLAS library).
+//
+// The bundled kernels are multi-threaded if the code is compiled with OpenMP
+// (see "lbfgsb_private.h").  The number of threads requested by the caller
+// is ignored by the external kernels whose multi-threading is controlled by
+// the BLAS library (e.g. via `OPENBLAS_NUM_THREADS`).
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <string.h>
+#include "lbfgsb_private.h"
+
+#ifdef LBFGSB_USE_BLAS
+
+// FORTRAN BLAS subroutines.  Integers are passed by address and must have
+// the same size as those of the library (see `integer` in "lbfgsb.h").
+extern double ddot_(const integer* n, const double* x, const integer* incx,
+                    const double* y, const integer* incy);
+extern void daxpy_(const integer* n, const double* a, const double* x,
+                   const integer* incx, double* y, const integer* incy);
+extern void dcopy_(const integer* n, const double* x, const integer* incx,
+                   double* y, const integer* incy);
+extern void dscal_(const integer* n, const double* a, double* x,
+                   const integer* incx);
+extern double dsdot_(const integer* n, const float* x, const integer* incx,
+                     const float* y, const integer* incy);
+extern void saxpy_(const integer* n, const float* a, const float* x,
+                   const integer* incx, float* y, const integer* incy);
+extern void scopy_(const integer* n, const float* x, const integer* incx,
+                   float* y, const integer* incy);
+extern void sscal_(const integer* n, const float* a, float* x,
+                   const integer* incx);
+
+static const integer inc = 1;
+
+const char* lbfgsb_blas_backend(void)
+{
+    return "external";
+}
+
+double lbfgsb_ddot(
+    int nt, long n, const double x[], const double y[])
+{
+    (void)nt;
+    integer len = n;
+    return ddot_(&len, x, &inc, y, &inc);
+}
+
+void lbfgsb_daxpy(
+    int nt, long n, double a, const double x[], double y[])
+{
+    (void)nt;
+    integer len = n;
+    daxpy_(&len, &a, x, &inc, y, &inc);
+}
+
+void lbfgsb_dcopy(
+    int nt, long n, const double x[], double y[])
+{
+    (void)nt;
+    integer len = n;
+    dcopy_(&len, x, &inc, y, &inc);
+}
+
+void lbfgsb_dscal(
+    int nt, long n, double a, double x[])
+{
+    (void)nt;
+    integer len = n;
+    dscal_(&len, &a, x, &inc);
+}
+
+double lbfgsb_sdot(
+    int nt, long n, const float x[], const float y[])
+{
+    (void)nt;
+    integer len = n;
+    return dsdot_(&len, x, &inc, y, &inc);
+}
+
+void lbfgsb_saxpy(
+    int nt, long n, double a, const float x[], float y[])
+{
+    (void)nt;
+    integer len = n;
+    float alpha = a;
+    saxpy_(&len, &alpha, x, &inc, y, &inc);
+}
+
+void lbfgsb_scopy(
+    int nt, long n, const float x[], float y[])
+{
+    (void)nt;
+    integer len = n;
+    scopy_(&len, x, &inc, y, &inc);
+}
+
+void lbfgsb_sscal(
+    int nt, long n, double a, float x[])
+{
+    (void)nt;
+    integer len = n;
+    float alpha = a;
+    sscal_(&len, &alpha, x, &inc);
+}
+
+#else // bundled kernels
+
+const char* lbfgsb_blas_backend(void)
+{
+    return "bundled";
+}
+
+// Sequential kernels.
+static double ddot(
+    long n, const double x[], const double y[])
+{
+    double s = 0.0;
+    for (long i = 0; i < n; ++i) {
+        s += x[i]*y[i];
+    }
+    return s;
+}
+
+static void daxpy(
+    long n, double a, const double x[], double y[])
+{
+    for (long i = 0; i < n; ++i) {
+        y[i] += a*x[i];
+    }
+}
+
+static void dscal(
+    long n, double a, double x[])
+{
+    for (long i = 0; i < n; ++i) {
+        x[i] = a*x[i];
+    }
+}
+
+static double sdot(
+    long n, const float x[], const float y[])
+{
+    double s = 0.0;
+    for (long i = 0; i < n; ++i) {
+        s += (double)x[i]*(double)y[i];
+    }
+    return s;
+}
+
+static void saxpy(
+    long n, float a, const float x[], float y[])
+{
+    for (long i = 0; i < n; ++i) {
+        y[i] += a*x[i];
+    }
+}
+
+static void sscal(
+    long n, float a, float x[])
+{
+    for (long i = 0; i < n; ++i) {
+        x[i] = a*x[i];
+    }
+}
+
+double lbfgsb_ddot(
+    int nt, long n, const double x[], const double y[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        return ddot(n, x, y);
+    }
+    double part[LBFGSB_MAX_THREADS];
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        part[k] = ddot(i1 - i0, &x[i0], &y[i0]);
+    }
+    double s = part[0];
+    for (int k = 1; k < nc; ++k) {
+        s += part[k];
+    }
+    return s;
+}
+
+void lbfgsb_daxpy(
+    int nt, long n, double a, const double x[], double y[])
+{
+    if (n <= 0 || a == 0.0) {
+        return;
+    }
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        daxpy(n, a, x, y);
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        daxpy(i1 - i0, a, &x[i0], &y[i0]);
+    }
+}
+
+void lbfgsb_dcopy(
+    int nt, long n, const double x[], double y[])
+{
+    if (n <= 0) {
+        return;
+    }
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        memcpy(y, x, n*sizeof(double));
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        memcpy(&y[i0], &x[i0], (i1 - i0)*sizeof(double));
+    }
+}
+
+void lbfgsb_dscal(
+    int nt, long n, double a, double x[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        dscal(n, a, x);
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        dscal(i1 - i0, a, &x[i0]);
+    }
+}
+
+double lbfgsb_sdot(
+    int nt, long n, const float x[], const float y[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        return sdot(n, x, y);
+    }
+    double part[LBFGSB_MAX_THREADS];
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        part[k] = sdot(i1 - i0, &x[i0], &y[i0]);
+    }
+    double s = part[0];
+    for (int k = 1; k < nc; ++k) {
+        s += part[k];
+    }
+    return s;
+}
+
+void lbfgsb_saxpy(
+    int nt, long n, double a, const float x[], float y[])
+{
+    if (n <= 0 || a == 0.0) {
+        return;
+    }
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        saxpy(n, a, x, y);
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        saxpy(i1 - i0, a, &x[i0], &y[i0]);
+    }
+}
+
+void lbfgsb_scopy(
+    int nt, long n, const float x[], float y[])
+{
+    if (n <= 0) {
+        return;
+    }
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        memcpy(y, x, n*sizeof(float));
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        memcpy(&y[i0], &x[i0], (i1 - i0)*sizeof(float));
+    }
+}
+
+void lbfgsb_sscal(
+    int nt, long n, double a, float x[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc <= 1) {
+        sscal(n, a, x);
+        return;
+    }
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static))
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        sscal(i1 - i0, a, &x[i0]);
+    }
+}
+
+#endif // LBFGSB_USE_BLAS
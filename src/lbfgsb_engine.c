@@ -0,0 +1,3380 @@
+// lbfgsb_engine.c -
+//
+// Native C implementation of the L-BFGS-B algorithm (version 3.0) by Ciyou
+// Zhu, Richard Byrd, Jorge Nocedal and Jose Luis Morales.  This is a faithful
+// translation of the FORTRAN subroutine `mainlb` and of its helpers in
+// `../lbfgsb-3.0/lbfgsb.f`, operations are carried out in the same order so
+// that the iterates are the same as those of the FORTRAN code.  The
+// algorithm and its variables are documented in the FORTRAN code.  The only
+// departure is for problems without any finite bound: the search direction
+// is then computed by the two-loop recursion of L-BFGS (see `twoloop`), which
+// yields the same iterates up to rounding errors.
+//
+// All indices are 0-based, except for the values printed in messages which
+// are the same as those printed by the FORTRAN code.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "lbfgsb_private.h"
+
+// Floating-point type of the variables, of the bounds, of the gradient and of
+// the other vectors of length `n` (including the correction history).  This
+// file is compiled twice: for `double` and, with the macro `LBFGSB_SINGLE`
+// defined, for `float` (see lbfgsb_iterate_f32).  In both cases, the small
+// matrices, the scalars and the sums are computed in double precision.
+#ifdef LBFGSB_SINGLE
+typedef float real;
+#  define REAL_EPSILON  FLT_EPSILON
+#  define lbfgsb_mainlb lbfgsb_mainlb_f32
+#  define lbfgsb_rdot   lbfgsb_sdot
+#  define lbfgsb_raxpy  lbfgsb_saxpy
+#  define lbfgsb_rcopy  lbfgsb_scopy
+#  define lbfgsb_rscal  lbfgsb_sscal
+#else
+typedef double real;
+#  define REAL_EPSILON  DBL_EPSILON
+#  define lbfgsb_rdot   lbfgsb_ddot
+#  define lbfgsb_raxpy  lbfgsb_daxpy
+#  define lbfgsb_rcopy  lbfgsb_dcopy
+#  define lbfgsb_rscal  lbfgsb_dscal
+#endif
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+// Accessors for the correction history, `hinc` and `hld` are the strides
+// between variables and between memorized pairs.  With the interleaved
+// layout, the `2*m` entries of each variable are contiguous with those of
+// `wy` first (hence `ws = wy + m`) and `hinc = 2*m`.
+#define WS(i,j)  ws[(i)*hinc + (j)*hld]
+#define WY(i,j)  wy[(i)*hinc + (j)*hld]
+#define INTERLEAVED (hinc > 1)
+
+// Accessors for column-major matrices.  SY, SS and the blocks of WN1 are
+// indexed by the positions of the memorized pairs (0 for the oldest) but
+// their rows and columns are stored in the slots of the pairs in the
+// circular buffers of the L-BFGS memory (`head` being the slot of the oldest
+// pair), so that nothing is moved when the oldest pair is discarded.
+#define SLOT(i)  ((i) + head < m ? (i) + head : (i) + head - m)
+#define SLOT2(i) ((i) < m ? SLOT(i) : m + SLOT((i) - m))
+#define SY(i,j)  sy[SLOT(i) + m*SLOT(j)]
+#define SS(i,j)  ss[SLOT(i) + m*SLOT(j)]
+#define WT(i,j)  wt[(i) + m*(j)]
+#define WN(i,j)  wn[(i) + m2*(j)]
+#define WN1(i,j) wn1[SLOT2(i) + m2*SLOT2(j)]
+
+// Next index in the circular buffers of the L-BFGS memory.
+#define NEXT(i, m) ((i) + 1 < (m) ? (i) + 1 : 0)
+
+//-----------------------------------------------------------------------------
+// LEVEL-1 BLAS AND LINPACK
+
+// Sums are computed in the same order as the reference BLAS.  These kernels
+// are used for short vectors (of length `m` or `2*m`), vectors of length `n`
+// are processed by the `lbfgsb_r...` kernels (that is, the `lbfgsb_d...` or
+// `lbfgsb_s...` kernels defined in "lbfgsb_blas.c").
+
+static inline double ddot(
+    long n, const double x[], const double y[])
+{
+    double s = 0.0;
+    for (long i = 0; i < n; ++i) {
+        s += x[i]*y[i];
+    }
+    return s;
+}
+
+static inline void daxpy(
+    long n, double a, const double x[], double y[])
+{
+    if (n > 0 && a != 0.0) {
+        for (long i = 0; i < n; ++i) {
+            y[i] += a*x[i];
+        }
+    }
+}
+
+static inline void dcopy(
+    long n, const double x[], double y[])
+{
+    if (n > 0) {
+        memmove(y, x, n*sizeof(double));
+    }
+}
+
+static inline void dscal(
+    long n, double a, double x[])
+{
+    for (long i = 0; i < n; ++i) {
+        x[i] = a*x[i];
+    }
+}
+
+// Factor a symmetric positive definite matrix (upper triangle).  Returns 0 on
+// success or the order (1-based) of the leading minor which is not positive
+// definite.
+static int dpofa(
+    double a[], long lda, long n)
+{
+#define A(i,j) a[(i) + lda*(j)]
+    for (long j = 0; j < n; ++j) {
+        double s = 0.0;
+        for (long k = 0; k < j; ++k) {
+            double t = A(k,j) - ddot(k, &A(0,k), &A(0,j));
+            t = t/A(k,k);
+            A(k,j) = t;
+            s += t*t;
+        }
+        s = A(j,j) - s;
+        if (s <= 0.0) {
+            return j + 1;
+        }
+        A(j,j) = sqrt(s);
+    }
+    return 0;
+#undef A
+}
+
+// Solve triangular systems `T*x = b` or `T'*x = b`.  The value of `job`
+// follows LINPACK conventions: `00` for `T*x = b` with `T` lower triangular,
+// `01` for `T*x = b` with `T` upper triangular, `10` for `T'*x = b` with `T`
+// lower triangular, `11` for `T'*x = b` with `T` upper triangular.  Returns
+// 0 on success or the index (1-based) of the first zero diagonal element.
+static int dtrsl(
+    const double t[], long ldt, long n, double b[], int job)
+{
+#define T(i,j) t[(i) + ldt*(j)]
+    for (long j = 0; j < n; ++j) {
+        if (T(j,j) == 0.0) {
+            return j + 1;
+        }
+    }
+    switch (job) {
+    case 00:
+        b[0] = b[0]/T(0,0);
+        for (long j = 1; j < n; ++j) {
+            daxpy(n - j, -b[j-1], &T(j,j-1), &b[j]);
+            b[j] = b[j]/T(j,j);
+        }
+        break;
+    case 01:
+        b[n-1] = b[n-1]/T(n-1,n-1);
+        for (long j = n - 2; j >= 0; --j) {
+            daxpy(j + 1, -b[j+1], &T(0,j+1), b);
+            b[j] = b[j]/T(j,j);
+        }
+        break;
+    case 10:
+        b[n-1] = b[n-1]/T(n-1,n-1);
+        for (long j = n - 2; j >= 0; --j) {
+            b[j] = b[j] - ddot(n - 1 - j, &T(j+1,j), &b[j+1]);
+            b[j] = b[j]/T(j,j);
+        }
+        break;
+    case 11:
+        b[0] = b[0]/T(0,0);
+        for (long j = 1; j < n; ++j) {
+            b[j] = b[j] - ddot(j, &T(0,j), b);
+            b[j] = b[j]/T(j,j);
+        }
+        break;
+    }
+    return 0;
+#undef T
+}
+
+//-----------------------------------------------------------------------------
+// FORMATTED OUTPUT
+
+// Format a value as with FORTRAN `1P,Ew.d` (or `1P,Dw.d` if `c` is 'D') edit
+// descriptor.
+static const char* fmt_e(
+    char buf[], int w, int d, double x, char c)
+{
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%.*E", d, x);
+    char* e = strchr(tmp, 'E');
+    if (e != NULL) {
+        if (strlen(e + 2) > 2) {
+            // 3-digit exponent, the letter is omitted.
+            memmove(e, e + 1, strlen(e));
+        } else {
+            *e = c;
+        }
+    }
+    int len = strlen(tmp);
+    if (len > w) {
+        memset(buf, '*', w);
+        buf[w] = '\0';
+    } else {
+        snprintf(buf, w + 1, "%*s", w, tmp);
+    }
+    return buf;
+}
+
+// Format an integer as with FORTRAN `Iw` edit descriptor.
+static const char* fmt_i(
+    char buf[], int w, long k)
+{
+    if (snprintf(buf, w + 1, "%*ld", w, k) > w) {
+        memset(buf, '*', w);
+        buf[w] = '\0';
+    }
+    return buf;
+}
+
+// Format a value as with FORTRAN list-directed output.
+static const char* fmt_list(
+    char buf[], double x)
+{
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%.16E", x);
+    char* e = strchr(tmp, 'E');
+    int p = (e == NULL ? 0 : atoi(e + 1));
+    if (x == 0.0 || (e != NULL && -1 <= p && p < 17)) {
+        snprintf(tmp, sizeof(tmp), "%.*f", (x == 0.0 ? 16 : 16 - p), x);
+        sprintf(buf, "%21s     ", tmp);
+    } else {
+        if (e != NULL) {
+            sprintf(e, "E%c%03d", (p < 0 ? '-' : '+'), abs(p));
+        }
+        sprintf(buf, "%26s", tmp);
+    }
+    return buf;
+}
+
+// Print a vector as with FORTRAN format
+// `(/,a4, 1p, 6(1x,d11.4),/,(4x,1p,6(1x,d11.4)))`.
+static void print_vector(
+    FILE* out, const char* label, const real x[], long n)
+{
+    char buf[32];
+    fprintf(out, "\n%4s", label);
+    for (long i = 0; i < n; ++i) {
+        if (i > 0 && i%6 == 0) {
+            fprintf(out, "\n    ");
+        }
+        fprintf(out, " %s", fmt_e(buf, 11, 4, x[i], 'D'));
+    }
+    fprintf(out, "\n");
+    if (n == 6) {
+        fprintf(out, "\n");
+    }
+}
+
+static const char* subsm_word(
+    int iword)
+{
+    switch (iword) {
+    case 0:  return "con";
+    case 1:  return "bnd";
+    case 5:  return "TNT";
+    default: return "---";
+    }
+}
+
+static void prn1lb(
+    long n, long m, const real l[], const real u[], const real x[],
+    int iprint, FILE* out, FILE* itfile, double epsmch)
+{
+    char buf[32];
+    if (iprint >= 0) {
+        fprintf(out, "RUNNING THE L-BFGS-B CODE\n\n"
+                "           * * *\n\n"
+                "Machine precision =%s\n", fmt_e(buf, 10, 3, epsmch, 'D'));
+        fprintf(out, " N = %12ld     M = %12ld\n", n, m);
+        if (iprint >= 1) {
+            if (itfile != NULL) {
+                fprintf(itfile, "RUNNING THE L-BFGS-B CODE\n\n"
+                        "it    = iteration number\n"
+                        "nf    = number of function evaluations\n"
+                        "nseg  = number of segments explored during the "
+                        "Cauchy search\n"
+                        "nact  = number of active bounds at the generalized "
+                        "Cauchy point\n"
+                        "sub   = manner in which the subspace minimization "
+                        "terminated:\n"
+                        "        con = converged, bnd = a bound was reached\n"
+                        "itls  = number of iterations performed in the line "
+                        "search\n"
+                        "stepl = step length used\n"
+                        "tstep = norm of the displacement (total step)\n"
+                        "projg = norm of the projected gradient\n"
+                        "f     = function value\n\n"
+                        "           * * *\n\n"
+                        "Machine precision =%s\n",
+                        fmt_e(buf, 10, 3, epsmch, 'D'));
+                fprintf(itfile, " N = %12ld     M = %12ld\n", n, m);
+                fprintf(itfile, "\n   it   nf  nseg  nact  sub  itls  stepl"
+                        "    tstep     projg        f\n");
+            }
+            if (iprint > 100) {
+                print_vector(out, "L =", l, n);
+                print_vector(out, "X0 =", x, n);
+                print_vector(out, "U =", u, n);
+            }
+        }
+    }
+}
+
+static void prn2lb(
+    long n, const real x[], double f, const real g[], int iprint,
+    FILE* out, FILE* itfile, long iter, long nfgv, long nact, double sbgnrm,
+    long nseg, int iword, long iback, double stp, double xstep)
+{
+    char buf1[32], buf2[32], buf3[32], buf4[32];
+    const char* word = subsm_word(iword);
+    if (iprint >= 99) {
+        fprintf(out, " LINE SEARCH%12ld  times; norm of step = %s\n",
+                iback, fmt_list(buf1, xstep));
+        fprintf(out, "\nAt iterate%5ld    f= %s    |proj g|= %s\n", iter,
+                fmt_e(buf1, 12, 5, f, 'D'), fmt_e(buf2, 12, 5, sbgnrm, 'D'));
+        if (iprint > 100) {
+            print_vector(out, "X =", x, n);
+            print_vector(out, "G =", g, n);
+        }
+    } else if (iprint > 0) {
+        if (iter%iprint == 0) {
+            fprintf(out, "\nAt iterate%5ld    f= %s    |proj g|= %s\n", iter,
+                    fmt_e(buf1, 12, 5, f, 'D'),
+                    fmt_e(buf2, 12, 5, sbgnrm, 'D'));
+        }
+    }
+    if (iprint >= 1 && itfile != NULL) {
+        fprintf(itfile, " %4ld %4ld %5ld %5ld  %3s %4ld  %s  %s %s %s\n",
+                iter, nfgv, nseg, nact, word, iback,
+                fmt_e(buf1, 7, 1, stp, 'D'), fmt_e(buf2, 7, 1, xstep, 'D'),
+                fmt_e(buf3, 10, 3, sbgnrm, 'D'), fmt_e(buf4, 10, 3, f, 'D'));
+    }
+}
+
+static void print_info(
+    FILE* file, int summary, int info, long k)
+{
+    switch (info) {
+    case -1:
+        fprintf(file, "\n Matrix in 1st Cholesky factorization in formk "
+                "is not Pos. Def.\n");
+        break;
+    case -2:
+        fprintf(file, "\n Matrix in 2st Cholesky factorization in formk "
+                "is not Pos. Def.\n");
+        break;
+    case -3:
+        fprintf(file, "\n Matrix in the Cholesky factorization in formt "
+                "is not Pos. Def.\n");
+        break;
+    case -4:
+        fprintf(file, "\n Derivative >= 0, backtracking line search "
+                "impossible.\n"
+                "   Previous x, f and g restored.\n"
+                " Possible causes: 1 error in function or gradient "
+                "evaluation;\n"
+                "                  2 rounding errors dominate "
+                "computation.\n");
+        break;
+    case -5:
+        fprintf(file, "\n Warning:  more than 10 function and gradient\n"
+                "   evaluations in the last line search.  Termination\n"
+                "   may possibly be caused by a bad search direction.\n");
+        break;
+    case -6:
+        if (!summary) {
+            fprintf(file, "  Input nbd(%12ld ) is invalid.\n", k);
+        }
+        break;
+    case -7:
+        if (!summary) {
+            fprintf(file, "  l(%12ld ) > u(%12ld ).  No feasible "
+                    "solution.\n", k, k);
+        }
+        break;
+    case -8:
+        fprintf(file, "\n The triangular system is singular.\n");
+        break;
+    case -9:
+        fprintf(file, "\n Line search cannot locate an adequate point "
+                "after 20 function\n"
+                "  and gradient evaluations.  Previous x, f and g "
+                "restored.\n"
+                " Possible causes: 1 error in function or gradient "
+                "evaluation;\n"
+                "                  2 rounding error dominate "
+                "computation.\n");
+        break;
+    }
+}
+
+static void prn3lb(
+    long n, const real x[], double f, const character task[], int iprint,
+    FILE* out, int info, FILE* itfile, long iter, long nfgv, long nintol,
+    long nskip, long nact, double sbgnrm, double time, long nseg, int iword,
+    long iback, double stp, double xstep, long k, double cachyt,
+    double sbtime, double lnscht)
+{
+    char buf1[32], buf2[32], buf3[32];
+    int error = (strncmp(task, "ERROR", 5) == 0);
+    if (!error && iprint >= 0) {
+        fprintf(out, "\n           * * *\n\n"
+                "Tit   = total number of iterations\n"
+                "Tnf   = total number of function evaluations\n"
+                "Tnint = total number of segments explored during"
+                " Cauchy searches\n"
+                "Skip  = number of BFGS updates skipped\n"
+                "Nact  = number of active bounds at final generalized"
+                " Cauchy point\n"
+                "Projg = norm of the final projected gradient\n"
+                "F     = final function value\n\n"
+                "           * * *\n");
+        fprintf(out, "\n   N    Tit     Tnf  Tnint  Skip  Nact     Projg"
+                "        F\n");
+        fprintf(out, "%5ld %6ld %6ld %6ld  %4ld %5ld  %s  %s\n",
+                n, iter, nfgv, nintol, nskip, nact,
+                fmt_e(buf1, 10, 3, sbgnrm, 'D'), fmt_e(buf2, 10, 3, f, 'D'));
+        if (iprint >= 100) {
+            print_vector(out, "X =", x, n);
+        }
+        if (iprint >= 1) {
+            fprintf(out, "  F =%s\n", fmt_list(buf1, f));
+        }
+    }
+    if (iprint >= 0) {
+        fprintf(out, "\n%.*s\n", LBFGSB_TASK_LENGTH, task);
+        print_info(out, 0, info, k);
+        if (iprint >= 1) {
+            fprintf(out, "\n Cauchy                time%s seconds.\n"
+                    " Subspace minimization time%s seconds.\n"
+                    " Line search           time%s seconds.\n",
+                    fmt_e(buf1, 10, 3, cachyt, 'E'),
+                    fmt_e(buf2, 10, 3, sbtime, 'E'),
+                    fmt_e(buf3, 10, 3, lnscht, 'E'));
+        }
+        fprintf(out, "\n Total User time%s seconds.\n\n",
+                fmt_e(buf1, 10, 3, time, 'E'));
+        if (iprint >= 1 && itfile != NULL) {
+            if (info == -4 || info == -9) {
+                fprintf(itfile, " %4ld %4ld %5ld %5ld  %3s %4ld  %s  %s"
+                        "      -          -\n",
+                        iter, nfgv, nseg, nact, subsm_word(iword), iback,
+                        fmt_e(buf1, 7, 1, stp, 'D'),
+                        fmt_e(buf2, 7, 1, xstep, 'D'));
+            }
+            fprintf(itfile, "\n%.*s\n", LBFGSB_TASK_LENGTH, task);
+            print_info(itfile, 1, info, k);
+            fprintf(itfile, "\n Total User time%s seconds.\n\n",
+                    fmt_e(buf1, 10, 3, time, 'E'));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// HELPERS OF THE MAIN ALGORITHM
+
+// Store in dst[0..len-1] the sums of the partial results of `nc` chunks of
+// variables, stored in part[len*k..len*(k+1)-1] for the k-th chunk, in the
+// order of the chunks.
+static void sum_parts(
+    int nc, long len, const double part[], double dst[])
+{
+    for (long s = 0; s < len; ++s) {
+        double sum = part[s];
+        for (int k = 1; k < nc; ++k) {
+            sum += part[len*k + s];
+        }
+        dst[s] = sum;
+    }
+}
+
+// Zero the vectors of length n (the correction history and z, r, d, t and
+// xp) by the threads which will later sweep each chunk of variables, so that
+// the pages get local to these threads under the first-touch policy.  This is
+// done at the first start, after that only the correction history is zeroed
+// in the interleaved layout.  A history mapped from a file is initially zero.
+static void touch_vectors(
+    int nc, long n, long m, lbfgsb_workspace* w)
+{
+    const int first = !w->primed;
+    const int interleaved = (w->layout == LBFGSB_LAYOUT_INTERLEAVED);
+    const int zero_hist = (interleaved ? (!first || w->hsiz == 0) :
+                           (first && w->hsiz == 0));
+    if (!first && !zero_hist) {
+        return;
+    }
+    real* h = w->hist;
+    real* v = w->z;
+    LBFGSB_PARALLEL_FOR(nc)
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        if (zero_hist && interleaved) {
+            memset(&h[2*m*i0], 0, 2*m*(i1 - i0)*sizeof(real));
+        } else if (zero_hist) {
+            for (long j = 0; j < 2*m; ++j) {
+                memset(&h[n*j + i0], 0, (i1 - i0)*sizeof(real));
+            }
+        }
+        if (first) {
+            for (long j = 0; j < 5; ++j) {
+                memset(&v[n*j + i0], 0, (i1 - i0)*sizeof(real));
+            }
+        }
+    }
+    w->primed = 1;
+}
+
+// Compute the infinity norm of the projected gradient for the variables
+// i0 to i1-1.  If `nbd` is NULL, there are no bounds.
+static double projgr_range(
+    long i0, long i1, const real l[], const real u[],
+    const integer nbd[], const real x[], const real g[])
+{
+    double sbgnrm = 0.0;
+    if (nbd == NULL) {
+        for (long i = i0; i < i1; ++i) {
+            sbgnrm = max(sbgnrm, fabs(g[i]));
+        }
+        return sbgnrm;
+    }
+    for (long i = i0; i < i1; ++i) {
+        double gi = g[i];
+        if (nbd[i] != 0) {
+            if (gi < 0.0) {
+                if (nbd[i] >= 2) {
+                    gi = max(x[i] - u[i], gi);
+                }
+            } else {
+                if (nbd[i] <= 2) {
+                    gi = min(x[i] - l[i], gi);
+                }
+            }
+        }
+        sbgnrm = max(sbgnrm, fabs(gi));
+    }
+    return sbgnrm;
+}
+
+// Compute the infinity norm of the projected gradient.
+static double projgr(
+    int nt, long n, const real l[], const real u[], const integer nbd[],
+    const real x[], const real g[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    double part[LBFGSB_MAX_THREADS];
+    LBFGSB_PARALLEL_FOR(nc)
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        part[k] = projgr_range(i0, i1, l, u, nbd, x, g);
+    }
+    double sbgnrm = part[0];
+    for (int k = 1; k < nc; ++k) {
+        sbgnrm = max(sbgnrm, part[k]);
+    }
+    return sbgnrm;
+}
+
+// Check the input arguments for errors.  Returns the error message or `NULL`
+// if there are no errors.
+static const char* errclb(
+    long n, long m, double factr, const real l[], const real u[],
+    const integer nbd[], int* info, long* k)
+{
+    const char* task = NULL;
+    if (n <= 0) {
+        task = "ERROR: N .LE. 0";
+    }
+    if (m <= 0) {
+        task = "ERROR: M .LE. 0";
+    }
+    if (factr < 0.0) {
+        task = "ERROR: FACTR .LT. 0";
+    }
+    for (long i = 0; i < n; ++i) {
+        if (nbd[i] < 0 || nbd[i] > 3) {
+            task = "ERROR: INVALID NBD";
+            *info = -6;
+            *k = i + 1;
+        }
+        if (nbd[i] == 2) {
+            if (l[i] > u[i]) {
+                task = "ERROR: NO FEASIBLE SOLUTION";
+                *info = -7;
+                *k = i + 1;
+            }
+        }
+    }
+    return task;
+}
+
+// Initialize `iwhere` and project the initial `x` to the feasible set.
+static void active(
+    long n, const real l[], const real u[], const integer nbd[],
+    real x[], integer iwhere[], int iprint, FILE* out, logical* prjctd,
+    logical* cnstnd, logical* boxed)
+{
+    long nbdd = 0;
+    *prjctd = 0;
+    *cnstnd = 0;
+    *boxed = 1;
+    for (long i = 0; i < n; ++i) {
+        if (nbd[i] > 0) {
+            if (nbd[i] <= 2 && x[i] <= l[i]) {
+                if (x[i] < l[i]) {
+                    *prjctd = 1;
+                    x[i] = l[i];
+                }
+                ++nbdd;
+            } else if (nbd[i] >= 2 && x[i] >= u[i]) {
+                if (x[i] > u[i]) {
+                    *prjctd = 1;
+                    x[i] = u[i];
+                }
+                ++nbdd;
+            }
+        }
+    }
+    for (long i = 0; i < n; ++i) {
+        if (nbd[i] != 2) {
+            *boxed = 0;
+        }
+        if (nbd[i] == 0) {
+            iwhere[i] = -1;
+        } else {
+            *cnstnd = 1;
+            if (nbd[i] == 2 && u[i] - l[i] <= 0.0) {
+                iwhere[i] = 3;
+            } else {
+                iwhere[i] = 0;
+            }
+        }
+    }
+    if (iprint >= 0) {
+        if (*prjctd) {
+            fprintf(out, " The initial X is infeasible.  "
+                    "Restart with its projection.\n");
+        }
+        if (!*cnstnd) {
+            fprintf(out, " This problem is unconstrained.\n");
+        }
+    }
+    if (iprint > 0) {
+        fprintf(out, "\nAt X0 %9ld variables are exactly at the bounds\n",
+                nbdd);
+    }
+}
+
+// Compute the product of the 2m-by-2m middle matrix with a 2col vector `v`.
+// Returns a nonzero value if a triangular system is singular.
+static int bmv(
+    long m, const double sy[], const double wt[], long col, long head,
+    const double v[], double p[])
+{
+    if (col == 0) {
+        return 0;
+    }
+    p[col] = v[col];
+    for (long i = 1; i < col; ++i) {
+        long i2 = col + i;
+        double sum = 0.0;
+        for (long k = 0; k < i; ++k) {
+            sum += SY(i,k)*v[k]/SY(k,k);
+        }
+        p[i2] = v[i2] + sum;
+    }
+    if (dtrsl(wt, m, col, &p[col], 11) != 0) {
+        return 1;
+    }
+    for (long i = 0; i < col; ++i) {
+        p[i] = v[i]/sqrt(SY(i,i));
+    }
+    if (dtrsl(wt, m, col, &p[col], 01) != 0) {
+        return 1;
+    }
+    for (long i = 0; i < col; ++i) {
+        p[i] = -p[i]/sqrt(SY(i,i));
+    }
+    for (long i = 0; i < col; ++i) {
+        double sum = 0.0;
+        for (long k = i + 1; k < col; ++k) {
+            sum += SY(k,i)*p[col+k]/SY(i,i);
+        }
+        p[i] += sum;
+    }
+    return 0;
+}
+
+// The breakpoints of the search for the generalized Cauchy point are
+// processed in increasing order of `t`.  Instead of extracting them one at a
+// time from a heap as in the FORTRAN code, the smallest remaining ones are
+// selected and sorted by batches of growing size, so that the work is spent
+// on the breakpoints that are actually passed and memory is swept
+// sequentially.  Partitions are three-way so that the many equal breakpoints
+// of variables with the same bounds and gradient cost a single pass.  As with
+// the heap, the order of equal breakpoints is unspecified; it does not change
+// the generalized Cauchy point.
+#define BP_MIN_BATCH 64
+#define BP_GROWTH    8
+
+static inline void bp_swap(
+    real t[], integer iorder[], long a, long b)
+{
+    real ta = t[a];
+    integer ia = iorder[a];
+    t[a] = t[b];
+    iorder[a] = iorder[b];
+    t[b] = ta;
+    iorder[b] = ia;
+}
+
+// Partition the breakpoints lo to hi-1 in those less than, equal to and
+// greater than the median of the first, the middle and the last ones.  On
+// return, the equal ones are at positions *lt to *gt-1.
+static void bp_partition(
+    real t[], integer iorder[], long lo, long hi, long* lt, long* gt)
+{
+    real a = t[lo], b = t[lo + (hi - lo)/2], c = t[hi-1];
+    real pv = (a < b ? (b < c ? b : (a < c ? c : a)) :
+               (a < c ? a : (b < c ? c : b)));
+    long i = lo, j = lo, k = hi;
+    while (j < k) {
+        if (t[j] < pv) {
+            bp_swap(t, iorder, i, j);
+            ++i;
+            ++j;
+        } else if (t[j] > pv) {
+            --k;
+            bp_swap(t, iorder, j, k);
+        } else {
+            ++j;
+        }
+    }
+    *lt = i;
+    *gt = k;
+}
+
+// Move the `k` smallest of the breakpoints lo to hi-1 in front of them.
+static void bp_select(
+    real t[], integer iorder[], long lo, long hi, long k)
+{
+    const long kth = lo + k;
+    while (hi - lo > 1) {
+        long lt, gt;
+        bp_partition(t, iorder, lo, hi, &lt, &gt);
+        if (kth < lt) {
+            hi = lt;
+        } else if (kth > gt) {
+            lo = gt;
+        } else {
+            break;
+        }
+    }
+}
+
+// Sort the breakpoints lo to hi-1 in increasing order.
+static void bp_sort(
+    real t[], integer iorder[], long lo, long hi)
+{
+    while (hi - lo > 16) {
+        long lt, gt;
+        bp_partition(t, iorder, lo, hi, &lt, &gt);
+        if (lt - lo < hi - gt) {
+            bp_sort(t, iorder, lo, lt);
+            lo = gt;
+        } else {
+            bp_sort(t, iorder, gt, hi);
+            hi = lt;
+        }
+    }
+    for (long i = lo + 1; i < hi; ++i) {
+        real ti = t[i];
+        integer ii = iorder[i];
+        long j = i;
+        while (j > lo && ti < t[j-1]) {
+            t[j] = t[j-1];
+            iorder[j] = iorder[j-1];
+            --j;
+        }
+        t[j] = ti;
+        iorder[j] = ii;
+    }
+}
+
+// Multi-threaded version of the first loop of cauchy (see the comments
+// there) for `nc > 1` chunks of variables.  A first pass over each chunk
+// resets iwhere, sets d, computes the partial sums of f1 and of p = W'd (in
+// the storage order of the pairs) and counts the breakpoints and the other
+// free variables.  A second pass stores these in iorder and t at the same
+// positions as the sequential code.  On return, p is in wbp[0..2m-1] in the
+// storage order of the pairs.
+static void cauchy_scan(
+    int nc, long n, const real x[], const real l[], const real u[],
+    const integer nbd[], const real g[], integer iorder[],
+    integer iwhere[], real t[], real d[], long m, const real wy[],
+    const real ws[], long hinc, long hld, long col, long head,
+    double wbp[], double part[], double* f1, long* nbreak, long* nfree,
+    long* ibkmin, double* bkmin, int* bnded)
+{
+    long cntb[LBFGSB_MAX_THREADS], cntf[LBFGSB_MAX_THREADS];
+    long ibkm[LBFGSB_MAX_THREADS];
+    double f1p[LBFGSB_MAX_THREADS], bkm[LBFGSB_MAX_THREADS];
+    int bnd[LBFGSB_MAX_THREADS];
+
+    LBFGSB_PARALLEL_FOR(nc)
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        double* pk = &part[2*m*k];
+        for (long s = 0; s < 2*m; ++s) {
+            pk[s] = 0.0;
+        }
+        double f1k = 0.0;
+        long nb = 0, nf = 0;
+        for (long i = i0; i < i1; ++i) {
+            double neggi = -g[i];
+            if (iwhere[i] != 3 && iwhere[i] != -1) {
+                double tl = (nbd[i] <= 2 ? x[i] - l[i] : 0.0);
+                double tu = (nbd[i] >= 2 ? u[i] - x[i] : 0.0);
+                int xlower = (nbd[i] <= 2 && tl <= 0.0);
+                int xupper = (nbd[i] >= 2 && tu <= 0.0);
+                iwhere[i] = 0;
+                if (xlower) {
+                    if (neggi <= 0.0) {
+                        iwhere[i] = 1;
+                    }
+                } else if (xupper) {
+                    if (neggi >= 0.0) {
+                        iwhere[i] = 2;
+                    }
+                } else {
+                    if (fabs(neggi) <= 0.0) {
+                        iwhere[i] = -3;
+                    }
+                }
+            }
+            if (iwhere[i] != 0 && iwhere[i] != -1) {
+                d[i] = 0.0;
+                continue;
+            }
+            d[i] = neggi;
+            f1k -= neggi*neggi;
+            if (INTERLEAVED) {
+                const real* row = &WY(i,0);
+                for (long s = 0; s < 2*m; ++s) {
+                    pk[s] += row[s]*neggi;
+                }
+            } else {
+                long pointr = head;
+                for (long j = 0; j < col; ++j) {
+                    pk[pointr] += WY(i,pointr)*neggi;
+                    pk[m+pointr] += WS(i,pointr)*neggi;
+                    pointr = NEXT(pointr, m);
+                }
+            }
+            if ((nbd[i] <= 2 && nbd[i] != 0 && neggi < 0.0) ||
+                (nbd[i] >= 2 && neggi > 0.0)) {
+                ++nb;
+            } else {
+                ++nf;
+            }
+        }
+        f1p[k] = f1k;
+        cntb[k] = nb;
+        cntf[k] = nf;
+    }
+
+    // Offsets of the breakpoints and of the other free variables of each
+    // chunk in iorder (stored in cntb and cntf).
+    long ib = 0, jf = n;
+    for (int k = 0; k < nc; ++k) {
+        long nb = cntb[k], nf = cntf[k];
+        cntb[k] = ib;
+        cntf[k] = jf;
+        ib += nb;
+        jf -= nf;
+    }
+    *nbreak = ib;
+    *nfree = jf;
+
+    LBFGSB_PARALLEL_FOR(nc)
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        long ib = cntb[k], jf = cntf[k], ibk = -1;
+        double bk = 0.0;
+        int bd = 1;
+        for (long i = i0; i < i1; ++i) {
+            if (iwhere[i] != 0 && iwhere[i] != -1) {
+                continue;
+            }
+            double neggi = d[i];
+            if (nbd[i] <= 2 && nbd[i] != 0 && neggi < 0.0) {
+                iorder[ib] = i;
+                t[ib] = (x[i] - l[i])/(-neggi);
+            } else if (nbd[i] >= 2 && neggi > 0.0) {
+                iorder[ib] = i;
+                t[ib] = (u[i] - x[i])/neggi;
+            } else {
+                --jf;
+                iorder[jf] = i;
+                if (fabs(neggi) > 0.0) {
+                    bd = 0;
+                }
+                continue;
+            }
+            if (ibk < 0 || t[ib] < bk) {
+                bk = t[ib];
+                ibk = ib;
+            }
+            ++ib;
+        }
+        ibkm[k] = ibk;
+        bkm[k] = bk;
+        bnd[k] = bd;
+    }
+
+    // Combine the results of the chunks in order.
+    *f1 = 0.0;
+    *ibkmin = 0;
+    *bkmin = 0.0;
+    *bnded = 1;
+    int found = 0;
+    for (int k = 0; k < nc; ++k) {
+        *f1 += f1p[k];
+        if (ibkm[k] >= 0 && (!found || bkm[k] < *bkmin)) {
+            *bkmin = bkm[k];
+            *ibkmin = ibkm[k];
+            found = 1;
+        }
+        if (!bnd[k]) {
+            *bnded = 0;
+        }
+    }
+    sum_parts(nc, 2*m, part, wbp);
+}
+
+// Compute the generalized Cauchy point.  Returns a nonzero value if a
+// triangular system is singular.
+static int cauchy(
+    int nt, long n, const real x[], const real l[], const real u[],
+    const integer nbd[], const real g[], integer iorder[],
+    integer iwhere[], real t[], real d[], real xcp[], long m,
+    const real wy[], const real ws[], long hinc, long hld,
+    const double sy[], const double wt[], double theta, long col,
+    long head, double p[],
+    double c[], double wbp[], double v[], double part[], integer* nseg,
+    int iprint, FILE* out, double sbgnrm, double epsmch)
+{
+    char buf1[32], buf2[32], buf3[32];
+
+    // Check the status of the variables, reset iwhere[i] if necessary;
+    // compute the Cauchy direction d and the breakpoints t; initialize the
+    // derivative f1 and the vector p = W'd (for theta = 1).
+    if (sbgnrm <= 0.0) {
+        if (iprint >= 0) {
+            fprintf(out, " Subgnorm = 0.  GCP = X.\n");
+        }
+        lbfgsb_rcopy(nt, n, x, xcp);
+        return 0;
+    }
+    int bnded = 1;
+    long nfree = n;
+    long nbreak = 0;
+    long ibkmin = 0;
+    double bkmin = 0.0;
+    long col2 = 2*col;
+    double f1 = 0.0;
+    if (iprint >= 99) {
+        fprintf(out, "\n---------------- CAUCHY entered-------------------\n");
+    }
+
+    // We set p to zero and build it up as we determine d.  With the
+    // interleaved layout or with multiple threads, p is first built in wbp in
+    // the storage order of the memorized pairs.
+    for (long i = 0; i < col2; ++i) {
+        p[i] = 0.0;
+    }
+    int nc = lbfgsb_nthreads(nt, n);
+    if (nc > 1) {
+        cauchy_scan(nc, n, x, l, u, nbd, g, iorder, iwhere, t, d, m, wy, ws,
+                    hinc, hld, col, head, wbp, part, &f1, &nbreak, &nfree,
+                    &ibkmin, &bkmin, &bnded);
+    } else {
+        if (INTERLEAVED) {
+            for (long s = 0; s < 2*m; ++s) {
+                wbp[s] = 0.0;
+            }
+        }
+
+        // In the following loop we determine for each variable its bound
+        // status and its breakpoint, and update p accordingly.  Smallest
+        // breakpoint is identified.
+        for (long i = 0; i < n; ++i) {
+            double neggi = -g[i];
+            double tl = 0.0, tu = 0.0;
+            if (iwhere[i] != 3 && iwhere[i] != -1) {
+                // If x[i] is not a constant and has bounds, compute the
+                // difference between x[i] and its bounds.
+                if (nbd[i] <= 2) {
+                    tl = x[i] - l[i];
+                }
+                if (nbd[i] >= 2) {
+                    tu = u[i] - x[i];
+                }
+
+                // If a variable is close enough to a bound we treat it as at
+                // bound.
+                int xlower = (nbd[i] <= 2 && tl <= 0.0);
+                int xupper = (nbd[i] >= 2 && tu <= 0.0);
+
+                // Reset iwhere[i].
+                iwhere[i] = 0;
+                if (xlower) {
+                    if (neggi <= 0.0) {
+                        iwhere[i] = 1;
+                    }
+                } else if (xupper) {
+                    if (neggi >= 0.0) {
+                        iwhere[i] = 2;
+                    }
+                } else {
+                    if (fabs(neggi) <= 0.0) {
+                        iwhere[i] = -3;
+                    }
+                }
+            }
+            long pointr = head;
+            if (iwhere[i] != 0 && iwhere[i] != -1) {
+                d[i] = 0.0;
+            } else {
+                d[i] = neggi;
+                f1 -= neggi*neggi;
+                // Calculate p := p - W'e_i* (g_i).
+                if (INTERLEAVED) {
+                    const real* row = &WY(i,0);
+                    for (long s = 0; s < 2*m; ++s) {
+                        wbp[s] += row[s]*neggi;
+                    }
+                } else {
+                    for (long j = 0; j < col; ++j) {
+                        p[j] = p[j] + WY(i,pointr)*neggi;
+                        p[col+j] = p[col+j] + WS(i,pointr)*neggi;
+                        pointr = NEXT(pointr, m);
+                    }
+                }
+                if (nbd[i] <= 2 && nbd[i] != 0 && neggi < 0.0) {
+                    // x[i] + d[i] is bounded; compute t[i].
+                    iorder[nbreak] = i;
+                    t[nbreak] = tl/(-neggi);
+                    if (nbreak == 0 || t[nbreak] < bkmin) {
+                        bkmin = t[nbreak];
+                        ibkmin = nbreak;
+                    }
+                    ++nbreak;
+                } else if (nbd[i] >= 2 && neggi > 0.0) {
+                    // x[i] + d[i] is bounded; compute t[i].
+                    iorder[nbreak] = i;
+                    t[nbreak] = tu/neggi;
+                    if (nbreak == 0 || t[nbreak] < bkmin) {
+                        bkmin = t[nbreak];
+                        ibkmin = nbreak;
+                    }
+                    ++nbreak;
+                } else {
+                    // x[i] + d[i] is not bounded.
+                    --nfree;
+                    iorder[nfree] = i;
+                    if (fabs(neggi) > 0.0) {
+                        bnded = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    if (INTERLEAVED || nc > 1) {
+        long pointr = head;
+        for (long j = 0; j < col; ++j) {
+            p[j] = wbp[pointr];
+            p[col+j] = wbp[m+pointr];
+            pointr = NEXT(pointr, m);
+        }
+    }
+
+    // The indices of the nonzero components of d are now stored in
+    // iorder[0..nbreak-1] and iorder[nfree..n-1].  The smallest of the
+    // nbreak breakpoints is in t[ibkmin] = bkmin.
+    if (theta != 1.0) {
+        // Complete the initialization of p for theta not equal to one.
+        dscal(col, theta, &p[col]);
+    }
+
+    // Initialize GCP xcp = x.
+    lbfgsb_rcopy(nt, n, x, xcp);
+    if (nbreak == 0 && nfree == n) {
+        // Is a zero vector, return with the initial xcp as GCP.
+        if (iprint > 100) {
+            fprintf(out, "Cauchy X =  \n");
+            for (long i = 0; i < n; ++i) {
+                fprintf(out, "%s %s",
+                        (i%6 == 0 ? (i > 0 ? "\n    " : "    ") : ""),
+                        fmt_e(buf1, 11, 4, xcp[i], 'D'));
+            }
+            fprintf(out, "\n");
+        }
+        return 0;
+    }
+
+    // Initialize c = W'(xcp - x) = 0.
+    for (long j = 0; j < col2; ++j) {
+        c[j] = 0.0;
+    }
+
+    // Initialize derivative f2.
+    double f2 = -theta*f1;
+    double f2_org = f2;
+    if (col > 0) {
+        if (bmv(m, sy, wt, col, head, p, v) != 0) {
+            return 1;
+        }
+        f2 -= ddot(col2, v, p);
+    }
+    double dtm = -f1/f2;
+    double tsum = 0.0;
+    *nseg = 1;
+    if (iprint >= 99) {
+        fprintf(out, " There are %12ld   breakpoints \n", nbreak);
+    }
+
+    // If there are no breakpoints, locate the GCP and return.
+    if (nbreak == 0) {
+        goto L888;
+    }
+    long nleft = nbreak;
+    long iter = 1;
+    double tj = 0.0;
+    long next = 0, ready = 0, batch = BP_MIN_BATCH;
+
+    //------------------- the beginning of the loop -------------------------
+  L777:
+    // Find the next smallest breakpoint; compute dt = t[nleft-1] -
+    // t[nleft].
+    ;
+    double tj0 = tj;
+    long ibp;
+    if (iter == 1) {
+        // Since we already have the smallest breakpoint we need not sort
+        // the breakpoints yet.  Often only one breakpoint is used and the
+        // cost of sorting is avoided.
+        tj = bkmin;
+        ibp = iorder[ibkmin];
+    } else {
+        if (iter == 2) {
+            // Move the already used smallest breakpoint in front of the
+            // others.
+            bp_swap(t, iorder, 0, ibkmin);
+            next = ready = 1;
+        }
+        if (next == ready) {
+            // Select and sort the next batch of breakpoints.
+            long k = min(batch, nbreak - ready);
+            if (k < nbreak - ready) {
+                bp_select(t, iorder, ready, nbreak, k);
+            }
+            bp_sort(t, iorder, ready, ready + k);
+            ready += k;
+            batch *= BP_GROWTH;
+        }
+        tj = t[next];
+        ibp = iorder[next];
+        ++next;
+    }
+    double dt = tj - tj0;
+    if (dt != 0.0 && iprint >= 100) {
+        fprintf(out, "\nPiece    %s --f1, f2 at start point  %s %s\n",
+                fmt_i(buf3, 3, *nseg), fmt_e(buf1, 11, 4, f1, 'D'),
+                fmt_e(buf2, 11, 4, f2, 'D'));
+        fprintf(out, "Distance to the next break point =  %s\n",
+                fmt_e(buf1, 11, 4, dt, 'D'));
+        fprintf(out, "Distance to the stationary point =  %s\n",
+                fmt_e(buf1, 11, 4, dtm, 'D'));
+    }
+
+    // If a minimizer is within this interval, locate the GCP and return.
+    if (dtm < dt) {
+        goto L888;
+    }
+
+    // Otherwise fix one variable and reset the corresponding component of d
+    // to zero.
+    tsum += dt;
+    --nleft;
+    ++iter;
+    double dibp = d[ibp];
+    d[ibp] = 0.0;
+    double zibp;
+    if (dibp > 0.0) {
+        zibp = u[ibp] - x[ibp];
+        xcp[ibp] = u[ibp];
+        iwhere[ibp] = 2;
+    } else {
+        zibp = l[ibp] - x[ibp];
+        xcp[ibp] = l[ibp];
+        iwhere[ibp] = 1;
+    }
+    if (iprint >= 100) {
+        fprintf(out, " Variable  %12ld   is fixed.\n", ibp + 1);
+    }
+    if (nleft == 0 && nbreak == n) {
+        // All n variables are fixed, return with xcp as GCP.
+        dtm = dt;
+        goto L999;
+    }
+
+    // Update the derivative information.
+    ++*nseg;
+    double dibp2 = dibp*dibp;
+
+    // Update f1 and f2.  Temporarily set f1 and f2 for col=0.
+    f1 = f1 + dt*f2 + dibp2 - theta*dibp*zibp;
+    f2 = f2 - theta*dibp2;
+    if (col > 0) {
+        // Update c = c + dt*p.
+        daxpy(col2, dt, p, c);
+
+        // Choose wbp, the row of W corresponding to the breakpoint
+        // encountered.
+        long pointr = head;
+        for (long j = 0; j < col; ++j) {
+            wbp[j] = WY(ibp,pointr);
+            wbp[col+j] = theta*WS(ibp,pointr);
+            pointr = NEXT(pointr, m);
+        }
+
+        // Compute (wbp)Mc, (wbp)Mp, and (wbp)M(wbp)'.
+        if (bmv(m, sy, wt, col, head, wbp, v) != 0) {
+            return 1;
+        }
+        double wmc = ddot(col2, c, v);
+        double wmp = ddot(col2, p, v);
+        double wmw = ddot(col2, wbp, v);
+
+        // Update p = p - dibp*wbp.
+        daxpy(col2, -dibp, wbp, p);
+
+        // Complete updating f1 and f2 while col > 0.
+        f1 += dibp*wmc;
+        f2 = f2 + 2.0*dibp*wmp - dibp2*wmw;
+    }
+    f2 = max(epsmch*f2_org, f2);
+    if (nleft > 0) {
+        dtm = -f1/f2;
+        goto L777;
+        // To repeat the loop for unsearched intervals.
+    } else if (bnded) {
+        f1 = 0.0;
+        f2 = 0.0;
+        dtm = 0.0;
+    } else {
+        dtm = -f1/f2;
+    }
+    //------------------- the end of the loop -------------------------------
+
+  L888:
+    if (iprint >= 99) {
+        fprintf(out, "\n GCP found in this segment\n");
+        fprintf(out, "Piece    %s --f1, f2 at start point  %s %s\n",
+                fmt_i(buf3, 3, *nseg), fmt_e(buf1, 11, 4, f1, 'D'),
+                fmt_e(buf2, 11, 4, f2, 'D'));
+        fprintf(out, "Distance to the stationary point =  %s\n",
+                fmt_e(buf1, 11, 4, dtm, 'D'));
+    }
+    if (dtm <= 0.0) {
+        dtm = 0.0;
+    }
+    tsum += dtm;
+
+    // Move free variables (i.e., the ones w/o breakpoints) and the variables
+    // whose breakpoints haven't been reached.
+    lbfgsb_raxpy(nt, n, tsum, d, xcp);
+
+  L999:
+    // Update c = c + dtm*p = W'(x^c - x) which will be used in computing
+    // r = Z'(B(x^c - x) + g).
+    if (col > 0) {
+        daxpy(col2, dtm, p, c);
+    }
+    if (iprint > 100) {
+        fprintf(out, "Cauchy X =  \n");
+        for (long i = 0; i < n; ++i) {
+            fprintf(out, "%s %s",
+                    (i%6 == 0 ? (i > 0 ? "\n    " : "    ") : ""),
+                    fmt_e(buf1, 11, 4, xcp[i], 'D'));
+        }
+        fprintf(out, "\n");
+    }
+    if (iprint >= 99) {
+        fprintf(out,
+                "\n---------------- exit CAUCHY----------------------\n\n");
+    }
+    return 0;
+}
+
+// Compute r = -Z'B(xcp - xk) - Z'g (using wa[2m..4m-1] from cauchy).
+// Returns a nonzero value if a triangular system is singular.
+static int cmprlb(
+    int nt, long n, long m, const real x[], const real g[],
+    const real ws[], const real wy[], long hinc, long hld,
+    const double sy[], const double wt[],
+    const real z[], real r[], double wa[], const integer index[],
+    double theta, long col, long head, long nfree, int cnstnd)
+{
+    if (!cnstnd && col > 0) {
+        int nc = lbfgsb_nthreads(nt, n);
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < n; ++i) {
+            r[i] = -g[i];
+        }
+    } else {
+        int nc = lbfgsb_nthreads(nt, nfree);
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < nfree; ++i) {
+            long k = index[i];
+            r[i] = -theta*(z[k] - x[k]) - g[k];
+        }
+        if (bmv(m, sy, wt, col, head, &wa[2*m], &wa[0]) != 0) {
+            return -8;
+        }
+        if (INTERLEAVED) {
+            // Store the coefficients in wa[4m..6m-1] in the storage order of
+            // the memorized pairs and update each r[i] in turn.
+            double* a = &wa[4*m];
+            long pointr = head;
+            for (long j = 0; j < col; ++j) {
+                a[pointr] = wa[j];
+                a[m+pointr] = theta*wa[col+j];
+                pointr = NEXT(pointr, m);
+            }
+            long len1 = min(col, m - head);
+            long len2 = col - len1;
+            LBFGSB_PARALLEL_FOR(nc)
+            for (long i = 0; i < nfree; ++i) {
+                const real* row = &WY(index[i],0);
+                double ri = r[i];
+                for (long s = head; s < head + len1; ++s) {
+                    ri = ri + row[s]*a[s] + row[m+s]*a[m+s];
+                }
+                for (long s = 0; s < len2; ++s) {
+                    ri = ri + row[s]*a[s] + row[m+s]*a[m+s];
+                }
+                r[i] = ri;
+            }
+        } else {
+            LBFGSB_PARALLEL_FOR(nc)
+            for (int ck = 0; ck < nc; ++ck) {
+                long i0, i1;
+                lbfgsb_chunk(nfree, nc, ck, &i0, &i1);
+                long pointr = head;
+                for (long j = 0; j < col; ++j) {
+                    double a1 = wa[j];
+                    double a2 = theta*wa[col+j];
+                    for (long i = i0; i < i1; ++i) {
+                        long k = index[i];
+                        r[i] = r[i] + WY(k,pointr)*a1 + WS(k,pointr)*a2;
+                    }
+                    pointr = NEXT(pointr, m);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Compute the sums over the rows listed in `set[0..cnt-1]` of the interleaved
+// history needed by formk to update the old parts of WN1: `a11` (for Y'Y),
+// `a22` (for S'S) and `a21` (for S'Y) are upcl-by-upcl with a stride of `m`.
+// `yv` and `sv` are workspaces of length `m`.
+static void formk_rows(
+    long m, const real wy[], long hinc, long hld, const integer set[],
+    long cnt, long head, long upcl, double a11[], double a22[],
+    double a21[], double yv[], double sv[])
+{
+    for (long iy = 0; iy < upcl; ++iy) {
+        for (long jy = 0; jy < upcl; ++jy) {
+            a11[iy*m+jy] = 0.0;
+            a22[iy*m+jy] = 0.0;
+            a21[iy*m+jy] = 0.0;
+        }
+    }
+    for (long k = 0; k < cnt; ++k) {
+        // Gather the row in the logical order of the pairs.
+        const real* row = &WY(set[k],0);
+        long pointr = head;
+        for (long j = 0; j < upcl; ++j) {
+            yv[j] = row[pointr];
+            sv[j] = row[m+pointr];
+            pointr = NEXT(pointr, m);
+        }
+        for (long iy = 0; iy < upcl; ++iy) {
+            double yi = yv[iy];
+            double si = sv[iy];
+            double* b11 = &a11[iy*m];
+            double* b22 = &a22[iy*m];
+            double* b21 = &a21[iy*m];
+            for (long jy = 0; jy <= iy; ++jy) {
+                b11[jy] += yi*yv[jy];
+                b22[jy] += si*sv[jy];
+            }
+            for (long jy = 0; jy < upcl; ++jy) {
+                b21[jy] += si*yv[jy];
+            }
+        }
+    }
+}
+
+// Form the LEL^T factorization of the indefinite matrix K.  Returns 0 on
+// success, -1 or -2 if the first or second Cholesky factorization failed.
+static int formk(
+    long n, long nsub, const integer ind[], long nenter, long ileave,
+    const integer indx2[], int updatd, double wn[], double wn1[], long m,
+    const real ws[], const real wy[], long hinc, long hld, const double sy[],
+    double theta, long col, long head, double wrk[])
+{
+    long m2 = 2*m;
+    long upcl;
+
+    // Form the lower triangular part of WN1 = [Y' ZZ'Y   L_a'+R_z']
+    //                                         [L_a+R_z   S'AA'S   ]
+    // where L_a is the strictly lower triangular part of S'AA'Y and R_z is
+    // the upper triangular part of S'ZZ'Y.
+    if (updatd) {
+        // Put new rows in blocks (1,1), (2,1) and (2,2).  The rows and
+        // columns of the discarded pair (if any) are overwritten.
+        long pbegin = 0;
+        long pend = nsub;
+        long dbegin = nsub;
+        long dend = n;
+        long iy = col - 1;
+        long is = m + col - 1;
+        long ipntr = head + col - 1;
+        if (ipntr >= m) {
+            ipntr -= m;
+        }
+        if (INTERLEAVED) {
+            // Same computations as below but in a single pass over the
+            // rows of the history.  The new row of Y'ZZ'Y, of S'AA'S, of L_a
+            // and the new column of R_z are accumulated in wrk[0..4m-1].
+            double* a1 = &wrk[0];
+            double* a2 = &wrk[m];
+            double* a3 = &wrk[2*m];
+            double* a4 = &wrk[3*m];
+            long len1 = min(col, m - head);
+            for (long jy = 0; jy < col; ++jy) {
+                a1[jy] = 0.0;
+                a2[jy] = 0.0;
+                a3[jy] = 0.0;
+                a4[jy] = 0.0;
+            }
+            for (long k = pbegin; k < pend; ++k) {
+                const real* row = &WY(ind[k],0);
+                const real* r1 = row + head;
+                double yk = row[ipntr];
+                for (long jy = 0; jy < len1; ++jy) {
+                    a1[jy] += yk*r1[jy];
+                    a4[jy] += r1[m+jy]*yk;
+                }
+                for (long jy = len1; jy < col; ++jy) {
+                    a1[jy] += yk*row[jy-len1];
+                    a4[jy] += row[m+jy-len1]*yk;
+                }
+            }
+            for (long k = dbegin; k < dend; ++k) {
+                const real* row = &WY(ind[k],0);
+                const real* r1 = row + head;
+                double sk = row[m+ipntr];
+                for (long jy = 0; jy < len1; ++jy) {
+                    a2[jy] += sk*r1[m+jy];
+                    a3[jy] += sk*r1[jy];
+                }
+                for (long jy = len1; jy < col; ++jy) {
+                    a2[jy] += sk*row[m+jy-len1];
+                    a3[jy] += sk*row[jy-len1];
+                }
+            }
+            for (long jy = 0; jy < col; ++jy) {
+                WN1(iy,jy) = a1[jy];
+                WN1(is,m+jy) = a2[jy];
+                WN1(is,jy) = a3[jy];
+            }
+            for (long i = 0; i < col; ++i) {
+                WN1(m+i,col-1) = a4[i];
+            }
+        } else {
+            long jpntr = head;
+            for (long jy = 0; jy < col; ++jy) {
+                long js = m + jy;
+                double temp1 = 0.0;
+                double temp2 = 0.0;
+                double temp3 = 0.0;
+                // Compute element jy of row 'col' of Y'ZZ'Y.
+                for (long k = pbegin; k < pend; ++k) {
+                    long k1 = ind[k];
+                    temp1 += WY(k1,ipntr)*WY(k1,jpntr);
+                }
+                // Compute elements jy of row 'col' of L_a and S'AA'S.
+                for (long k = dbegin; k < dend; ++k) {
+                    long k1 = ind[k];
+                    temp2 += WS(k1,ipntr)*WS(k1,jpntr);
+                    temp3 += WS(k1,ipntr)*WY(k1,jpntr);
+                }
+                WN1(iy,jy) = temp1;
+                WN1(is,js) = temp2;
+                WN1(is,jy) = temp3;
+                jpntr = NEXT(jpntr, m);
+            }
+
+            // Put new column in block (2,1).
+            long jy = col - 1;
+            jpntr = head + col - 1;
+            if (jpntr >= m) {
+                jpntr -= m;
+            }
+            ipntr = head;
+            for (long i = 0; i < col; ++i) {
+                is = m + i;
+                double temp3 = 0.0;
+                // Compute element i of column 'col' of R_z.
+                for (long k = pbegin; k < pend; ++k) {
+                    long k1 = ind[k];
+                    temp3 += WS(k1,ipntr)*WY(k1,jpntr);
+                }
+                ipntr = NEXT(ipntr, m);
+                WN1(is,jy) = temp3;
+            }
+        }
+        upcl = col - 1;
+    } else {
+        upcl = col;
+    }
+
+    // Modify the old parts in blocks (1,1), (2,2) and (2,1) due to changes in
+    // the set of free variables.
+    if (INTERLEAVED) {
+        // The sums over the entering and leaving variables are computed in
+        // a single pass over the corresponding rows of the history and
+        // added in the same order as below.  The array wn, which is formed
+        // afterwards, is used to store the sums.
+        double* a11 = &wn[0];
+        double* a22 = &wn[m*m];
+        double* a21 = &wn[2*m*m];
+        for (int pass = 0; pass < 2; ++pass) {
+            const integer* set = (pass == 0 ? indx2 : &indx2[ileave]);
+            long cnt = (pass == 0 ? nenter : n - ileave);
+            double sgn = (pass == 0 ? 1.0 : -1.0);
+            formk_rows(m, wy, hinc, hld, set, cnt, head, upcl, a11, a22, a21,
+                       &wrk[0], &wrk[m]);
+            for (long iy = 0; iy < upcl; ++iy) {
+                for (long jy = 0; jy <= iy; ++jy) {
+                    WN1(iy,jy) = WN1(iy,jy) + sgn*a11[iy*m+jy];
+                    WN1(m+iy,m+jy) = WN1(m+iy,m+jy) - sgn*a22[iy*m+jy];
+                }
+            }
+            for (long i = 0; i < upcl; ++i) {
+                for (long jy = 0; jy < upcl; ++jy) {
+                    if (i <= jy) {
+                        WN1(m+i,jy) = WN1(m+i,jy) + sgn*a21[i*m+jy];
+                    } else {
+                        WN1(m+i,jy) = WN1(m+i,jy) - sgn*a21[i*m+jy];
+                    }
+                }
+            }
+        }
+    } else {
+        long ipntr = head;
+        for (long iy = 0; iy < upcl; ++iy) {
+            long is = m + iy;
+            long jpntr = head;
+            for (long jy = 0; jy <= iy; ++jy) {
+                long js = m + jy;
+                double temp1 = 0.0;
+                double temp2 = 0.0;
+                double temp3 = 0.0;
+                double temp4 = 0.0;
+                for (long k = 0; k < nenter; ++k) {
+                    long k1 = indx2[k];
+                    temp1 += WY(k1,ipntr)*WY(k1,jpntr);
+                    temp2 += WS(k1,ipntr)*WS(k1,jpntr);
+                }
+                for (long k = ileave; k < n; ++k) {
+                    long k1 = indx2[k];
+                    temp3 += WY(k1,ipntr)*WY(k1,jpntr);
+                    temp4 += WS(k1,ipntr)*WS(k1,jpntr);
+                }
+                WN1(iy,jy) = WN1(iy,jy) + temp1 - temp3;
+                WN1(is,js) = WN1(is,js) - temp2 + temp4;
+                jpntr = NEXT(jpntr, m);
+            }
+            ipntr = NEXT(ipntr, m);
+        }
+
+        // Modify the old parts in block (2,1).
+        ipntr = head;
+        for (long is = m; is < m + upcl; ++is) {
+            long jpntr = head;
+            for (long jy = 0; jy < upcl; ++jy) {
+                double temp1 = 0.0;
+                double temp3 = 0.0;
+                for (long k = 0; k < nenter; ++k) {
+                    long k1 = indx2[k];
+                    temp1 += WS(k1,ipntr)*WY(k1,jpntr);
+                }
+                for (long k = ileave; k < n; ++k) {
+                    long k1 = indx2[k];
+                    temp3 += WS(k1,ipntr)*WY(k1,jpntr);
+                }
+                if (is <= jy + m) {
+                    WN1(is,jy) = WN1(is,jy) + temp1 - temp3;
+                } else {
+                    WN1(is,jy) = WN1(is,jy) - temp1 + temp3;
+                }
+                jpntr = NEXT(jpntr, m);
+            }
+            ipntr = NEXT(ipntr, m);
+        }
+    }
+
+    // Form the upper triangle of WN = [D+Y' ZZ'Y/theta   -L_a'+R_z' ]
+    //                                 [-L_a +R_z        S'AA'S*theta]
+    for (long iy = 0; iy < col; ++iy) {
+        long is = col + iy;
+        long is1 = m + iy;
+        for (long jy = 0; jy <= iy; ++jy) {
+            long js = col + jy;
+            long js1 = m + jy;
+            WN(jy,iy) = WN1(iy,jy)/theta;
+            WN(js,is) = WN1(is1,js1)*theta;
+        }
+        for (long jy = 0; jy < iy; ++jy) {
+            WN(jy,is) = -WN1(is1,jy);
+        }
+        for (long jy = iy; jy < col; ++jy) {
+            WN(jy,is) = WN1(is1,jy);
+        }
+        WN(iy,iy) = WN(iy,iy) + SY(iy,iy);
+    }
+
+    // Form the upper triangle of WN = [  LL'            L^-1(-L_a'+R_z')]
+    //                                 [(-L_a +R_z)L'^-1   S'AA'S*theta  ]
+    //
+    // First Cholesky factor (1,1) block of wn to get LL' with L' stored in
+    // the upper triangle of wn.
+    if (dpofa(wn, m2, col) != 0) {
+        return -1;
+    }
+
+    // Then form L^-1(-L_a'+R_z') in the (1,2) block.
+    long col2 = 2*col;
+    for (long js = col; js < col2; ++js) {
+        dtrsl(wn, m2, col, &WN(0,js), 11);
+    }
+
+    // Form S'AA'S*theta + (L^-1(-L_a'+R_z'))'L^-1(-L_a'+R_z') in the upper
+    // triangle of (2,2) block of wn.
+    for (long is = col; is < col2; ++is) {
+        for (long js = is; js < col2; ++js) {
+            WN(is,js) = WN(is,js) + ddot(col, &WN(0,is), &WN(0,js));
+        }
+    }
+
+    // Cholesky factorization of (2,2) block of wn.
+    if (dpofa(&WN(col,col), m2, col) != 0) {
+        return -2;
+    }
+    return 0;
+}
+
+// Form the upper half of the pos. def. and symm. T = theta*SS + L*D^(-1)*L',
+// store T in the upper triangle of the array wt, and perform the Cholesky
+// factorization of T to produce J*J', with J' stored in the upper triangle
+// of wt.  Returns 0 on success or -3 on failure.
+static int formt(
+    long m, double wt[], const double sy[], const double ss[], long col,
+    long head, double theta)
+{
+    for (long j = 0; j < col; ++j) {
+        WT(0,j) = theta*SS(0,j);
+    }
+    for (long i = 1; i < col; ++i) {
+        for (long j = i; j < col; ++j) {
+            long k1 = min(i, j);
+            double ddum = 0.0;
+            for (long k = 0; k < k1; ++k) {
+                ddum += SY(i,k)*SY(j,k)/SY(k,k);
+            }
+            WT(i,j) = ddum + theta*SS(i,j);
+        }
+    }
+    return (dpofa(wt, m, col) != 0 ? -3 : 0);
+}
+
+// Set the lower triangular part of WN1 (see formk()) as if all the variables
+// were active.  The set of free variables is emptied accordingly, so that
+// the next call to formk(), with all the free variables entering the set,
+// forms WN1 for the actual free variables.  This is used to start an
+// optimization with the L-BFGS memory of the previous one.
+static void formk_all_active(
+    long n, long m, integer* nfree, integer index[], const double sy[],
+    const double ss[], long col, long head, double wn1[])
+{
+    long m2 = 2*m;
+    for (long iy = 0; iy < col; ++iy) {
+        for (long jy = 0; jy <= iy; ++jy) {
+            WN1(iy,jy) = 0.0;
+            WN1(m+iy,m+jy) = SS(jy,iy);
+        }
+    }
+    for (long i = 0; i < col; ++i) {
+        for (long jy = 0; jy < col; ++jy) {
+            WN1(m+i,jy) = (i <= jy ? 0.0 : SY(i,jy));
+        }
+    }
+    *nfree = 0;
+    for (long i = 0; i < n; ++i) {
+        index[i] = i;
+    }
+}
+
+// Count the entering and leaving variables for iter > 0, and find the index
+// set of free and active variables at the GCP.  Returns whether the
+// factorization of K has to be recomputed.
+static int freev(
+    long n, integer* nfree, integer index[], integer* nenter,
+    integer* ileave, integer indx2[], const integer iwhere[], int updatd,
+    int cnstnd, int iprint, FILE* out, long iter, int warm)
+{
+    *nenter = 0;
+    *ileave = n;
+    if ((iter > 0 || warm) && cnstnd) {
+        // Count the entering and leaving variables.
+        for (long i = 0; i < *nfree; ++i) {
+            long k = index[i];
+            if (iwhere[k] > 0) {
+                --*ileave;
+                indx2[*ileave] = k;
+                if (iprint >= 100) {
+                    fprintf(out, " Variable %12ld  leaves the set of free "
+                            "variables\n", k + 1);
+                }
+            }
+        }
+        for (long i = *nfree; i < n; ++i) {
+            long k = index[i];
+            if (iwhere[k] <= 0) {
+                indx2[*nenter] = k;
+                ++*nenter;
+                if (iprint >= 100) {
+                    fprintf(out, " Variable %12ld  enters the set of free "
+                            "variables\n", k + 1);
+                }
+            }
+        }
+        if (iprint >= 99) {
+            fprintf(out, "%12ld  variables leave; %12ld  variables enter\n",
+                    n - (long)*ileave, (long)*nenter);
+        }
+    }
+    int wrk = (*ileave < n || *nenter > 0 || updatd);
+
+    // Find the index set of free and active variables at the GCP.
+    *nfree = 0;
+    long iact = n;
+    for (long i = 0; i < n; ++i) {
+        if (iwhere[i] <= 0) {
+            index[*nfree] = i;
+            ++*nfree;
+        } else {
+            --iact;
+            index[iact] = i;
+        }
+    }
+    if (iprint >= 99) {
+        fprintf(out, "%12ld  variables are free at GCP %12ld\n",
+                (long)*nfree, iter + 1);
+    }
+    return wrk;
+}
+
+// Update matrices WS and WY, and form the middle matrix in B.  If `prefetch`
+// is true, the columns of WS and WY are prefetched before being swept (the
+// history is mapped from a file).
+static void matupd(
+    int nt, long n, long m, real ws[], real wy[], long hinc, long hld,
+    double sy[], double ss[], const real d[], const real r[],
+    integer* itail, long iupdat, integer* col, integer* ihead,
+    double* theta, double rr, double dr, double stp, double dtd,
+    double wrk[], double part[], int prefetch)
+{
+    // Set pointers for matrices WS and WY.
+    if (iupdat <= m) {
+        *col = iupdat;
+        *itail = (*ihead + iupdat - 1)%m;
+    } else {
+        *itail = NEXT(*itail, m);
+        *ihead = NEXT(*ihead, m);
+    }
+    const long head = *ihead;
+
+    // Update matrices WS and WY.  With the interleaved layout, this is done
+    // in the same pass as the computation of the products of d with the
+    // stored pairs (in wrk[0..2m-1] in storage order).  With multiple
+    // threads, each chunk of variables yields its own products in part.
+    long tail = *itail;
+    if (INTERLEAVED) {
+        int nc = lbfgsb_nthreads(nt, n);
+        LBFGSB_PARALLEL_FOR(nc)
+        for (int k = 0; k < nc; ++k) {
+            long i0, i1;
+            lbfgsb_chunk(n, nc, k, &i0, &i1);
+            double* acc = (nc > 1 ? &part[2*m*k] : wrk);
+            for (long s = 0; s < 2*m; ++s) {
+                acc[s] = 0.0;
+            }
+            for (long i = i0; i < i1; ++i) {
+                real* row = &WY(i,0);
+                double di = d[i];
+                row[tail] = r[i];
+                row[m+tail] = di;
+                for (long s = 0; s < m; ++s) {
+                    acc[s] += di*row[s];
+                }
+                for (long s = m; s < 2*m; ++s) {
+                    acc[s] += row[s]*di;
+                }
+            }
+        }
+        if (nc > 1) {
+            sum_parts(nc, 2*m, part, wrk);
+        }
+    } else {
+        if (prefetch) {
+            lbfgsb_prefetch_(&WS(0,tail), n*sizeof(real));
+            lbfgsb_prefetch_(&WY(0,tail), n*sizeof(real));
+        }
+        lbfgsb_rcopy(nt, n, d, &WS(0,tail));
+        lbfgsb_rcopy(nt, n, r, &WY(0,tail));
+    }
+
+    // Set theta = yy/ys.
+    *theta = rr/dr;
+
+    // Form the middle matrix in B.  Update the upper triangle of SS, and the
+    // lower triangle of SY.  The new information (the last row of SY and the
+    // last column of SS) replaces that of the discarded pair (if any).
+    long c = *col;
+    long pointr = head;
+    for (long j = 0; j < c - 1; ++j) {
+        if (INTERLEAVED) {
+            SY(c-1,j) = wrk[pointr];
+            SS(j,c-1) = wrk[m+pointr];
+        } else {
+            if (prefetch && j + 1 < c - 1) {
+                lbfgsb_prefetch_(&WY(0,NEXT(pointr, m)), n*sizeof(real));
+                lbfgsb_prefetch_(&WS(0,NEXT(pointr, m)), n*sizeof(real));
+            }
+            SY(c-1,j) = lbfgsb_rdot(nt, n, d, &WY(0,pointr));
+            SS(j,c-1) = lbfgsb_rdot(nt, n, &WS(0,pointr), d);
+        }
+        pointr = NEXT(pointr, m);
+    }
+    if (stp == 1.0) {
+        SS(c-1,c-1) = dtd;
+    } else {
+        SS(c-1,c-1) = stp*stp*dtd;
+    }
+    SY(c-1,c-1) = dr;
+}
+
+// Perform the subspace minimization.  Returns a nonzero value if a
+// triangular system is singular.
+static int subsm(
+    int nt, long n, long m, long nsub, const integer ind[], const real l[],
+    const real u[], const integer nbd[], real x[], real d[],
+    real xp[], const real ws[], const real wy[], long hinc,
+    long hld, double theta, const real xx[], const real gg[], long col,
+    long head, integer* iword, double wv[], double wrk[], double part[],
+    const double wn[], int iprint, FILE* out)
+{
+    if (nsub <= 0) {
+        return 0;
+    }
+    if (iprint >= 99) {
+        fprintf(out, "\n----------------SUBSM entered-----------------\n\n");
+    }
+
+    // Compute wv = W'Zd.  With the interleaved layout, the products are
+    // accumulated in wrk[0..2m-1] in the storage order of the pairs.  With
+    // multiple threads, each chunk of variables yields its own products in
+    // part.
+    int nc = lbfgsb_nthreads(nt, nsub);
+    long pointr = head;
+    if (INTERLEAVED) {
+        LBFGSB_PARALLEL_FOR(nc)
+        for (int k = 0; k < nc; ++k) {
+            long j0, j1;
+            lbfgsb_chunk(nsub, nc, k, &j0, &j1);
+            double* acc = (nc > 1 ? &part[2*m*k] : wrk);
+            for (long s = 0; s < 2*m; ++s) {
+                acc[s] = 0.0;
+            }
+            for (long j = j0; j < j1; ++j) {
+                const real* row = &WY(ind[j],0);
+                double dj = d[j];
+                for (long s = 0; s < 2*m; ++s) {
+                    acc[s] += row[s]*dj;
+                }
+            }
+        }
+        if (nc > 1) {
+            sum_parts(nc, 2*m, part, wrk);
+        }
+        for (long i = 0; i < col; ++i) {
+            wv[i] = wrk[pointr];
+            wv[col+i] = theta*wrk[m+pointr];
+            pointr = NEXT(pointr, m);
+        }
+    } else {
+        LBFGSB_PARALLEL_FOR(nc)
+        for (int ck = 0; ck < nc; ++ck) {
+            long j0, j1;
+            lbfgsb_chunk(nsub, nc, ck, &j0, &j1);
+            double* acc = (nc > 1 ? &part[2*col*ck] : wv);
+            long pointr = head;
+            for (long i = 0; i < col; ++i) {
+                double temp1 = 0.0;
+                double temp2 = 0.0;
+                for (long j = j0; j < j1; ++j) {
+                    long k = ind[j];
+                    temp1 += WY(k,pointr)*d[j];
+                    temp2 += WS(k,pointr)*d[j];
+                }
+                acc[i] = temp1;
+                acc[col+i] = temp2;
+                pointr = NEXT(pointr, m);
+            }
+        }
+        if (nc > 1) {
+            sum_parts(nc, 2*col, part, wv);
+        }
+        for (long i = 0; i < col; ++i) {
+            wv[col+i] = theta*wv[col+i];
+        }
+    }
+
+    // Compute wv := K^(-1)wv.
+    long m2 = 2*m;
+    long col2 = 2*col;
+    if (dtrsl(wn, m2, col2, wv, 11) != 0) {
+        return 1;
+    }
+    for (long i = 0; i < col; ++i) {
+        wv[i] = -wv[i];
+    }
+    if (dtrsl(wn, m2, col2, wv, 01) != 0) {
+        return 1;
+    }
+
+    // Compute d = (1/theta)d + (1/theta**2)Z'W wv.
+    pointr = head;
+    if (INTERLEAVED) {
+        // Store the coefficients in wrk in the storage order of the pairs
+        // and update each d[i] in turn.
+        for (long jy = 0; jy < col; ++jy) {
+            wrk[pointr] = wv[jy];
+            wrk[m+pointr] = wv[col+jy];
+            pointr = NEXT(pointr, m);
+        }
+        long len1 = min(col, m - head);
+        long len2 = col - len1;
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < nsub; ++i) {
+            const real* row = &WY(ind[i],0);
+            double di = d[i];
+            for (long s = head; s < head + len1; ++s) {
+                di = di + row[s]*wrk[s]/theta + row[m+s]*wrk[m+s];
+            }
+            for (long s = 0; s < len2; ++s) {
+                di = di + row[s]*wrk[s]/theta + row[m+s]*wrk[m+s];
+            }
+            d[i] = di;
+        }
+    } else {
+        LBFGSB_PARALLEL_FOR(nc)
+        for (int ck = 0; ck < nc; ++ck) {
+            long i0, i1;
+            lbfgsb_chunk(nsub, nc, ck, &i0, &i1);
+            long pointr = head;
+            for (long jy = 0; jy < col; ++jy) {
+                long js = col + jy;
+                for (long i = i0; i < i1; ++i) {
+                    long k = ind[i];
+                    d[i] = d[i] + WY(k,pointr)*wv[jy]/theta
+                        + WS(k,pointr)*wv[js];
+                }
+                pointr = NEXT(pointr, m);
+            }
+        }
+    }
+    lbfgsb_rscal(nt, nsub, 1.0/theta, d);
+
+    // Let us try the projection, d is the Newton direction.
+    lbfgsb_rcopy(nt, n, x, xp);
+    int proj = 0;
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static) if(nc > 1)
+               reduction(|:proj))
+    for (long i = 0; i < nsub; ++i) {
+        long k = ind[i];
+        double dk = d[i];
+        double xk = x[k];
+        if (nbd[k] != 0) {
+            if (nbd[k] == 1) {
+                // Lower bounds only.
+                x[k] = max(l[k], xk + dk);
+                if (x[k] == l[k]) {
+                    proj = 1;
+                }
+            } else if (nbd[k] == 2) {
+                // Upper and lower bounds.
+                xk = max(l[k], xk + dk);
+                x[k] = min(u[k], xk);
+                if (x[k] == l[k] || x[k] == u[k]) {
+                    proj = 1;
+                }
+            } else if (nbd[k] == 3) {
+                // Upper bounds only.
+                x[k] = min(u[k], xk + dk);
+                if (x[k] == u[k]) {
+                    proj = 1;
+                }
+            }
+        } else {
+            // Free variables.
+            x[k] = xk + dk;
+        }
+    }
+    *iword = proj;
+    if (*iword == 0) {
+        goto L911;
+    }
+
+    // Check sign of the directional derivative.
+    int ncn = lbfgsb_nthreads(nt, n);
+    double dd_part[LBFGSB_MAX_THREADS];
+    LBFGSB_PARALLEL_FOR(ncn)
+    for (int k = 0; k < ncn; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, ncn, k, &i0, &i1);
+        double dd_p = 0.0;
+        for (long i = i0; i < i1; ++i) {
+            dd_p += (x[i] - xx[i])*gg[i];
+        }
+        dd_part[k] = dd_p;
+    }
+    double dd_p = dd_part[0];
+    for (int k = 1; k < ncn; ++k) {
+        dd_p += dd_part[k];
+    }
+    if (dd_p > 0.0) {
+        lbfgsb_rcopy(nt, n, xp, x);
+        fprintf(out, "  Positive dir derivative in projection \n");
+        fprintf(out, "  Using the backtracking step \n");
+    } else {
+        goto L911;
+    }
+
+    // Compute the maximum step length alpha along d.
+    double alpha = 1.0;
+    double temp1 = alpha;
+    long ibd = 0;
+    for (long i = 0; i < nsub; ++i) {
+        long k = ind[i];
+        double dk = d[i];
+        if (nbd[k] != 0) {
+            if (dk < 0.0 && nbd[k] <= 2) {
+                double temp2 = l[k] - x[k];
+                if (temp2 >= 0.0) {
+                    temp1 = 0.0;
+                } else if (dk*alpha < temp2) {
+                    temp1 = temp2/dk;
+                }
+            } else if (dk > 0.0 && nbd[k] >= 2) {
+                double temp2 = u[k] - x[k];
+                if (temp2 <= 0.0) {
+                    temp1 = 0.0;
+                } else if (dk*alpha > temp2) {
+                    temp1 = temp2/dk;
+                }
+            }
+            if (temp1 < alpha) {
+                alpha = temp1;
+                ibd = i;
+            }
+        }
+    }
+    if (alpha < 1.0) {
+        double dk = d[ibd];
+        long k = ind[ibd];
+        if (dk > 0.0) {
+            x[k] = u[k];
+            d[ibd] = 0.0;
+        } else if (dk < 0.0) {
+            x[k] = l[k];
+            d[ibd] = 0.0;
+        }
+    }
+    LBFGSB_PARALLEL_FOR(nc)
+    for (long i = 0; i < nsub; ++i) {
+        long k = ind[i];
+        x[k] = x[k] + alpha*d[i];
+    }
+
+  L911:
+    if (iprint >= 99) {
+        fprintf(out, "\n----------------exit SUBSM --------------------\n\n");
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// UNCONSTRAINED PROBLEMS
+
+// Compute d = a*(c + b*x) and return v'd (0 if `v` is NULL) in a single pass
+// over the variables.  The entries of `x` and `v` are spaced by `inc`, `c`
+// may be `d`.
+static double twoloop_pass(
+    int nt, long n, double a, const real c[], double b, const real x[],
+    const real v[], long inc, real d[])
+{
+    int nc = lbfgsb_nthreads(nt, n);
+    double part[LBFGSB_MAX_THREADS];
+    LBFGSB_PARALLEL_FOR(nc)
+    for (int k = 0; k < nc; ++k) {
+        long i0, i1;
+        lbfgsb_chunk(n, nc, k, &i0, &i1);
+        double s = 0.0;
+        if (v == NULL) {
+            for (long i = i0; i < i1; ++i) {
+                d[i] = a*(c[i] + b*x[i*inc]);
+            }
+        } else {
+            for (long i = i0; i < i1; ++i) {
+                real di = a*(c[i] + b*x[i*inc]);
+                d[i] = di;
+                s += v[i*inc]*di;
+            }
+        }
+        part[k] = s;
+    }
+    double s = part[0];
+    for (int k = 1; k < nc; ++k) {
+        s += part[k];
+    }
+    return s;
+}
+
+// Compute the search direction d = -H*g by the two-loop recursion, H being
+// the inverse of the L-BFGS matrix with H0 = I/theta.  Without bounds, this
+// is the direction given by the subspace minimization (up to rounding
+// errors) but it takes 2*col+1 passes over the variables instead of forming
+// and factorizing the 2m-by-2m middle matrix.  Each pass applies the update
+// of a step of the recursion and computes the dot product needed by the next
+// one.  To save the negations, `d` holds -q and then -r (q and r being the
+// vectors of the usual formulation).  The coefficients are stored in
+// alpha[0..col-1].
+static void twoloop(
+    int nt, long n, long m, const real ws[], const real wy[], long hinc,
+    long hld, const double sy[], double theta, long col, long head,
+    const real g[], real d[], double alpha[])
+{
+    if (col == 0) {
+        twoloop_pass(nt, n, -1.0/theta, g, 0.0, g, NULL, 1, d);
+        return;
+    }
+
+    // First loop, from the most recent pair to the oldest one, with d = -q.
+    long j = col - 1;
+    double sd = twoloop_pass(nt, n, -1.0, g, 0.0, &WS(0,SLOT(j)),
+                             &WS(0,SLOT(j)), hinc, d);
+    for (; j > 0; --j) {
+        alpha[j] = -sd/SY(j,j);
+        sd = twoloop_pass(nt, n, 1.0, d, alpha[j], &WY(0,SLOT(j)),
+                          &WS(0,SLOT(j-1)), hinc, d);
+    }
+    alpha[0] = -sd/SY(0,0);
+
+    // Apply H0 along with the last update of the first loop, then second
+    // loop from the oldest pair to the most recent one.
+    double yd = twoloop_pass(nt, n, 1.0/theta, d, alpha[0], &WY(0,SLOT(0)),
+                             &WY(0,SLOT(0)), hinc, d);
+    for (j = 0; j < col; ++j) {
+        double beta = -yd/SY(j,j);
+        const real* v = (j + 1 < col ? &WY(0,SLOT(j+1)) : NULL);
+        yd = twoloop_pass(nt, n, 1.0, d, beta - alpha[j], &WS(0,SLOT(j)),
+                          v, hinc, d);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// LINE SEARCH
+
+// Tasks of the line search.
+enum {
+    DCSRCH_START = 0,
+    DCSRCH_FG,
+    DCSRCH_CONVERGENCE,
+    DCSRCH_WARNING,
+    DCSRCH_ERROR,
+};
+
+// Compute a safeguarded step for a search procedure and update an interval
+// that contains a step that satisfies a sufficient decrease and a curvature
+// condition.
+static void dcstep(
+    double* stx, double* fx, double* dx, double* sty, double* fy,
+    double* dy, double* stp, double fp, double dp, int* brackt,
+    double stpmin, double stpmax)
+{
+    const double p66 = 0.66, two = 2.0, three = 3.0;
+    double gamma, p, q, r, s, sgnd, stpc, stpf, stpq, theta;
+
+    sgnd = dp*(*dx/fabs(*dx));
+    if (fp > *fx) {
+        // First case: a higher function value.  The minimum is bracketed.
+        theta = three*(*fx - fp)/(*stp - *stx) + *dx + dp;
+        s = max(max(fabs(theta), fabs(*dx)), fabs(dp));
+        gamma = s*sqrt((theta/s)*(theta/s) - (*dx/s)*(dp/s));
+        if (*stp < *stx) {
+            gamma = -gamma;
+        }
+        p = (gamma - *dx) + theta;
+        q = ((gamma - *dx) + gamma) + dp;
+        r = p/q;
+        stpc = *stx + r*(*stp - *stx);
+        stpq = *stx + ((*dx/((*fx - fp)/(*stp - *stx) + *dx))/two)*
+            (*stp - *stx);
+        if (fabs(stpc - *stx) < fabs(stpq - *stx)) {
+            stpf = stpc;
+        } else {
+            stpf = stpc + (stpq - stpc)/two;
+        }
+        *brackt = 1;
+    } else if (sgnd < 0.0) {
+        // Second case: a lower function value and derivatives of opposite
+        // sign.  The minimum is bracketed.
+        theta = three*(*fx - fp)/(*stp - *stx) + *dx + dp;
+        s = max(max(fabs(theta), fabs(*dx)), fabs(dp));
+        gamma = s*sqrt((theta/s)*(theta/s) - (*dx/s)*(dp/s));
+        if (*stp > *stx) {
+            gamma = -gamma;
+        }
+        p = (gamma - dp) + theta;
+        q = ((gamma - dp) + gamma) + *dx;
+        r = p/q;
+        stpc = *stp + r*(*stx - *stp);
+        stpq = *stp + (dp/(dp - *dx))*(*stx - *stp);
+        if (fabs(stpc - *stp) > fabs(stpq - *stp)) {
+            stpf = stpc;
+        } else {
+            stpf = stpq;
+        }
+        *brackt = 1;
+    } else if (fabs(dp) < fabs(*dx)) {
+        // Third case: a lower function value, derivatives of the same sign,
+        // and the magnitude of the derivative decreases.
+        theta = three*(*fx - fp)/(*stp - *stx) + *dx + dp;
+        s = max(max(fabs(theta), fabs(*dx)), fabs(dp));
+        gamma = s*sqrt(max(0.0, (theta/s)*(theta/s) - (*dx/s)*(dp/s)));
+        if (*stp > *stx) {
+            gamma = -gamma;
+        }
+        p = (gamma - dp) + theta;
+        q = (gamma + (*dx - dp)) + gamma;
+        r = p/q;
+        if (r < 0.0 && gamma != 0.0) {
+            stpc = *stp + r*(*stx - *stp);
+        } else if (*stp > *stx) {
+            stpc = stpmax;
+        } else {
+            stpc = stpmin;
+        }
+        stpq = *stp + (dp/(dp - *dx))*(*stx - *stp);
+        if (*brackt) {
+            // A minimizer has been bracketed.
+            if (fabs(stpc - *stp) < fabs(stpq - *stp)) {
+                stpf = stpc;
+            } else {
+                stpf = stpq;
+            }
+            if (*stp > *stx) {
+                stpf = min(*stp + p66*(*sty - *stp), stpf);
+            } else {
+                stpf = max(*stp + p66*(*sty - *stp), stpf);
+            }
+        } else {
+            // A minimizer has not been bracketed.
+            if (fabs(stpc - *stp) > fabs(stpq - *stp)) {
+                stpf = stpc;
+            } else {
+                stpf = stpq;
+            }
+            stpf = min(stpmax, stpf);
+            stpf = max(stpmin, stpf);
+        }
+    } else {
+        // Fourth case: a lower function value, derivatives of the same sign,
+        // and the magnitude of the derivative does not decrease.
+        if (*brackt) {
+            theta = three*(fp - *fy)/(*sty - *stp) + *dy + dp;
+            s = max(max(fabs(theta), fabs(*dy)), fabs(dp));
+            gamma = s*sqrt((theta/s)*(theta/s) - (*dy/s)*(dp/s));
+            if (*stp > *sty) {
+                gamma = -gamma;
+            }
+            p = (gamma - dp) + theta;
+            q = ((gamma - dp) + gamma) + *dy;
+            r = p/q;
+            stpc = *stp + r*(*sty - *stp);
+            stpf = stpc;
+        } else if (*stp > *stx) {
+            stpf = stpmax;
+        } else {
+            stpf = stpmin;
+        }
+    }
+
+    // Update the interval which contains a minimizer.
+    if (fp > *fx) {
+        *sty = *stp;
+        *fy = fp;
+        *dy = dp;
+    } else {
+        if (sgnd < 0.0) {
+            *sty = *stx;
+            *fy = *fx;
+            *dy = *dx;
+        }
+        *stx = *stp;
+        *fx = fp;
+        *dx = dp;
+    }
+
+    // Compute the new step.
+    *stp = stpf;
+}
+
+// Moré & Thuente line search, the state is stored in `ls` and `ls->task`
+// is the task (see `DCSRCH_...`).
+static void dcsrch(
+    double f, double g, double* stp, double ftol, double gtol, double xtol,
+    double stpmin, double stpmax, struct lbfgsb_lnsrch* ls)
+{
+    const double p5 = 0.5, p66 = 0.66, xtrapl = 1.1, xtrapu = 4.0;
+
+    if (ls->task == DCSRCH_START) {
+        // Check the input arguments for errors.
+        int error = 0;
+        if (*stp < stpmin) error = 1; // STP .LT. STPMIN
+        if (*stp > stpmax) error = 1; // STP .GT. STPMAX
+        if (g >= 0.0) error = 1;      // INITIAL G .GE. ZERO
+        if (ftol < 0.0) error = 1;    // FTOL .LT. ZERO
+        if (gtol < 0.0) error = 1;    // GTOL .LT. ZERO
+        if (xtol < 0.0) error = 1;    // XTOL .LT. ZERO
+        if (stpmin < 0.0) error = 1;  // STPMIN .LT. ZERO
+        if (stpmax < stpmin) error = 1; // STPMAX .LT. STPMIN
+        if (error) {
+            // Exit if there are errors on input.
+            ls->task = DCSRCH_ERROR;
+            return;
+        }
+
+        // Initialize local variables.
+        ls->brackt = 0;
+        ls->stage = 1;
+        ls->finit = f;
+        ls->ginit = g;
+        ls->gtest = ftol*ls->ginit;
+        ls->width = stpmax - stpmin;
+        ls->width1 = ls->width/p5;
+        ls->stx = 0.0;
+        ls->fx = ls->finit;
+        ls->gx = ls->ginit;
+        ls->sty = 0.0;
+        ls->fy = ls->finit;
+        ls->gy = ls->ginit;
+        ls->stmin = 0.0;
+        ls->stmax = *stp + xtrapu*(*stp);
+        ls->task = DCSRCH_FG;
+        return;
+    }
+
+    // If psi(stp) <= 0 and f'(stp) >= 0 for some step, then the algorithm
+    // enters the second stage.
+    double ftest = ls->finit + (*stp)*ls->gtest;
+    if (ls->stage == 1 && f <= ftest && g >= 0.0) {
+        ls->stage = 2;
+    }
+
+    // Test for warnings.
+    int task = ls->task;
+    if (ls->brackt && (*stp <= ls->stmin || *stp >= ls->stmax)) {
+        task = DCSRCH_WARNING; // ROUNDING ERRORS PREVENT PROGRESS
+    }
+    if (ls->brackt && ls->stmax - ls->stmin <= xtol*ls->stmax) {
+        task = DCSRCH_WARNING; // XTOL TEST SATISFIED
+    }
+    if (*stp == stpmax && f <= ftest && g <= ls->gtest) {
+        task = DCSRCH_WARNING; // STP = STPMAX
+    }
+    if (*stp == stpmin && (f > ftest || g >= ls->gtest)) {
+        task = DCSRCH_WARNING; // STP = STPMIN
+    }
+
+    // Test for convergence.
+    if (f <= ftest && fabs(g) <= gtol*(-ls->ginit)) {
+        task = DCSRCH_CONVERGENCE;
+    }
+
+    // Test for termination.
+    if (task == DCSRCH_WARNING || task == DCSRCH_CONVERGENCE) {
+        ls->task = task;
+        return;
+    }
+
+    // A modified function is used to predict the step during the first stage
+    // if a lower function value has been obtained but the decrease is not
+    // sufficient.
+    if (ls->stage == 1 && f <= ls->fx && f > ftest) {
+        // Define the modified function and derivative values.
+        double fm = f - (*stp)*ls->gtest;
+        double fxm = ls->fx - ls->stx*ls->gtest;
+        double fym = ls->fy - ls->sty*ls->gtest;
+        double gm = g - ls->gtest;
+        double gxm = ls->gx - ls->gtest;
+        double gym = ls->gy - ls->gtest;
+
+        // Call dcstep to update stx, sty, and to compute the new step.
+        dcstep(&ls->stx, &fxm, &gxm, &ls->sty, &fym, &gym, stp, fm, gm,
+               &ls->brackt, ls->stmin, ls->stmax);
+
+        // Reset the function and derivative values for f.
+        ls->fx = fxm + ls->stx*ls->gtest;
+        ls->fy = fym + ls->sty*ls->gtest;
+        ls->gx = gxm + ls->gtest;
+        ls->gy = gym + ls->gtest;
+    } else {
+        // Call dcstep to update stx, sty, and to compute the new step.
+        dcstep(&ls->stx, &ls->fx, &ls->gx, &ls->sty, &ls->fy, &ls->gy, stp,
+               f, g, &ls->brackt, ls->stmin, ls->stmax);
+    }
+
+    // Decide if a bisection step is needed.
+    if (ls->brackt) {
+        if (fabs(ls->sty - ls->stx) >= p66*ls->width1) {
+            *stp = ls->stx + p5*(ls->sty - ls->stx);
+        }
+        ls->width1 = ls->width;
+        ls->width = fabs(ls->sty - ls->stx);
+    }
+
+    // Set the minimum and maximum steps allowed for stp.
+    if (ls->brackt) {
+        ls->stmin = min(ls->stx, ls->sty);
+        ls->stmax = max(ls->stx, ls->sty);
+    } else {
+        ls->stmin = *stp + xtrapl*(*stp - ls->stx);
+        ls->stmax = *stp + xtrapu*(*stp - ls->stx);
+    }
+
+    // Force the step to be within the bounds stpmax and stpmin.
+    *stp = max(*stp, stpmin);
+    *stp = min(*stp, stpmax);
+
+    // If further progress is not possible, let stp be the best point obtained
+    // during the search.
+    if ((ls->brackt && (*stp <= ls->stmin || *stp >= ls->stmax))
+        || (ls->brackt && ls->stmax - ls->stmin <= xtol*ls->stmax)) {
+        *stp = ls->stx;
+    }
+
+    // Obtain another function and derivative.
+    ls->task = DCSRCH_FG;
+}
+
+// Parameters of the line search: sufficient decrease, curvature and relative
+// width of the interval of uncertainty.
+#define LNSRCH_FTOL 1.0e-3
+#define LNSRCH_GTOL 0.9
+#define LNSRCH_XTOL 0.1
+
+// Count a new trial of the line search and set the variables `x` to the
+// trial point at step `w->stp` along `d` from `t` (or to `z` if the step is
+// 1 and `z` is not NULL).
+static void next_trial(
+    lbfgsb_workspace* w, int nt, long n, real x[], const real d[],
+    const real t[], const real z[])
+{
+    ++w->ifun;
+    ++w->nfgv;
+    w->iback = w->ifun - 1;
+    if (w->stp == 1.0 && z != NULL) {
+        lbfgsb_rcopy(nt, n, z, x);
+    } else {
+        double stp = w->stp;
+        int nc = lbfgsb_nthreads(nt, n);
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < n; ++i) {
+            x[i] = stp*d[i] + t[i];
+        }
+    }
+}
+
+// Perform the line search.  If `start` is true, a new line search is
+// started.  Returns true if a new function evaluation is required, false if
+// the line search has terminated.  If `z` is NULL, the trial points are
+// always computed from `d`.
+static int lnsrlb(
+    lbfgsb_workspace* w, int nt, long n, const real l[], const real u[],
+    const integer nbd[], real x[], double f, const real g[],
+    const real d[], real r[], real t[], const real z[], int start)
+{
+    const double big = 1.0e10;
+    if (start) {
+        w->dtd = lbfgsb_rdot(nt, n, d, d);
+        w->dnorm = sqrt(w->dtd);
+
+        // Determine the maximum step length.
+        w->stpmx = big;
+        if (w->cnstnd) {
+            if (w->iter == 0 && !w->warm) {
+                w->stpmx = 1.0;
+            } else {
+                int nc = lbfgsb_nthreads(nt, n);
+                double part[LBFGSB_MAX_THREADS];
+                LBFGSB_PARALLEL_FOR(nc)
+                for (int k = 0; k < nc; ++k) {
+                    long i0, i1;
+                    lbfgsb_chunk(n, nc, k, &i0, &i1);
+                    double stpmx = w->stpmx;
+                    for (long i = i0; i < i1; ++i) {
+                        double a1 = d[i];
+                        if (nbd[i] != 0) {
+                            if (a1 < 0.0 && nbd[i] <= 2) {
+                                double a2 = l[i] - x[i];
+                                if (a2 >= 0.0) {
+                                    stpmx = 0.0;
+                                } else if (a1*stpmx < a2) {
+                                    stpmx = a2/a1;
+                                }
+                            } else if (a1 > 0.0 && nbd[i] >= 2) {
+                                double a2 = u[i] - x[i];
+                                if (a2 <= 0.0) {
+                                    stpmx = 0.0;
+                                } else if (a1*stpmx > a2) {
+                                    stpmx = a2/a1;
+                                }
+                            }
+                        }
+                    }
+                    part[k] = stpmx;
+                }
+                w->stpmx = part[0];
+                for (int k = 1; k < nc; ++k) {
+                    w->stpmx = min(w->stpmx, part[k]);
+                }
+            }
+        }
+        if (w->iter == 0 && !w->warm && !w->boxed) {
+            w->stp = min(1.0/w->dnorm, w->stpmx);
+        } else {
+            w->stp = 1.0;
+        }
+        lbfgsb_rcopy(nt, n, x, t);
+        lbfgsb_rcopy(nt, n, g, r);
+        w->fold = f;
+        w->ifun = 0;
+        w->iback = 0;
+        w->lnsrch.task = DCSRCH_START;
+    }
+    w->gd = lbfgsb_rdot(nt, n, g, d);
+    if (w->ifun == 0) {
+        w->gdold = w->gd;
+        if (w->gd >= 0.0) {
+            // The directional derivative >=0.  Line search is impossible.
+            char buf[32];
+            fprintf(lbfgsb_output(w),
+                    "  ascent direction in projection gd = %s\n",
+                    fmt_list(buf, w->gd));
+            w->info = -4;
+            return 0;
+        }
+    }
+    dcsrch(f, w->gd, &w->stp, LNSRCH_FTOL, LNSRCH_GTOL, LNSRCH_XTOL, 0.0,
+           w->stpmx, &w->lnsrch);
+    w->xstep = w->stp*w->dnorm;
+    if (w->lnsrch.task != DCSRCH_CONVERGENCE &&
+        w->lnsrch.task != DCSRCH_WARNING) {
+        next_trial(w, nt, n, x, d, t, z);
+        return 1;
+    }
+    return 0;
+}
+
+// Continue the line search when only the function value `f` is known at the
+// current trial point and the sufficient decrease condition does not hold.
+// The directional derivative required by dcsrch() is replaced by that of the
+// quadratic interpolating the function and its derivative at the best step
+// `stx` and the function at the trial step, so that the cubic step of
+// dcstep() is the minimum of this quadratic.  Returns as lnsrlb().
+static int lnsrlb_f(
+    lbfgsb_workspace* w, int nt, long n, real x[], double f,
+    const real d[], const real t[], const real z[])
+{
+    const struct lbfgsb_lnsrch* ls = &w->lnsrch;
+    double gd = ls->gx;
+    if (w->stp != ls->stx) {
+        gd = 2*(f - ls->fx)/(w->stp - ls->stx) - ls->gx;
+    }
+    dcsrch(f, gd, &w->stp, LNSRCH_FTOL, LNSRCH_GTOL, LNSRCH_XTOL, 0.0,
+           w->stpmx, &w->lnsrch);
+    w->xstep = w->stp*w->dnorm;
+    if (w->lnsrch.task != DCSRCH_CONVERGENCE &&
+        w->lnsrch.task != DCSRCH_WARNING) {
+        next_trial(w, nt, n, x, d, t, z);
+        return 1;
+    }
+    return 0;
+}
+
+// Set the `ntrials` trials of the speculative line search.  The first one is
+// the trial point `x` at step `w->stp` computed by lnsrlb(), the following
+// steps are successively halved.
+static void make_trials(
+    lbfgsb_workspace* w, int nt, long n, int ntrials, const real x[],
+    const real d[], const real t[])
+{
+    double* stp = w->trial;
+    int nc = lbfgsb_nthreads(nt, n);
+    stp[0] = w->stp;
+    lbfgsb_rcopy(nt, n, x, lbfgsb_trial_vector(w->trial, ntrials, n,
+                                               sizeof(real), 0));
+    for (int j = 1; j < ntrials; ++j) {
+        real* xj = lbfgsb_trial_vector(w->trial, ntrials, n, sizeof(real), j);
+        double s = stp[j] = stp[j-1]/2;
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < n; ++i) {
+            xj[i] = s*d[i] + t[i];
+        }
+    }
+}
+
+// Select, among the trials of the speculative line search, the one that
+// satisfies the convergence test of dcsrch() with the smallest function
+// value.  Returns its index and stores its directional derivative in `w->gd`,
+// or returns -1 if there is none.
+static int pick_trial(
+    lbfgsb_workspace* w, int nt, long n, int ntrials, const real d[])
+{
+    const double* stp = w->trial;
+    const double* f = stp + ntrials;
+    double gtest = LNSRCH_FTOL*w->gdold;
+    int best = -1;
+    for (int j = 0; j < ntrials; ++j) {
+        if (f[j] <= w->fold + stp[j]*gtest &&
+            (best < 0 || f[j] < f[best])) {
+            const real* gj = lbfgsb_trial_vector(w->trial, ntrials, n,
+                                                 sizeof(real), ntrials + j);
+            double gd = lbfgsb_rdot(nt, n, gj, d);
+            if (fabs(gd) <= LNSRCH_GTOL*(-w->gdold)) {
+                best = j;
+                w->gd = gd;
+            }
+        }
+    }
+    return best;
+}
+
+//-----------------------------------------------------------------------------
+// MAIN ALGORITHM
+
+// Measure the duration of a phase of the algorithm and estimate its memory
+// traffic from the number `npass` of passes over vectors of `n` elements (see
+// lbfgsb_get_stats()).  These calls vanish if compiled with LBFGSB_NO_STATS.
+static inline void phase_start(
+    lbfgsb_workspace* w)
+{
+#ifdef LBFGSB_NO_STATS
+    (void)w;
+#else
+    w->wall0 = lbfgsb_clock_ns();
+    w->cpu0 = lbfgsb_cpu_clock_ns();
+#endif
+}
+
+static inline void phase_stop(
+    lbfgsb_workspace* w, lbfgsb_phase p, long n, long npass)
+{
+#ifdef LBFGSB_NO_STATS
+    (void)w;
+    (void)p;
+    (void)n;
+    (void)npass;
+#else
+    w->wall_ns[p] += lbfgsb_clock_ns() - w->wall0;
+    w->cpu_ns[p] += lbfgsb_cpu_clock_ns() - w->cpu0;
+    w->bytes += (int64_t)npass*(int64_t)n*(int64_t)sizeof(real);
+#endif
+}
+
+// Reset the L-BFGS memory after a failure.
+static void reset_memory(
+    lbfgsb_workspace* w)
+{
+    ++w->nreset;
+    w->info = 0;
+    w->col = 0;
+    w->head = 0;
+    w->theta = 1.0;
+    w->iupdat = 0;
+    w->updatd = 0;
+}
+
+static void mainlb(
+    lbfgsb_context* ctx,
+    const real      l[],
+    const real      u[],
+    real            x[],
+    double*         f,
+    real            g[])
+{
+    lbfgsb_workspace* w = &ctx->wrks;
+    const long n = ctx->siz;
+    const long m = ctx->mem;
+    const integer* nbd = w->nbd;
+    const int iprint = ctx->print;
+    FILE* out = lbfgsb_output(w);
+    const int nt = ctx->nthreads;
+    const int nc = lbfgsb_nthreads(nt, n);
+    real* ws = w->ws;
+    real* wy = w->wy;
+    long hinc = w->hinc;
+    long hld = w->hld;
+    double* sy = w->sy;
+    double* ss = w->ss;
+    real* z = w->z;
+    real* r = w->r;
+    real* d = w->d;
+    real* t = w->t;
+    double* wa = w->wa8;
+    FILE* itfile;
+    double time2;
+    int wrk = 0;
+    long k = 0;
+
+    switch (w->stage) {
+    case LBFGSB_STAGE_START:
+        w->epsmch = REAL_EPSILON;
+        w->time1 = lbfgsb_timer();
+        w->wtime1 = lbfgsb_wall_time();
+
+        // Initialize counters and indicators.  A warm start keeps the L-BFGS
+        // memory of the previous optimization, provided its storage layout
+        // is unchanged.
+        w->warm = (w->warm && w->col > 0 && w->layout == ctx->layout);
+        if (!w->warm) {
+            w->col = 0;
+            w->head = 0;
+            w->theta = 1.0;
+            w->iupdat = 0;
+            w->itail = 0;
+        }
+        w->updatd = 0;
+        w->iback = 0;
+        w->iword = 0;
+        w->nact = 0;
+        w->ileave = 0;
+        w->nenter = 0;
+        w->fold = 0.0;
+        w->dnorm = 0.0;
+        w->gd = 0.0;
+        w->stpmx = 0.0;
+        w->sbgnrm = 0.0;
+        w->stp = 0.0;
+        w->gdold = 0.0;
+        w->dtd = 0.0;
+        w->xstep = 0.0;
+        w->iter = 0;
+        w->nfgv = 0;
+        w->nseg = 0;
+        w->nintol = 0;
+        w->nskip = 0;
+        w->nreset = 0;
+        w->nfree = n;
+        w->ifun = 0;
+
+        // For stopping tolerance.
+        w->tol = ctx->factr*w->epsmch;
+
+        // Arrange the storage of the correction history.
+        w->layout = ctx->layout;
+        if (w->layout == LBFGSB_LAYOUT_INTERLEAVED) {
+            w->wy = (real*)w->hist;
+            w->ws = (real*)w->hist + m;
+            w->hinc = 2*m;
+            w->hld = 1;
+        } else {
+            w->ws = (real*)w->hist;
+            w->wy = (real*)w->hist + m*n;
+            w->hinc = 1;
+            w->hld = n;
+        }
+        ws = w->ws;
+        wy = w->wy;
+        hinc = w->hinc;
+        hld = w->hld;
+        if (!w->warm) {
+            touch_vectors(nc, n, m, w);
+        }
+
+        w->info = 0;
+
+        // Write the summary in the stream provided by the caller, if any,
+        // unless the iterations are recorded in a trace.
+        w->itfile = (iprint >= 1 && w->trace == NULL ? w->summary : NULL);
+        itfile = w->itfile;
+
+        // Check the input arguments for errors.
+        int info = 0;
+        const char* mesg = errclb(n, m, ctx->factr, l, u, nbd, &info, &k);
+        if (mesg != NULL) {
+            w->info = info;
+            lbfgsb_set_task_(ctx, LBFGSB_ERROR, LBFGSB_STAGE_DONE, mesg);
+            prn3lb(n, x, *f, w->task, iprint, out, w->info, itfile, w->iter,
+                   w->nfgv, w->nintol, w->nskip, w->nact, w->sbgnrm, 0.0,
+                   w->nseg, w->iword, w->iback, w->stp, w->xstep, k,
+                   0.0, 0.0, 0.0);
+            return;
+        }
+        prn1lb(n, m, l, u, x, iprint, out, itfile, w->epsmch);
+
+        // Initialize iwhere and project x onto the feasible set.
+        active(n, l, u, nbd, x, w->iwhere, iprint, out, &w->prjctd,
+               &w->cnstnd, &w->boxed);
+        if (w->warm) {
+            // The sets of free variables of the previous optimization do not
+            // apply to the new bounds.
+            formk_all_active(n, m, &w->nfree, w->index, sy, ss, w->col,
+                             w->head, w->snd);
+        }
+        break;
+
+    case LBFGSB_STAGE_FG_LNSRCH:
+        itfile = w->itfile;
+        phase_start(w);
+        goto L666;
+
+    case LBFGSB_STAGE_FG_TRIALS:
+        itfile = w->itfile;
+        phase_start(w);
+        goto L668;
+
+    case LBFGSB_STAGE_F_LNSRCH:
+        itfile = w->itfile;
+        phase_start(w);
+        goto L660;
+
+    case LBFGSB_STAGE_G_LNSRCH:
+        itfile = w->itfile;
+        phase_start(w);
+        goto L665;
+
+    case LBFGSB_STAGE_NEW_X:
+        itfile = w->itfile;
+        goto L777;
+
+    case LBFGSB_STAGE_FG_START:
+        itfile = w->itfile;
+        goto L111;
+
+    case LBFGSB_STAGE_STOP_CPU:
+        // Restore the previous iterate.
+        lbfgsb_rcopy(nt, n, t, x);
+        lbfgsb_rcopy(nt, n, r, g);
+        *f = w->fold;
+        /* fall through */
+    case LBFGSB_STAGE_STOP:
+        itfile = w->itfile;
+        goto L999;
+
+    default:
+        break;
+    }
+
+    // Compute f0 and g0.
+    lbfgsb_set_task_(ctx, LBFGSB_FG, LBFGSB_STAGE_FG_START, "FG_START");
+    // Return to the driver to calculate f and g; reenter at 111.
+    return;
+
+  L111:
+    w->nfgv = 1;
+
+    // Compute the infinity norm of the (-) projected gradient.
+    w->sbgnrm = projgr(nt, n, l, u, (w->uncons ? NULL : nbd), x, g);
+    if (w->trace != NULL) {
+        lbfgsb_push_trace(w, *f);
+    }
+    if (iprint >= 1) {
+        char buf1[32], buf2[32];
+        fprintf(out, "\nAt iterate%5ld    f= %s    |proj g|= %s\n",
+                (long)w->iter, fmt_e(buf1, 12, 5, *f, 'D'),
+                fmt_e(buf2, 12, 5, w->sbgnrm, 'D'));
+        if (itfile != NULL) {
+            fprintf(itfile, " %4ld %4ld     -     -   -     -     -        -"
+                    "    %s %s\n", (long)w->iter, (long)w->nfgv,
+                    fmt_e(buf1, 10, 3, w->sbgnrm, 'D'),
+                    fmt_e(buf2, 10, 3, *f, 'D'));
+        }
+    }
+    if (w->sbgnrm <= ctx->pgtol) {
+        // Terminate the algorithm.
+        lbfgsb_set_task_(ctx, LBFGSB_CONVERGENCE, LBFGSB_STAGE_DONE,
+                         "CONVERGENCE: NORM_OF_PROJECTED_GRADIENT_<=_PGTOL");
+        goto L999;
+    }
+
+    // ----------------- the beginning of the loop --------------------------
+  L222:
+    if (iprint >= 99) {
+        fprintf(out, "\n\nITERATION %5ld\n", (long)w->iter + 1);
+    }
+    w->iword = -1;
+    if (w->uncons) {
+        // Compute the search direction by the two-loop recursion.
+        phase_start(w);
+        twoloop(nt, n, m, ws, wy, hinc, hld, sy, w->theta, w->col, w->head,
+                g, d, wa);
+        phase_stop(w, LBFGSB_PHASE_SUBSPACE, n, 10*w->col + 4);
+        w->iword = (w->col > 0 ? 0 : -1);
+        w->nseg = 0;
+        goto L555;
+    }
+    if (!w->cnstnd && w->col > 0) {
+        // Skip the search for GCP.
+        lbfgsb_rcopy(nt, n, x, z);
+        wrk = w->updatd;
+        w->nseg = 0;
+        goto L333;
+    }
+
+    // Compute the Generalized Cauchy Point (GCP).
+    phase_start(w);
+    w->info = cauchy(nt, n, x, l, u, nbd, g, w->indx2, w->iwhere, t, d, z,
+                     m, wy, ws, hinc, hld, sy, w->wt, w->theta, w->col,
+                     w->head, &wa[0], &wa[2*m], &wa[4*m], &wa[6*m], w->part,
+                     &w->nseg, iprint, out, w->sbgnrm, w->epsmch);
+    if (w->info != 0) {
+        // Singular triangular system detected; refresh the lbfgs memory.
+        if (iprint >= 1) {
+            fprintf(out, "\n Singular triangular system detected;\n"
+                    "   refresh the lbfgs memory and restart the "
+                    "iteration.\n");
+        }
+        reset_memory(w);
+        phase_stop(w, LBFGSB_PHASE_CAUCHY, n, 2*w->col + 8);
+        goto L222;
+    }
+    phase_stop(w, LBFGSB_PHASE_CAUCHY, n, 2*w->col + 8);
+    w->nintol += w->nseg;
+
+    // Count the entering and leaving variables for iter > 0; find the index
+    // set of free and active variables at the GCP.
+    wrk = freev(n, &w->nfree, w->index, &w->nenter, &w->ileave, w->indx2,
+                w->iwhere, w->updatd, w->cnstnd, iprint, out, w->iter,
+                w->warm);
+    w->nact = n - w->nfree;
+
+  L333:
+    // If there are no free variables or B=theta*I, then skip the subspace
+    // minimization.
+    if (w->nfree == 0 || w->col == 0) {
+        goto L555;
+    }
+
+    // Subspace minimization.
+    phase_start(w);
+
+    // Form the LEL^T factorization of the indefinite matrix
+    //
+    //   K = [-D -Y'ZZ'Y/theta     L_a'-R_z'  ]
+    //       [L_a -R_z           theta*S'AA'S ]
+    //
+    // where E = [-I  0]
+    //           [ 0  I]
+    if (wrk) {
+        w->info = formk(n, w->nfree, w->index, w->nenter, w->ileave,
+                        w->indx2, w->updatd, w->wn, w->snd, m, ws, wy, hinc,
+                        hld, sy, w->theta, w->col, w->head, &wa[4*m]);
+    }
+    if (w->info != 0) {
+        // Nonpositive definiteness in Cholesky factorization; refresh the
+        // lbfgs memory and restart the iteration.
+        if (iprint >= 1) {
+            fprintf(out, "\n Nonpositive definiteness in Cholesky "
+                    "factorization in formk;\n"
+                    "   refresh the lbfgs memory and restart the "
+                    "iteration.\n");
+        }
+        reset_memory(w);
+        phase_stop(w, LBFGSB_PHASE_SUBSPACE, n, 6*w->col + 10);
+        goto L222;
+    }
+
+    // Compute r=-Z'B(xcp-xk)-Z'g (using wa(2m+1)=W'(xcp-x) from cauchy).
+    w->info = cmprlb(nt, n, m, x, g, ws, wy, hinc, hld, sy, w->wt, z, r,
+                     wa, w->index, w->theta, w->col, w->head, w->nfree,
+                     w->cnstnd);
+    if (w->info != 0) {
+        goto L444;
+    }
+
+    // Call the direct method.
+    w->info = subsm(nt, n, m, w->nfree, w->index, l, u, nbd, z, r, w->xp, ws,
+                    wy, hinc, hld, w->theta, x, g, w->col, w->head, &w->iword,
+                    wa, &wa[2*m], w->part, w->wn, iprint, out);
+  L444:
+    if (w->info != 0) {
+        // Singular triangular system detected; refresh the lbfgs memory and
+        // restart the iteration.
+        if (iprint >= 1) {
+            fprintf(out, "\n Singular triangular system detected;\n"
+                    "   refresh the lbfgs memory and restart the "
+                    "iteration.\n");
+        }
+        reset_memory(w);
+        phase_stop(w, LBFGSB_PHASE_SUBSPACE, n, 6*w->col + 10);
+        goto L222;
+    }
+    phase_stop(w, LBFGSB_PHASE_SUBSPACE, n, 6*w->col + 10);
+
+  L555:
+    // Generate the search direction d := z - x.
+    if (!w->uncons) {
+        LBFGSB_PARALLEL_FOR(nc)
+        for (long i = 0; i < n; ++i) {
+            d[i] = z[i] - x[i];
+        }
+    }
+    phase_start(w);
+    int start = 1;
+    goto L667;
+
+  L666:
+    start = 0;
+  L667:
+    if (lnsrlb(w, nt, n, l, u, nbd, x, *f, g, d, r, t,
+               (w->uncons ? NULL : z), start)) {
+        if (start && ctx->trials > 1 &&
+            (ctx->maxeval < 0 ||
+             w->nfgv + ctx->trials - 1 <= ctx->maxeval)) {
+            // Return to the driver for calculating f and g at all the trial
+            // points; reenter at 668.
+            make_trials(w, nt, n, ctx->trials, x, d, t);
+            phase_stop(w, LBFGSB_PHASE_LNSRCH, n, 3*ctx->trials + 5);
+            lbfgsb_set_task_(ctx, LBFGSB_FG_TRIALS, LBFGSB_STAGE_FG_TRIALS,
+                             "FG_TRIALS");
+            return;
+        }
+        goto L670;
+    }
+    goto L669;
+
+  L660:
+    // Only f is known at the trial point.  Request g if the sufficient
+    // decrease condition holds, otherwise reject the trial point.
+    if (*f <= w->lnsrch.finit + w->stp*w->lnsrch.gtest) {
+        // Return to the driver for calculating g; reenter at 665.
+        phase_stop(w, LBFGSB_PHASE_LNSRCH, n, 0);
+        lbfgsb_set_task_(ctx, LBFGSB_G, LBFGSB_STAGE_G_LNSRCH, "G_LNSRCH");
+        return;
+    }
+    if (lnsrlb_f(w, nt, n, x, *f, d, t, (w->uncons ? NULL : z))) {
+        goto L670;
+    }
+    // The line search has terminated at the trial point whose gradient is
+    // still needed; reenter at 665.
+    phase_stop(w, LBFGSB_PHASE_LNSRCH, n, 0);
+    lbfgsb_set_task_(ctx, LBFGSB_G, LBFGSB_STAGE_G_LNSRCH, "G_LNSRCH");
+    return;
+
+  L665:
+    if (w->lnsrch.task == DCSRCH_CONVERGENCE ||
+        w->lnsrch.task == DCSRCH_WARNING) {
+        w->gd = lbfgsb_rdot(nt, n, g, d);
+        goto L669;
+    }
+    goto L666;
+
+  L670:
+    phase_stop(w, LBFGSB_PHASE_LNSRCH, n, 5);
+    if (ctx->maxeval >= 0 && w->nfgv > ctx->maxeval) {
+        // Do not exceed the maximum number of evaluations, restore the
+        // previous iterate.
+        --w->nfgv;
+        --w->ifun;
+        w->iback = max(w->ifun - 1, 0);
+        lbfgsb_rcopy(nt, n, t, x);
+        lbfgsb_rcopy(nt, n, r, g);
+        *f = w->fold;
+        lbfgsb_set_task_(ctx, LBFGSB_WARNING, LBFGSB_STAGE_DONE,
+                         "WARNING: TOO_MANY_EVALUATIONS");
+        goto L999;
+    }
+    if (ctx->lazy) {
+        // Return to the driver for calculating f; reenter at 660.
+        lbfgsb_set_task_(ctx, LBFGSB_F, LBFGSB_STAGE_F_LNSRCH, "F_LNSRCH");
+    } else {
+        // Return to the driver for calculating f and g; reenter at 666.
+        lbfgsb_set_task_(ctx, LBFGSB_FG, LBFGSB_STAGE_FG_LNSRCH,
+                         "FG_LNSRCH");
+    }
+    return;
+
+  L668:
+    // Accept the best trial of the speculative line search.  If it is the
+    // first one or if there is none, resume the line search at the first
+    // trial for which f and g have been computed as if requested alone.
+    w->nfgv += ctx->trials - 1;
+    int best = pick_trial(w, nt, n, ctx->trials, d);
+    int j = (best > 0 ? best : 0);
+    const double* trial = w->trial;
+    *f = trial[ctx->trials + j];
+    lbfgsb_rcopy(nt, n, lbfgsb_trial_vector(w->trial, ctx->trials, n,
+                                            sizeof(real), j), x);
+    lbfgsb_rcopy(nt, n, lbfgsb_trial_vector(w->trial, ctx->trials, n,
+                                            sizeof(real), ctx->trials + j), g);
+    if (best <= 0) {
+        goto L666;
+    }
+    w->stp = trial[j];
+    w->xstep = w->stp*w->dnorm;
+    w->iback = j;
+
+  L669:
+    phase_stop(w, LBFGSB_PHASE_LNSRCH, n, 2);
+    if (w->info != 0 || w->iback >= 20) {
+        // Restore the previous iterate.
+        lbfgsb_rcopy(nt, n, t, x);
+        lbfgsb_rcopy(nt, n, r, g);
+        *f = w->fold;
+        if (w->col == 0) {
+            // Abnormal termination.
+            if (w->info == 0) {
+                w->info = -9;
+                // Restore the actual number of f and g evaluations etc.
+                --w->nfgv;
+                --w->ifun;
+                --w->iback;
+            }
+            lbfgsb_set_task_(ctx, LBFGSB_ERROR, LBFGSB_STAGE_DONE,
+                             "ABNORMAL_TERMINATION_IN_LNSRCH");
+            ++w->iter;
+            goto L999;
+        } else {
+            // Refresh the lbfgs memory and restart the iteration.
+            if (iprint >= 1) {
+                fprintf(out, "\n Bad direction in the line search;\n"
+                        "   refresh the lbfgs memory and restart the "
+                        "iteration.\n");
+            }
+            if (w->info == 0) {
+                --w->nfgv;
+            }
+            reset_memory(w);
+            goto L222;
+        }
+    } else {
+        // Calculate and print out the quantities related to the new X.
+        ++w->iter;
+
+        // Compute the infinity norm of the projected (-)gradient.
+        w->sbgnrm = projgr(nt, n, l, u, (w->uncons ? NULL : nbd), x, g);
+
+        // Print iteration information.
+        prn2lb(n, x, *f, g, iprint, out, itfile, w->iter, w->nfgv, w->nact,
+               w->sbgnrm, w->nseg, w->iword, w->iback, w->stp, w->xstep);
+        if (w->trace != NULL) {
+            lbfgsb_push_trace(w, *f);
+        }
+        lbfgsb_set_task_(ctx, LBFGSB_NEW_X, LBFGSB_STAGE_NEW_X, "NEW_X");
+        return;
+    }
+
+  L777:
+    // Test for termination.
+    if (w->sbgnrm <= ctx->pgtol) {
+        lbfgsb_set_task_(ctx, LBFGSB_CONVERGENCE, LBFGSB_STAGE_DONE,
+                         "CONVERGENCE: NORM_OF_PROJECTED_GRADIENT_<=_PGTOL");
+        goto L999;
+    }
+    double ddum = max(max(fabs(w->fold), fabs(*f)), 1.0);
+    if ((w->fold - *f) <= w->tol*ddum) {
+        lbfgsb_set_task_(ctx, LBFGSB_CONVERGENCE, LBFGSB_STAGE_DONE,
+                         "CONVERGENCE: REL_REDUCTION_OF_F_<=_FACTR*EPSMCH");
+        if (w->iback >= 10) {
+            w->info = -5;
+        }
+        // i.e., to issue a warning if iback>10 in the line search.
+        goto L999;
+    }
+    if (*f <= ctx->fatol) {
+        lbfgsb_set_task_(ctx, LBFGSB_CONVERGENCE, LBFGSB_STAGE_DONE,
+                         "CONVERGENCE: F_<=_FATOL");
+        goto L999;
+    }
+    if (ctx->xatol > 0.0 || ctx->xrtol > 0.0) {
+        // The norm of the step x - t is that of stp*d.
+        double xtol = ctx->xatol;
+        if (ctx->xrtol > 0.0) {
+            xtol = max(xtol, ctx->xrtol*sqrt(lbfgsb_rdot(nt, n, x, x)));
+        }
+        if (w->xstep <= xtol) {
+            lbfgsb_set_task_(ctx, LBFGSB_CONVERGENCE, LBFGSB_STAGE_DONE,
+                             "CONVERGENCE: NORM_OF_STEP_<=_XTOL");
+            goto L999;
+        }
+    }
+    if (ctx->maxiter >= 0 && w->iter >= ctx->maxiter) {
+        lbfgsb_set_task_(ctx, LBFGSB_WARNING, LBFGSB_STAGE_DONE,
+                         "WARNING: TOO_MANY_ITERATIONS");
+        goto L999;
+    }
+    if (ctx->maxeval >= 0 && w->nfgv >= ctx->maxeval) {
+        lbfgsb_set_task_(ctx, LBFGSB_WARNING, LBFGSB_STAGE_DONE,
+                         "WARNING: TOO_MANY_EVALUATIONS");
+        goto L999;
+    }
+    if (lbfgsb_wall_time() - w->wtime1 > ctx->deadline) {
+        lbfgsb_set_task_(ctx, LBFGSB_WARNING, LBFGSB_STAGE_DONE,
+                         "WARNING: DEADLINE_REACHED");
+        goto L999;
+    }
+
+    // Compute d=newx-oldx, r=newg-oldg, rr=y'y and dr=y's.
+    phase_start(w);
+    LBFGSB_PARALLEL_FOR(nc)
+    for (long i = 0; i < n; ++i) {
+        r[i] = g[i] - r[i];
+    }
+    double rr = lbfgsb_rdot(nt, n, r, r);
+    double dr;
+    if (w->stp == 1.0) {
+        dr = w->gd - w->gdold;
+        ddum = -w->gdold;
+    } else {
+        dr = (w->gd - w->gdold)*w->stp;
+        lbfgsb_rscal(nt, n, w->stp, d);
+        ddum = -w->gdold*w->stp;
+    }
+    if (dr <= w->epsmch*ddum) {
+        // Skip the L-BFGS update.
+        ++w->nskip;
+        w->updatd = 0;
+        if (iprint >= 1) {
+            char buf1[32], buf2[32];
+            fprintf(out, "  ys=%s  -gs=%s BFGS update SKIPPED\n",
+                    fmt_e(buf1, 10, 3, dr, 'E'),
+                    fmt_e(buf2, 10, 3, ddum, 'E'));
+        }
+        goto L888;
+    }
+
+    // Update the L-BFGS matrix.
+    w->updatd = 1;
+    ++w->iupdat;
+
+    // Update matrices WS and WY and form the middle matrix in B.
+    matupd(nt, n, m, ws, wy, hinc, hld, sy, ss, d, r, &w->itail, w->iupdat,
+           &w->col, &w->head, &w->theta, rr, dr, w->stp, w->dtd, wa,
+           w->part, w->hsiz > 0);
+
+    // Form the upper half of the pds T = theta*SS + L*D^(-1)*L'; store T in
+    // the upper triangular of the array wt; Cholesky factorize T to J*J'
+    // with J' stored in the upper triangular of wt.
+    w->info = formt(m, w->wt, sy, ss, w->col, w->head, w->theta);
+    if (w->info != 0) {
+        // Nonpositive definiteness in Cholesky factorization; refresh the
+        // lbfgs memory and restart the iteration.
+        if (iprint >= 1) {
+            fprintf(out, "\n Nonpositive definiteness in Cholesky "
+                    "factorization in formt;\n"
+                    "   refresh the lbfgs memory and restart the "
+                    "iteration.\n");
+        }
+        reset_memory(w);
+        phase_stop(w, LBFGSB_PHASE_UPDATE, n, 4*w->col + 10);
+        goto L222;
+    }
+
+    // Now the inverse of the middle matrix in B is
+    //
+    //   [  D^(1/2)      O ] [ -D^(1/2)  D^(-1/2)*L' ]
+    //   [ -L*D^(-1/2)   J ] [  0        J'          ]
+  L888:
+    phase_stop(w, LBFGSB_PHASE_UPDATE, n, 4*w->col + 10);
+    // -------------------- the end of the loop -----------------------------
+    goto L222;
+
+  L999:
+    time2 = lbfgsb_timer();
+    prn3lb(n, x, *f, w->task, iprint, out, w->info, itfile, w->iter,
+           w->nfgv, w->nintol, w->nskip, w->nact, w->sbgnrm, time2 - w->time1,
+           w->nseg, w->iword, w->iback, w->stp, w->xstep, k,
+           LBFGSB_CAUCHY_TIME(ctx), LBFGSB_SUBSPACE_TIME(ctx),
+           LBFGSB_LNSRCH_TIME(ctx));
+}
+
+// Run the algorithm until the next request to the caller and account for the
+// time spent in the engine and by the caller since the previous return.
+void lbfgsb_mainlb(
+    lbfgsb_context* ctx,
+    const real      l[],
+    const real      u[],
+    real            x[],
+    double*         f,
+    real            g[])
+{
+#ifdef LBFGSB_NO_STATS
+    mainlb(ctx, l, u, x, f, g);
+#else
+    lbfgsb_workspace* w = &ctx->wrks;
+    int64_t wall = lbfgsb_clock_ns();
+    int64_t cpu = lbfgsb_cpu_clock_ns();
+    if (w->stage == LBFGSB_STAGE_START) {
+        memset(w->wall_ns, 0, sizeof(w->wall_ns));
+        memset(w->cpu_ns, 0, sizeof(w->cpu_ns));
+        w->bytes = 0;
+    } else {
+        w->wall_ns[LBFGSB_PHASE_CALLER] += wall - w->wall_exit;
+        w->cpu_ns[LBFGSB_PHASE_CALLER] += cpu - w->cpu_exit;
+    }
+    mainlb(ctx, l, u, x, f, g);
+    w->wall_exit = lbfgsb_clock_ns();
+    w->cpu_exit = lbfgsb_cpu_clock_ns();
+    w->wall_ns[LBFGSB_PHASE_ENGINE] += w->wall_exit - wall;
+    w->cpu_ns[LBFGSB_PHASE_ENGINE] += w->cpu_exit - cpu;
+#endif
+}
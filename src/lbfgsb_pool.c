@@ -0,0 +1,400 @@
+// lbfgsb_pool.c -
+//
+// Pool of worker threads solving independent optimization jobs (see
+// lbfgsb_pool_create() in "lbfgsb.h").  Each worker has a double-ended queue
+// of jobs: it pushes and pops the jobs it runs at the bottom of its own queue
+// and, when this queue is empty, steals the job at the top (the oldest one)
+// of the queue of another worker.  A job runs for one iteration of the
+// reverse communication loop at a time, so a worker with a long job in its
+// queue gives the other jobs of its queue to idle workers after at most one
+// iteration.  The queues, the counters and the statistics are protected by a
+// single mutex which is taken once per iteration of a job; this is cheap
+// compared to an iteration, which costs at least one evaluation of the
+// objective function and a few passes over the variables.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lbfgsb_private.h"
+
+typedef struct pool_job {
+    lbfgsb_context*    ctx;
+    double*            x;
+    double*            g;
+    lbfgsb_fg_callback fg;
+    void*              data;
+    double             f;
+    double             latest;  // Value of `f` at the latest iterate.
+    lbfgsb_status      status;  // Status of the context when finished.
+    int                done;
+    long               iters;
+    long               evals;
+    long               steals;
+    int64_t            submit_ns;
+    int64_t            finish_ns;
+    int64_t            run_ns;
+    int64_t            fg_ns;
+} pool_job;
+
+// Double-ended queue of a worker, a ring of `cap` slots with the jobs at
+// indices `top` (the oldest) to `bot - 1` (the latest) modulo `cap`.
+typedef struct pool_deque {
+    lbfgsb_pool* pool;
+    int          index;
+    pthread_t    thread;
+    pool_job**   ring;
+    long         cap;
+    long         top;
+    long         bot;
+} pool_deque;
+
+struct lbfgsb_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;     // Signaled when a job is queued.
+    pthread_cond_t  idle;     // Broadcast when no jobs are active.
+    int             nworkers;
+    int             started;  // Number of started workers.
+    int             shutdown;
+    long            queued;   // Number of jobs in the queues.
+    long            active;   // Number of unfinished jobs.
+    long            next;     // Worker to receive the next job.
+    long            njobs;
+    long            capacity;
+    pool_job**      jobs;
+    pool_deque*     deques;
+    long            done;
+    long            iters;
+    long            evals;
+    long            steals;
+    int64_t         busy_ns;
+    int64_t         first_ns; // Time of the first submission.
+    int64_t         last_ns;  // Time of the latest completion.
+};
+
+// Push a job at the bottom of a queue.  Called with the lock held.
+static int push_job(
+    pool_deque* q,
+    pool_job*   job)
+{
+    if (q->bot - q->top >= q->cap) {
+        long cap = (q->cap < 16 ? 16 : 2*q->cap);
+        pool_job** ring = malloc(cap*sizeof(pool_job*));
+        if (ring == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        for (long i = q->top; i < q->bot; ++i) {
+            ring[i - q->top] = q->ring[i%q->cap];
+        }
+        free(q->ring);
+        q->ring = ring;
+        q->cap = cap;
+        q->bot -= q->top;
+        q->top = 0;
+    }
+    q->ring[q->bot%q->cap] = job;
+    ++q->bot;
+    ++q->pool->queued;
+    return 0;
+}
+
+// Take a job for the worker of queue `q`: the latest job of its own queue or
+// else the oldest job of another queue.  Called with the lock held and at
+// least one job queued.
+static pool_job* take_job(
+    pool_deque* q)
+{
+    lbfgsb_pool* pool = q->pool;
+    pool_job* job = NULL;
+    if (q->bot > q->top) {
+        --q->bot;
+        job = q->ring[q->bot%q->cap];
+    } else {
+        for (int i = 1; i < pool->nworkers; ++i) {
+            pool_deque* v = &pool->deques[(q->index + i)%pool->nworkers];
+            if (v->bot > v->top) {
+                job = v->ring[v->top%v->cap];
+                ++v->top;
+                ++job->steals;
+                ++pool->steals;
+                break;
+            }
+        }
+    }
+    --pool->queued;
+    return job;
+}
+
+static void* run_worker(
+    void* arg)
+{
+    pool_deque* q = arg;
+    lbfgsb_pool* pool = q->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->queued == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->queued == 0) {
+            break;
+        }
+        pool_job* job = take_job(q);
+        pthread_mutex_unlock(&pool->lock);
+
+        // Run one iteration of the job.
+        lbfgsb_context* ctx = job->ctx;
+        int64_t t0 = lbfgsb_clock_ns();
+        int64_t fg_ns = 0;
+        long evals = 0;
+        lbfgsb_task task;
+        while (1) {
+            task = lbfgsb_iterate(ctx, job->x, &job->f, job->g);
+            if (task != LBFGSB_FG && task != LBFGSB_FG_TRIALS &&
+                task != LBFGSB_F && task != LBFGSB_G) {
+                break;
+            }
+            int64_t t1 = lbfgsb_clock_ns();
+            int k = lbfgsb_evaluate(ctx, job->x, &job->f, job->g,
+                                    job->fg, job->data);
+            fg_ns += lbfgsb_clock_ns() - t1;
+            evals += (k < 0 ? 1 : k);
+        }
+        int64_t t2 = lbfgsb_clock_ns();
+
+        pthread_mutex_lock(&pool->lock);
+        job->run_ns += t2 - t0;
+        job->fg_ns += fg_ns;
+        job->evals += evals;
+        pool->busy_ns += t2 - t0;
+        pool->evals += evals;
+        job->latest = job->f;
+        if (task == LBFGSB_NEW_X) {
+            ++job->iters;
+            ++pool->iters;
+            if (push_job(q, job) == 0) {
+                continue;
+            }
+            // Not enough memory to queue the job again.
+            lbfgsb_set_task_(ctx, LBFGSB_ERROR, LBFGSB_STAGE_DONE,
+                             "ERROR: NOT ENOUGH MEMORY");
+        }
+        job->status = lbfgsb_get_status(ctx);
+        job->done = 1;
+        job->finish_ns = t2;
+        pool->last_ns = t2;
+        ++pool->done;
+        if (--pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+lbfgsb_pool* lbfgsb_pool_create(
+    int nworkers)
+{
+    if (nworkers < 1) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = (ncpus < 1 ? 1 : ncpus > LBFGSB_MAX_THREADS ?
+                    LBFGSB_MAX_THREADS : (int)ncpus);
+    } else if (nworkers > LBFGSB_MAX_THREADS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    lbfgsb_pool* pool = calloc(1, sizeof(lbfgsb_pool));
+    pool_deque* deques = calloc(nworkers, sizeof(pool_deque));
+    if (pool == NULL || deques == NULL) {
+        free(pool);
+        free(deques);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pool->nworkers = nworkers;
+    pool->deques = deques;
+    for (int k = 0; k < nworkers; ++k) {
+        deques[k].pool = pool;
+        deques[k].index = k;
+        int code = pthread_create(&deques[k].thread, NULL, run_worker,
+                                  &deques[k]);
+        if (code != 0) {
+            lbfgsb_pool_destroy(pool);
+            errno = code;
+            return NULL;
+        }
+        pool->started = k + 1;
+    }
+    return pool;
+}
+
+void lbfgsb_pool_destroy(
+    lbfgsb_pool* pool)
+{
+    if (pool != NULL) {
+        lbfgsb_pool_wait(pool);
+        pthread_mutex_lock(&pool->lock);
+        pool->shutdown = 1;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+        for (int k = 0; k < pool->started; ++k) {
+            pthread_join(pool->deques[k].thread, NULL);
+        }
+        for (int k = 0; k < pool->nworkers; ++k) {
+            free(pool->deques[k].ring);
+        }
+        for (long i = 0; i < pool->njobs; ++i) {
+            free(pool->jobs[i]);
+        }
+        pthread_cond_destroy(&pool->idle);
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->jobs);
+        free(pool->deques);
+        free(pool);
+    }
+}
+
+long lbfgsb_pool_submit(
+    lbfgsb_pool*       pool,
+    lbfgsb_context*    ctx,
+    double             x[],
+    double             g[],
+    lbfgsb_fg_callback fg,
+    void*              data)
+{
+    if (fg == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    pool_job* job = calloc(1, sizeof(pool_job));
+    if (job == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    job->ctx = ctx;
+    job->x = x;
+    job->g = g;
+    job->fg = fg;
+    job->data = data;
+    job->f = NAN;
+    job->latest = NAN;
+    job->submit_ns = lbfgsb_clock_ns();
+    pthread_mutex_lock(&pool->lock);
+    // The context of an unfinished job belongs to a worker, its task must not
+    // even be read.
+    int owned = 0;
+    for (long i = 0; i < pool->njobs && !owned; ++i) {
+        owned = (pool->jobs[i]->ctx == ctx && !pool->jobs[i]->done);
+    }
+    if (owned || ctx->task != LBFGSB_START) {
+        pthread_mutex_unlock(&pool->lock);
+        free(job);
+        errno = EINVAL;
+        return -1;
+    }
+    if (pool->njobs >= pool->capacity) {
+        long capacity = (pool->capacity < 16 ? 16 : 2*pool->capacity);
+        pool_job** jobs = realloc(pool->jobs, capacity*sizeof(pool_job*));
+        if (jobs == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            free(job);
+            errno = ENOMEM;
+            return -1;
+        }
+        pool->jobs = jobs;
+        pool->capacity = capacity;
+    }
+    if (push_job(&pool->deques[pool->next], job) != 0) {
+        pthread_mutex_unlock(&pool->lock);
+        free(job);
+        return -1;
+    }
+    pool->next = (pool->next + 1)%pool->nworkers;
+    if (pool->njobs == 0) {
+        pool->first_ns = job->submit_ns;
+    }
+    long id = pool->njobs++;
+    pool->jobs[id] = job;
+    ++pool->active;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return id;
+}
+
+long lbfgsb_pool_wait(
+    lbfgsb_pool* pool)
+{
+    long failures = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    for (long i = 0; i < pool->njobs; ++i) {
+        lbfgsb_status status = pool->jobs[i]->status;
+        if (status == LBFGSB_STOPPED || status == LBFGSB_FAILURE) {
+            ++failures;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return failures;
+}
+
+int lbfgsb_pool_get_job_stats(
+    lbfgsb_pool*      pool,
+    long              id,
+    lbfgsb_job_stats* stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (id < 0 || id >= pool->njobs) {
+        pthread_mutex_unlock(&pool->lock);
+        errno = EINVAL;
+        return -1;
+    }
+    const pool_job* job = pool->jobs[id];
+    int64_t end = (job->done ? job->finish_ns : lbfgsb_clock_ns());
+    // The context of a finished job may have been destroyed or submitted
+    // again, so only the status recorded when the job finished is used.
+    stats->status = (job->done ? job->status : LBFGSB_RUNNING);
+    stats->f = job->latest;
+    stats->iters = job->iters;
+    stats->evals = job->evals;
+    stats->steals = job->steals;
+    stats->wall_ns = end - job->submit_ns;
+    stats->run_ns = job->run_ns;
+    stats->fg_ns = job->fg_ns;
+    stats->iter_rate = (job->run_ns > 0 ?
+                        1e9*(double)job->iters/(double)job->run_ns : 0.0);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void lbfgsb_pool_get_stats(
+    lbfgsb_pool*       pool,
+    lbfgsb_pool_stats* stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    int64_t end = (pool->active > 0 ? lbfgsb_clock_ns() : pool->last_ns);
+    int64_t wall = (pool->njobs > 0 ? end - pool->first_ns : 0);
+    stats->workers = pool->nworkers;
+    stats->jobs = pool->njobs;
+    stats->done = pool->done;
+    stats->iters = pool->iters;
+    stats->evals = pool->evals;
+    stats->steals = pool->steals;
+    stats->wall_ns = wall;
+    stats->busy_ns = pool->busy_ns;
+    stats->job_rate = (wall > 0 ? 1e9*(double)pool->done/(double)wall : 0.0);
+    stats->iter_rate = (wall > 0 ? 1e9*(double)pool->iters/(double)wall :
+                        0.0);
+    stats->utilization = (wall > 0 ? (double)pool->busy_ns/
+                          ((double)wall*(double)pool->nworkers) : 0.0);
+    pthread_mutex_unlock(&pool->lock);
+}
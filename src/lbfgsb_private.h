@@ -0,0 +1,211 @@
+// lbfgsb_private.h -
+//
+// Private definitions shared by the C implementation of L-BFGS-B.
+//
+//-----------------------------------------------------------------------------
+//
+// See LICENSE.md for details.
+
+#ifndef LBFGSB_PRIVATE_H
+#define LBFGSB_PRIVATE_H 1
+
+#include "lbfgsb.h"
+
+/*
+ * Stages of the reverse communication driven algorithm.  These replace the
+ * leading characters of the `task` string that were tested by the FORTRAN
+ * code to decide where to resume the algorithm.
+ */
+typedef enum {
+    LBFGSB_STAGE_START = 0, // "START"
+    LBFGSB_STAGE_FG_START,  // "FG_START"
+    LBFGSB_STAGE_FG_LNSRCH, // "FG_LNSRCH"
+    LBFGSB_STAGE_NEW_X,     // "NEW_X"
+    LBFGSB_STAGE_STOP,      // "STOP..."
+    LBFGSB_STAGE_STOP_CPU,  // "STOP: CPU..."
+    LBFGSB_STAGE_DONE,      // "CONVERGENCE...", "ERROR...", etc.
+    LBFGSB_STAGE_FG_TRIALS, // "FG_TRIALS"
+    LBFGSB_STAGE_F_LNSRCH,  // "F_LNSRCH"
+    LBFGSB_STAGE_G_LNSRCH,  // "G_LNSRCH"
+} lbfgsb_stage;
+
+/*
+ * Set the task, the stage and the task message of a context.  The message is
+ * stored padded with spaces as was the FORTRAN task string.
+ */
+extern void lbfgsb_set_task_(
+    lbfgsb_context* ctx,
+    lbfgsb_task     task,
+    lbfgsb_stage    stage,
+    const char*     mesg);
+
+/*
+ * Wall-clock time (in seconds) since an arbitrary origin, for the deadline
+ * of an optimization.
+ */
+extern double lbfgsb_wall_time(void);
+
+/*
+ * Monotonic wall-clock time and CPU time of the process in nanoseconds since
+ * an arbitrary origin, for the performance statistics (see
+ * lbfgsb_get_stats()).
+ */
+extern int64_t lbfgsb_clock_ns(void);
+extern int64_t lbfgsb_cpu_clock_ns(void);
+
+/*
+ * Store a record of the current iterate, whose objective function is `f`,
+ * in the trace of the workspace `w`, which must have one (see
+ * lbfgsb_set_trace()).
+ */
+extern void lbfgsb_push_trace(lbfgsb_workspace* w, double f);
+
+/*
+ * Compute with the callback `fg` what the task of the context `ctx` requests
+ * (the function and its gradient at `x` for `LBFGSB_FG`, the function alone
+ * with `g = NULL` for `LBFGSB_F`, the gradient alone with `f = NULL` for
+ * `LBFGSB_G` or both at each trial point for `LBFGSB_FG_TRIALS`).  If the
+ * callback fails, the task is set to `LBFGSB_STOP` so that the next call to
+ * lbfgsb_iterate() terminates the algorithm at the previous iterate.  Yields
+ * the number of calls to the callback (0 if the task is not an evaluation)
+ * or -1 on failure.
+ */
+extern int lbfgsb_evaluate(
+    lbfgsb_context*    ctx,
+    double             x[],
+    double*            f,
+    double             g[],
+    lbfgsb_fg_callback fg,
+    void*              data);
+
+/*
+ * Stream for the messages of the engine (see lbfgsb_set_output()).
+ */
+static inline FILE* lbfgsb_output(const lbfgsb_workspace* w)
+{
+    return (w->output != NULL ? (FILE*)w->output : stdout);
+}
+
+/*
+ * Multi-threading.  When the library is compiled with OpenMP, the passes over
+ * the variables use up to `nt` threads (the value set by lbfgsb_set_threads).
+ * A pass over `n` elements is split in lbfgsb_nthreads(nt,n) contiguous
+ * chunks given by lbfgsb_chunk(), and the partial results of reductions are
+ * combined in the order of the chunks.  Hence results only depend on the
+ * number of chunks and are the same as the sequential ones for a single
+ * chunk.  Without OpenMP, LBFGSB_OMP(...) expands to nothing and there is
+ * always a single chunk.
+ */
+#ifdef _OPENMP
+#  include <omp.h>
+#  define LBFGSB_OMP(args) _Pragma(#args)
+#else
+#  define LBFGSB_OMP(args)
+#endif
+
+// Split the iterations of the following loop across `nc` threads.
+#ifdef _OPENMP
+#  define LBFGSB_PARALLEL_FOR(nc) \
+    LBFGSB_OMP(omp parallel for num_threads(nc) schedule(static) if((nc) > 1))
+#else
+#  define LBFGSB_PARALLEL_FOR(nc) (void)(nc);
+#endif
+
+// Maximum number of threads and minimum number of elements per chunk.
+#define LBFGSB_MAX_THREADS 256
+#define LBFGSB_MIN_CHUNK   32768
+
+static inline int lbfgsb_nthreads(int nt, long n)
+{
+#ifdef _OPENMP
+    long nc = n/LBFGSB_MIN_CHUNK;
+    return (nc < nt ? (nc > 1 ? (int)nc : 1) : (nt > 1 ? nt : 1));
+#else
+    (void)nt;
+    (void)n;
+    return 1;
+#endif
+}
+
+static inline void lbfgsb_chunk(long n, int nc, int k, long* i0, long* i1)
+{
+    *i0 = (n/nc)*k + (k < n%nc ? k : n%nc);
+    *i1 = *i0 + n/nc + (k < n%nc ? 1 : 0);
+}
+
+// Index of the calling thread in a parallel region (0 outside).
+static inline int lbfgsb_thread_index(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Trials of the speculative line search (see lbfgsb_set_trials()).  The
+ * block `trial` stores the `nt` steps and the `nt` function values (in double
+ * precision), then the `nt` points and the `nt` gradients of `n` elements of
+ * `elsize` bytes.  lbfgsb_trial_vector() yields the address of the `j`-th
+ * point (`j < nt`) or of the `(j-nt)`-th gradient (`j >= nt`).
+ */
+#define LBFGSB_MAX_TRIALS 16
+
+static inline void* lbfgsb_trial_vector(void* trial, int nt, long n,
+                                        size_t elsize, int j)
+{
+    return (char*)trial + 2*nt*sizeof(double) + j*n*elsize;
+}
+
+/*
+ * Level-1 BLAS kernels for vectors of length `n` (see "lbfgsb_blas.c") using
+ * up to `nt` threads.  Vectors are contiguous and must not overlap.
+ * lbfgsb_blas_backend() yields "bundled" or "external" depending on the build
+ * settings.
+ */
+extern const char* lbfgsb_blas_backend(void);
+extern double lbfgsb_ddot(int nt, long n, const double x[], const double y[]);
+extern void lbfgsb_daxpy(int nt, long n, double a, const double x[],
+                         double y[]);
+extern void lbfgsb_dcopy(int nt, long n, const double x[], double y[]);
+extern void lbfgsb_dscal(int nt, long n, double a, double x[]);
+
+/*
+ * Same kernels for vectors in single precision.  The dot product is
+ * accumulated in double precision.
+ */
+extern double lbfgsb_sdot(int nt, long n, const float x[], const float y[]);
+extern void lbfgsb_saxpy(int nt, long n, double a, const float x[],
+                         float y[]);
+extern void lbfgsb_scopy(int nt, long n, const float x[], float y[]);
+extern void lbfgsb_sscal(int nt, long n, double a, float x[]);
+
+/*
+ * Advise the system that `len` bytes at `addr` (in the mapping of the
+ * correction history) will be needed soon.
+ */
+extern void lbfgsb_prefetch_(const void* addr, size_t len);
+
+/*
+ * Native implementation of `mainlb` (the main L-BFGS-B subroutine) for
+ * variables in double and in single precision.  The bounds `l` and `u` must
+ * have been checked and `ctx->wrks.nbd` set before starting the algorithm.
+ */
+extern void lbfgsb_mainlb(
+    lbfgsb_context* ctx,
+    const double    l[],
+    const double    u[],
+    double          x[],
+    double*         f,
+    double          g[]);
+
+extern void lbfgsb_mainlb_f32(
+    lbfgsb_context* ctx,
+    const float     l[],
+    const float     u[],
+    float           x[],
+    double*         f,
+    float           g[]);
+
+#endif // LBFGSB_PRIVATE_H
@@ -28,7 +28,8 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
      The method returns `x` the best solution found during iterations.
      Arguments `f`, `g` and `status` are optional output variables to store the
      value and the gradient of the objective at `x` and an integer code
-     indicating the reason of the termination of the algorithm.
+     indicating the reason of the termination of the algorithm (see
+     `ctx.status` in `lbfgsb_create`).
 
      The function `fg` shall be implemented as follows:
 
@@ -87,7 +88,10 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
 
      - Keywords `maxiter` and `maxeval` are to specify a maximum number of
        algorithm iterations or or evaluations of the objective function
-       implemented by `fg`.  By default, these are unlimited.
+       implemented by `fg`.  By default (or if negative), these are unlimited.
+
+     The tests on `fatol`, `xatol`, `xrtol`, `maxiter` and `maxeval` are
+     performed by the L-BFGS-B engine (see `lbfgsb_config`).
 
      - Keyword `verb`, if positive, specifies to print information every `verb`
        iterations.  Nothing is printed if `verb ≤ 0`.  By default, `verb = 0`.
@@ -108,8 +112,8 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
 
     // Parse settings.
     if (is_void(mem)) mem = 5;
-    if (is_void(maxiter)) maxiter = INF;
-    if (is_void(maxeval)) maxeval = INF;
+    if (is_void(maxiter)) maxiter = -1;
+    if (is_void(maxeval)) maxeval = -1;
     if (is_void(ftol)) ftol = 1.0E-8;
     if (is_void(gtol)) gtol = 1.0E-5;
     if (is_void(xtol)) xtol = 1.0E-6;
@@ -151,10 +155,16 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
         // Specify the bounds.
         lower = lower,
         upper = upper,
-        // Suppress the default output and code-supplied stopping tests.
+        // Suppress the default output and replace the code-supplied stopping
+        // tests on `factr` and `pgtol`.
         print = -1,
         factr = 0.0,
-        pgtol = 0.0;
+        pgtol = 0.0,
+        fatol = fatol,
+        xatol = xatol,
+        xrtol = xrtol,
+        maxiter = maxiter,
+        maxeval = maxeval;
 
     // Other initialization.
     x = double(x0);// initial iterate (forcing copy)
@@ -173,32 +183,26 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
     }
     f0 = f;
     gtest = [];
-    xtest = (xatol > 0 || xrtol > 0);
     while (TRUE) {
         task = lbfgsb_iterate(ctx, x, f, g);
         if (task == LBFGSB_FG) {
-            if (evals >= maxeval) {
-                task = lbfgsb_stop(
-                    ctx, "WARNING: Too many function evaluations");
-            } else {
-                f = fg(x, g);
-                ++evals;
-                if (f < best_f) {
-                    best_f = f;
-                    best_g = g;
-                    best_x = x;
-                }
-                if (evals == 1 && verb > 0) {
-                    write, output, format="%s%s\n%s%s\n",
-                        "# Iter.   Time (ms)   Eval.   Skips ",
-                        "       Obj. Func.           Grad.       Step",
-                        "# ----------------------------------",
-                        "-----------------------------------------------";
-                    gnorm = lbfgsb_pgnorm2(ctx, x, g);
-                    _lbfgsb_print;
-                }
-                continue;
+            f = fg(x, g);
+            ++evals;
+            if (f < best_f) {
+                best_f = f;
+                best_g = g;
+                best_x = x;
             }
+            if (evals == 1 && verb > 0) {
+                write, output, format="%s%s\n%s%s\n",
+                    "# Iter.   Time (ms)   Eval.   Skips ",
+                    "       Obj. Func.           Grad.       Step",
+                    "# ----------------------------------",
+                    "-----------------------------------------------";
+                gnorm = lbfgsb_pgnorm2(ctx, x, g);
+                _lbfgsb_print;
+            }
+            continue;
         }
         if (task == LBFGSB_NEW_X) {
             gnorm = lbfgsb_pgnorm2(ctx, x, g);
@@ -208,27 +212,11 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
             if (gnorm <= gtest) {
                 task = lbfgsb_stop(
                     ctx, "STOP: ‖∇f(x)‖ ≤ max(gatol, grtol⋅‖∇f(x0)‖)");
-            } else if (f <= fatol) {
-                task = lbfgsb_stop(
-                    ctx, "STOP: f(x) ≤ fatol");
             } else if (iters > 0 && abs(f - f0) <= frtol*max(abs(f), abs(f0))) {
                 task = lbfgsb_stop(
                     ctx, "STOP: |Δf(x)| ≤ frtol⋅|f(x)|");
-            } else if (xtest) {
-                s = x - x0;
-                snorm = sqrt(sum(s*s));
-                s = [];
-                if (snorm <= xatol ||
-                    xrtol > 0 && snorm <= xrtol*sqrt(sum(x*x))) {
-                    task = lbfgsb_stop(
-                        ctx, "STOP: ‖Δx| ≤ max(xatol, xrtol⋅‖x‖)");
-                }
             }
             ++iters;
-            if (iters >= maxiter) {
-                task = lbfgsb_stop(
-                    ctx, "WARNING: Too many algorithm iterations");
-            }
         }
         if (verb > 0 && ((iters % verb) == 0 || task != LBFGSB_NEW_X)) {
             _lbfgsb_print;
@@ -236,9 +224,6 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
         if (task != LBFGSB_NEW_X) {
             break;
         }
-        if (xtest && evals > 1) {
-            x0 = x;
-        }
     }
 
     // Restore best solution so far and return solution (and status).
@@ -250,6 +235,7 @@ func lbfgsb(fg, x0, &f, &g, &status, lower=, upper=, mem=, cputime=,
     if (verb > 0) {
         write, output, format="# Termination: %s\n", ctx.reason;
     }
+    status = ctx.status;
     return x;
 }
 
@@ -292,6 +278,9 @@ extern lbfgsb_create;
      - `ctx.pgtol`: the threshold on the infinite norm of the projected
        gradient (see `lbfgsb_config`);
 
+     - `ctx.fatol`, `ctx.xatol`, `ctx.xrtol`, `ctx.maxiter`, `ctx.maxeval`
+       and `ctx.deadline`: the other stopping criteria (see `lbfgsb_config`);
+
      - `ctx.niters`: the number of iterations of the algorithm;
 
      - `ctx.nevals`: the number of computations of the objective function and
@@ -316,8 +305,16 @@ extern lbfgsb_create;
 
      - `ctx.theta`: the scaling parameter of the BFGS matrix;
 
+     - `ctx.status`: the reason of the termination of the algorithm, one of
+       `LBFGSB_RUNNING` (not terminated), `LBFGSB_PGTOL_TEST`,
+       `LBFGSB_FACTR_TEST`, `LBFGSB_FATOL_TEST`, `LBFGSB_XTOL_TEST`,
+       `LBFGSB_TOO_MANY_ITERATIONS`, `LBFGSB_TOO_MANY_EVALUATIONS`,
+       `LBFGSB_DEADLINE_REACHED`, `LBFGSB_STOPPED` (stopped by the caller)
+       or `LBFGSB_FAILURE`.
+
      The bounds of the problem `ctx.lower` and `ctx.upper` and parameters
-     `ctx.factr`, `ctx.pgtol`, and `ctx.print` can be set with `lbfgsb_config`.
+     `ctx.factr`, `ctx.pgtol`, `ctx.print` and the other stopping criteria
+     can be set with `lbfgsb_config`.
 
      The possible values for `ctx.task` are:
 
@@ -353,7 +350,9 @@ extern lbfgsb_create;
  */
 
 extern lbfgsb_config;
-/* DOCUMENT lbfgsb_config, ctx, factr=, pgtol=, print=, upper=, lower=;
+/* DOCUMENT lbfgsb_config, ctx, factr=, pgtol=, print=, upper=, lower=,
+                          fatol=, xatol=, xrtol=, maxiter=, maxeval=,
+                          deadline=;
 
      Configure parameters of L-BFGS-B algorithm in context `ctx`.  The current
      tast `ctx.task` must be `LBFGSB_START`, that is `lbfgsb_iterate` must not
@@ -381,6 +380,28 @@ extern lbfgsb_config;
 
      where `pg_i` is the `i`-th component of the projected gradient.
 
+     Keyword `fatol` is to specify a threshold on the objective function, the
+     iteration will stop when `f ≤ fatol` (the default is `fatol = -Inf`).
+
+     Keywords `xatol ≥ 0` and `xrtol ≥ 0` are to specify absolute and
+     relative tolerances on the variables.  The iteration will stop when:
+
+         ‖x_{k+1} - x_{k}‖ ≤ max(xatol, xrtol⋅‖x_{k+1}‖)
+
+     where `‖…‖` is the Euclidean norm.  This test is disabled if both are
+     zero (the default).
+
+     Keywords `maxiter` and `maxeval` are to specify the maximum number of
+     iterations and of evaluations of the objective function (unlimited if
+     negative, the default).  The line search is interrupted, and the
+     previous iterate restored, rather than exceeding `maxeval`.
+
+     Keyword `deadline ≥ 0` is to specify the maximum wall-clock time (in
+     seconds) of the optimization (unlimited by default).
+
+     All these tests are performed by the L-BFGS-B engine, the reason of the
+     termination is given by `ctx.status`.
+
      If called as a function, returns the context `ctx`.
 
    SEE ALSO: lbfgsb_create, lbfgsb_iterate, lbfgsb_reset, lbfgsb_stop.
@@ -417,6 +438,10 @@ extern lbfgsb_stop;
 
 local LBFGSB_START, LBFGSB_FG, LBFGSB_NEW_X, LBFGSB_CONVERGENCE;
 local LBFGSB_STOP, LBFGSB_WARNING, LBFGSB_ERROR;
+local LBFGSB_RUNNING, LBFGSB_PGTOL_TEST, LBFGSB_FACTR_TEST, LBFGSB_FATOL_TEST;
+local LBFGSB_XTOL_TEST, LBFGSB_TOO_MANY_ITERATIONS;
+local LBFGSB_TOO_MANY_EVALUATIONS, LBFGSB_DEADLINE_REACHED, LBFGSB_STOPPED;
+local LBFGSB_FAILURE;
 extern lbfgsb_iterate;
 /* DOCUMENT task = lbfgsb_iterate(ctx, x, f, g);
 
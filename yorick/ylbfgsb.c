@@ -229,6 +229,10 @@ static void extract_context(
     lbfgsb_context* ctx = obj->ctx;
     switch (name[0]) {
     case 'd':
+        if (strcmp(name, "deadline") == 0) {
+            ypush_double(ctx->deadline);
+            return;
+        }
         if (strcmp(name, "dims") == 0) {
             int ndims = obj->dims[0];
             long* dims = ypush_l((long[2]){1, ndims+1});
@@ -249,6 +253,10 @@ static void extract_context(
             ypush_double(ctx->factr);
             return;
         }
+        if (strcmp(name, "fatol") == 0) {
+            ypush_double(ctx->fatol);
+            return;
+        }
         break;
    case 'l':
         if (strcmp(name, "lower") == 0) {
@@ -257,6 +265,14 @@ static void extract_context(
         }
         break;
     case 'm':
+        if (strcmp(name, "maxeval") == 0) {
+            ypush_long(ctx->maxeval);
+            return;
+        }
+        if (strcmp(name, "maxiter") == 0) {
+            ypush_long(ctx->maxiter);
+            return;
+        }
         if (strcmp(name, "mem") == 0) {
             ypush_long(ctx->mem);
             return;
@@ -306,6 +322,10 @@ static void extract_context(
             ypush_double(LBFGSB_STEP(ctx));
             return;
         }
+        if (strcmp(name, "status") == 0) {
+            ypush_long(lbfgsb_get_status(ctx));
+            return;
+        }
         break;
     case 't':
         if (strcmp(name, "task") == 0) {
@@ -323,6 +343,16 @@ static void extract_context(
             return;
         }
         break;
+    case 'x':
+        if (strcmp(name, "xatol") == 0) {
+            ypush_double(ctx->xatol);
+            return;
+        }
+        if (strcmp(name, "xrtol") == 0) {
+            ypush_double(ctx->xrtol);
+            return;
+        }
+        break;
     }
     y_error("bad member");
 }
@@ -413,14 +443,30 @@ void Y_lbfgsb_config(
     int argc)
 {
     // Keyword unique indices.
+    static long deadline_index = -1L;
+    if (deadline_index == -1L) {
+        deadline_index = yget_global("deadline", 0);
+    }
     static long factr_index = -1L;
     if (factr_index == -1L) {
         factr_index = yget_global("factr", 0);
     }
+    static long fatol_index = -1L;
+    if (fatol_index == -1L) {
+        fatol_index = yget_global("fatol", 0);
+    }
     static long lower_index = -1L;
     if (lower_index == -1L) {
         lower_index = yget_global("lower", 0);
     }
+    static long maxeval_index = -1L;
+    if (maxeval_index == -1L) {
+        maxeval_index = yget_global("maxeval", 0);
+    }
+    static long maxiter_index = -1L;
+    if (maxiter_index == -1L) {
+        maxiter_index = yget_global("maxiter", 0);
+    }
     static long pgtol_index = -1L;
     if (pgtol_index == -1L) {
         pgtol_index = yget_global("pgtol", 0);
@@ -433,6 +479,14 @@ void Y_lbfgsb_config(
     if (upper_index == -1L) {
         upper_index = yget_global("upper", 0);
     }
+    static long xatol_index = -1L;
+    if (xatol_index == -1L) {
+        xatol_index = yget_global("xatol", 0);
+    }
+    static long xrtol_index = -1L;
+    if (xrtol_index == -1L) {
+        xrtol_index = yget_global("xrtol", 0);
+    }
 
     // First pass on positional arguments.
     int drop = 0;
@@ -469,7 +523,15 @@ void Y_lbfgsb_config(
         } else {
             // Keyword argument.
             --iarg;
-            if (index == factr_index) {
+            if (index == deadline_index) {
+                if (!yarg_nil(iarg)) {
+                    double deadline = ygets_d(iarg);
+                    if (isnan(deadline) || deadline < 0) {
+                        y_error("bad value for parameter `deadline`");
+                    }
+                    ctx->deadline = deadline;
+                }
+            } else if (index == factr_index) {
                 if (!yarg_nil(iarg)) {
                     double factr = ygets_d(iarg);
                     if (isnan(factr) || factr < 0) {
@@ -477,10 +539,26 @@ void Y_lbfgsb_config(
                     }
                     ctx->factr = factr;
                 }
+            } else if (index == fatol_index) {
+                if (!yarg_nil(iarg)) {
+                    double fatol = ygets_d(iarg);
+                    if (isnan(fatol)) {
+                        y_error("bad value for parameter `fatol`");
+                    }
+                    ctx->fatol = fatol;
+                }
             } else if (index == lower_index) {
                 if (!yarg_nil(iarg)) {
                     set_bound(obj, ctx->lower, iarg);
                 }
+            } else if (index == maxeval_index) {
+                if (!yarg_nil(iarg)) {
+                    ctx->maxeval = ygets_l(iarg);
+                }
+            } else if (index == maxiter_index) {
+                if (!yarg_nil(iarg)) {
+                    ctx->maxiter = ygets_l(iarg);
+                }
             } else if (index == pgtol_index) {
                 if (!yarg_nil(iarg)) {
                     double pgtol = ygets_d(iarg);
@@ -497,6 +575,22 @@ void Y_lbfgsb_config(
                 if (!yarg_nil(iarg)) {
                     set_bound(obj, ctx->upper, iarg);
                 }
+            } else if (index == xatol_index) {
+                if (!yarg_nil(iarg)) {
+                    double xatol = ygets_d(iarg);
+                    if (isnan(xatol) || xatol < 0) {
+                        y_error("bad value for parameter `xatol`");
+                    }
+                    ctx->xatol = xatol;
+                }
+            } else if (index == xrtol_index) {
+                if (!yarg_nil(iarg)) {
+                    double xrtol = ygets_d(iarg);
+                    if (isnan(xrtol) || xrtol < 0) {
+                        y_error("bad value for parameter `xrtol`");
+                    }
+                    ctx->xrtol = xrtol;
+                }
             } else {
                 y_error("unsupported keyword");
             }
@@ -753,6 +847,16 @@ void Y_lbfgsb_init(
     DEFINE_LONG(LBFGSB_STOP);
     DEFINE_LONG(LBFGSB_WARNING);
     DEFINE_LONG(LBFGSB_ERROR);
+    DEFINE_LONG(LBFGSB_RUNNING);
+    DEFINE_LONG(LBFGSB_PGTOL_TEST);
+    DEFINE_LONG(LBFGSB_FACTR_TEST);
+    DEFINE_LONG(LBFGSB_FATOL_TEST);
+    DEFINE_LONG(LBFGSB_XTOL_TEST);
+    DEFINE_LONG(LBFGSB_TOO_MANY_ITERATIONS);
+    DEFINE_LONG(LBFGSB_TOO_MANY_EVALUATIONS);
+    DEFINE_LONG(LBFGSB_DEADLINE_REACHED);
+    DEFINE_LONG(LBFGSB_STOPPED);
+    DEFINE_LONG(LBFGSB_FAILURE);
 #undef DEFINE_LONG
     define_double("LBFGSB_INFINITY", (double)INFINITY);
     define_double("LBFGSB_NAN", (double)NAN);